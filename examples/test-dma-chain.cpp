@@ -0,0 +1,181 @@
+/*
+ * DMA chain test.
+ *
+ * Runs two lists of memory-to-memory transfers on DMA1 channel 1.
+ * Connect via SerialUSB, and press any key to start.
+ *
+ * The first gathers a header, a payload and a trailer from separate
+ * buffers into one packet, as a driver sending a packet through a
+ * peripheral would. The second loops, copying four stripes into a
+ * frame buffer over and over; the last stripe's callback counts the
+ * laps, and stops the chain after N_LAPS. Memory-to-memory transfers
+ * finish about as quickly as a transfer can, so this also checks
+ * that none of their interrupts get lost.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/dma_chain.h>
+
+#include <string.h>
+
+#define CHAIN_DEV    DMA1
+#define CHAIN_TUBE   DMA_CH1
+#define CHAIN_REQ    DMA_REQ_SRC_ADC1 // Any of the tube's will do
+
+#define PAYLOAD_LEN  32
+#define STRIPE_LEN   64
+#define N_STRIPES    4
+#define N_LAPS       1000
+
+uint8 header[4] = { 0xA5, 0x5A, 0x00, PAYLOAD_LEN };
+uint8 payload[PAYLOAD_LEN];
+uint8 trailer[2] = { 0xDE, 0xAD };
+uint8 packet[sizeof(header) + PAYLOAD_LEN + sizeof(trailer)];
+
+uint32 stripes[N_STRIPES][STRIPE_LEN];
+uint32 frame[N_STRIPES * STRIPE_LEN];
+
+dma_chain chain;
+dma_chain_desc gather[3];
+dma_chain_desc ring[N_STRIPES];
+volatile unsigned callbacks;
+volatile unsigned laps;
+
+void set_desc(dma_chain_desc *desc, void *src, void *dst, unsigned n,
+              dma_xfer_size size, dma_chain_desc *next,
+              dma_chain_callback callback) {
+    desc->cfg.tube_src = src;
+    desc->cfg.tube_src_size = size;
+    desc->cfg.tube_dst = dst;
+    desc->cfg.tube_dst_size = size;
+    desc->cfg.tube_nr_xfers = n;
+    desc->cfg.tube_flags = DMA_CFG_SRC_INC | DMA_CFG_DST_INC;
+    desc->cfg.target_data = NULL;
+    desc->cfg.tube_req_src = CHAIN_REQ;
+    desc->callback = callback;
+    desc->arg = NULL;
+    desc->next = next;
+}
+
+void count_callback(dma_chain *chain, dma_chain_desc *desc) {
+    callbacks++;
+}
+
+void lap_callback(dma_chain *chain, dma_chain_desc *desc) {
+    if (++laps == N_LAPS) {
+        dma_chain_stop(chain);
+    }
+}
+
+void wait_for_chain(void) {
+    uint32 start = millis();
+    while (dma_chain_is_running(&chain)) {
+        if (millis() - start > 1000) {
+            SerialUSB.println("FAILED: chain stalled");
+            dma_chain_stop(&chain);
+            return;
+        }
+    }
+}
+
+void test_gather(void) {
+    memset(packet, 0, sizeof(packet));
+    callbacks = 0;
+    set_desc(&gather[0], header, packet, sizeof(header),
+             DMA_SIZE_8BITS, &gather[1], count_callback);
+    set_desc(&gather[1], payload, packet + sizeof(header), PAYLOAD_LEN,
+             DMA_SIZE_8BITS, &gather[2], count_callback);
+    set_desc(&gather[2], trailer, packet + sizeof(header) + PAYLOAD_LEN,
+             sizeof(trailer), DMA_SIZE_8BITS, NULL, count_callback);
+
+    if (dma_chain_start(&chain, CHAIN_DEV, CHAIN_TUBE, gather,
+                        DMA_PRIORITY_LOW) != DMA_TUBE_CFG_SUCCESS) {
+        SerialUSB.println("FAILED: couldn't start gather chain");
+        return;
+    }
+    wait_for_chain();
+
+    SerialUSB.print("Gather: ");
+    if (chain.state != DMA_CHAIN_IDLE || callbacks != 3 ||
+        memcmp(packet, header, sizeof(header)) ||
+        memcmp(packet + sizeof(header), payload, PAYLOAD_LEN) ||
+        memcmp(packet + sizeof(header) + PAYLOAD_LEN, trailer,
+               sizeof(trailer))) {
+        SerialUSB.println("FAILED");
+    } else {
+        SerialUSB.println("ok");
+    }
+}
+
+void test_loop(void) {
+    memset(frame, 0, sizeof(frame));
+    laps = 0;
+    for (int i = 0; i < N_STRIPES; i++) {
+        set_desc(&ring[i], stripes[i], frame + i * STRIPE_LEN, STRIPE_LEN,
+                 DMA_SIZE_32BITS, &ring[(i + 1) % N_STRIPES],
+                 i == N_STRIPES - 1 ? lap_callback : NULL);
+    }
+
+    uint32 start = micros();
+    if (dma_chain_start(&chain, CHAIN_DEV, CHAIN_TUBE, ring,
+                        DMA_PRIORITY_LOW) != DMA_TUBE_CFG_SUCCESS) {
+        SerialUSB.println("FAILED: couldn't start looping chain");
+        return;
+    }
+    wait_for_chain();
+    uint32 elapsed = micros() - start;
+
+    SerialUSB.print("Loop: ");
+    SerialUSB.print(laps);
+    SerialUSB.print(" laps in ");
+    SerialUSB.print(elapsed);
+    SerialUSB.print(" us, ");
+    if (laps != N_LAPS || memcmp(frame, stripes, sizeof(frame))) {
+        SerialUSB.println("FAILED");
+    } else {
+        SerialUSB.println("ok");
+    }
+}
+
+void setup() {
+    for (int i = 0; i < PAYLOAD_LEN; i++) {
+        payload[i] = i * 7 + 3;
+    }
+    for (int i = 0; i < N_STRIPES; i++) {
+        for (int j = 0; j < STRIPE_LEN; j++) {
+            stripes[i][j] = (i << 16) | j;
+        }
+    }
+    dma_init(CHAIN_DEV);
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    test_gather();
+    test_loop();
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
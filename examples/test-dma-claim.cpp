@@ -0,0 +1,150 @@
+/*
+ * DMA tube ownership test.
+ *
+ * On STM32F1, USART3's RX requests and SPI1's TX requests both go to
+ * DMA1 channel 3, so the two can't use DMA at the same time. This
+ * checks that whichever asks second is turned away (and that
+ * HardwareSPI falls back to polling, even for transferAsync())
+ * instead of both breaking, and that the channel can be used again
+ * once it's released. It also claims every free memory-to-memory
+ * tube, and prints who owns each DMA1 channel along the way.
+ *
+ * No connections are needed. Connect via SerialUSB, and press any
+ * key to start.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/dma.h>
+#include <libmaple/spi.h>
+#include <libmaple/usart.h>
+
+HardwareSPI spi(1);
+uint8 tx_buf[64];
+uint8 rx_buf[64];
+int failures;
+volatile bool async_done;
+
+void set_async_done(void) {
+    async_done = true;
+}
+
+void check(const char *what, bool ok) {
+    SerialUSB.print(what);
+    SerialUSB.println(ok ? ": ok" : ": FAILED");
+    if (!ok) {
+        failures++;
+    }
+}
+
+void print_owners(void) {
+    SerialUSB.print("DMA1 owners:");
+    for (int ch = DMA_CH1; ch <= DMA_CH7; ch++) {
+        const void *owner = dma_tube_owner(DMA1, (dma_tube)ch);
+        SerialUSB.print(" ");
+        if (owner == USART3) {
+            SerialUSB.print("USART3");
+        } else if (owner == SPI1) {
+            SerialUSB.print("SPI1");
+        } else if (owner) {
+            SerialUSB.print((uint32)owner, HEX);
+        } else {
+            SerialUSB.print("-");
+        }
+    }
+    SerialUSB.println();
+}
+
+void test_contention(void) {
+    check("Serial3 RX DMA on", Serial3.enableRxDMA());
+    print_owners();
+    check("SPI1 DMA refused while channel 3 is taken",
+          spi_dma_xfer_start(SPI1, tx_buf, rx_buf, sizeof(tx_buf),
+                             NULL, NULL) < 0);
+    check("Serial3 still owns channel 3",
+          dma_tube_owner(DMA1, DMA_CH3) == USART3);
+
+    // HardwareSPI should quietly poll instead.
+    spi.transfer(tx_buf, rx_buf, sizeof(tx_buf));
+    check("SPI1 polled transfer done", !spi_dma_xfer_busy(SPI1));
+    async_done = false;
+    check("SPI1 transferAsync() polls",
+          spi.transferAsync(tx_buf, rx_buf, sizeof(tx_buf), set_async_done) &&
+          async_done);
+
+    Serial3.disableRxDMA();
+    check("channel 3 free again", dma_tube_owner(DMA1, DMA_CH3) == NULL);
+    check("SPI1 DMA allowed now",
+          spi_dma_xfer_start(SPI1, tx_buf, rx_buf, sizeof(tx_buf),
+                             NULL, NULL) == 0);
+    print_owners();
+    spi_dma_xfer_wait(SPI1);
+    check("SPI1 released its channels",
+          dma_tube_owner(DMA1, DMA_CH2) == NULL &&
+          dma_tube_owner(DMA1, DMA_CH3) == NULL);
+}
+
+void test_mem2mem(void) {
+    static uint8 owners[12];
+    dma_dev *dev[12];
+    dma_tube tube[12];
+    dma_request_src req_src;
+    int n = 0;
+
+    check("Serial3 RX DMA on", Serial3.enableRxDMA());
+    while (n < 12 &&
+           dma_claim_mem2mem(&owners[n], &dev[n], &tube[n], &req_src) == 0) {
+        n++;
+    }
+    print_owners();
+    SerialUSB.print("Free memory-to-memory tubes: ");
+    SerialUSB.println(n);
+    check("mem2mem claims skipped Serial3's channel",
+          dma_tube_owner(DMA1, DMA_CH3) == USART3);
+
+    while (n--) {
+        dma_tube_release(dev[n], tube[n], &owners[n]);
+    }
+    Serial3.disableRxDMA();
+}
+
+void setup() {
+    Serial3.begin(115200);
+    spi.begin(SPI_1_125MHZ, MSBFIRST, SPI_MODE_0);
+    for (unsigned i = 0; i < sizeof(tx_buf); i++) {
+        tx_buf[i] = i;
+    }
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    failures = 0;
+    test_contention();
+    test_mem2mem();
+    SerialUSB.print("Failures: ");
+    SerialUSB.println(failures);
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * DMA memcpy/memset benchmark.
+ *
+ * Times memcpy() and memset() from the C library against
+ * dma_memcpy() and dma_memset(), using the Cortex-M3 DWT cycle
+ * counter, for a range of sizes and alignments, and checks every
+ * result. Since the point of the DMA versions is to let the CPU do
+ * something else, it also counts how many times the CPU can go round
+ * an empty loop while dma_memcpy_async() copies the largest buffer.
+ *
+ * To test:
+ *
+ *     - Connect a serial monitor to SerialUSB
+ *     - Press any key
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/dma_memcpy.h>
+#include <libmaple/dwt.h>
+
+#include <string.h>
+
+#define MAX_LEN 4096
+
+/* A few extra bytes, so we can start at odd addresses. */
+uint8 src_buf[MAX_LEN + 4] __attribute__((aligned(4)));
+uint8 dst_buf[MAX_LEN + 4] __attribute__((aligned(4)));
+
+const uint32 sizes[] = { 16, 64, 256, 1024, MAX_LEN };
+#define N_SIZES (sizeof(sizes) / sizeof(sizes[0]))
+
+int failures;
+
+void check(const char *what, uint32 len, unsigned src_align,
+           unsigned dst_align, int ok) {
+    if (ok) {
+        return;
+    }
+    SerialUSB.print("FAILED: ");
+    SerialUSB.print(what);
+    SerialUSB.print(", length ");
+    SerialUSB.print(len);
+    SerialUSB.print(", alignments ");
+    SerialUSB.print(src_align);
+    SerialUSB.print("/");
+    SerialUSB.println(dst_align);
+    failures++;
+}
+
+int is_filled(const uint8 *buf, uint8 c, uint32 len) {
+    for (uint32 i = 0; i < len; i++) {
+        if (buf[i] != c) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bench_memcpy(unsigned src_align, unsigned dst_align) {
+    uint8 *src = src_buf + src_align;
+    uint8 *dst = dst_buf + dst_align;
+
+    SerialUSB.print("memcpy, alignments ");
+    SerialUSB.print(src_align);
+    SerialUSB.print("/");
+    SerialUSB.println(dst_align);
+    SerialUSB.println("\tbytes\tlibc\tDMA (cycles)");
+    for (unsigned i = 0; i < N_SIZES; i++) {
+        uint32 len = sizes[i];
+        uint32 start, libc, dma;
+
+        memset(dst_buf, 0, sizeof(dst_buf));
+        start = dwt_cyccnt();
+        memcpy(dst, src, len);
+        libc = dwt_cyccnt() - start;
+
+        memset(dst_buf, 0, sizeof(dst_buf));
+        start = dwt_cyccnt();
+        dma_memcpy(dst, src, len);
+        dma = dwt_cyccnt() - start;
+        check("dma_memcpy", len, src_align, dst_align,
+              !memcmp(dst, src, len) && dst[len] == 0);
+
+        SerialUSB.print("\t");
+        SerialUSB.print(len);
+        SerialUSB.print("\t");
+        SerialUSB.print(libc);
+        SerialUSB.print("\t");
+        SerialUSB.println(dma);
+    }
+}
+
+void bench_memset(unsigned dst_align) {
+    uint8 *dst = dst_buf + dst_align;
+
+    SerialUSB.print("memset, alignment ");
+    SerialUSB.println(dst_align);
+    SerialUSB.println("\tbytes\tlibc\tDMA (cycles)");
+    for (unsigned i = 0; i < N_SIZES; i++) {
+        uint32 len = sizes[i];
+        uint32 start, libc, dma;
+
+        memset(dst_buf, 0, sizeof(dst_buf));
+        start = dwt_cyccnt();
+        memset(dst, 0x5A, len);
+        libc = dwt_cyccnt() - start;
+
+        memset(dst_buf, 0, sizeof(dst_buf));
+        start = dwt_cyccnt();
+        dma_memset(dst, 0x5A, len);
+        dma = dwt_cyccnt() - start;
+        check("dma_memset", len, 0, dst_align,
+              is_filled(dst, 0x5A, len) && dst[len] == 0);
+
+        SerialUSB.print("\t");
+        SerialUSB.print(len);
+        SerialUSB.print("\t");
+        SerialUSB.print(libc);
+        SerialUSB.print("\t");
+        SerialUSB.println(dma);
+    }
+}
+
+volatile int callback_result = 1;
+
+void async_done(void *arg, int result) {
+    callback_result = result;
+}
+
+void bench_async(void) {
+    uint32 spins = 0;
+
+    memset(dst_buf, 0, sizeof(dst_buf));
+    callback_result = 1;
+    if (dma_memcpy_async(dst_buf, src_buf, MAX_LEN, async_done, NULL) < 0) {
+        check("dma_memcpy_async start", MAX_LEN, 0, 0, 0);
+        return;
+    }
+    while (dma_memcpy_busy()) {
+        spins++;
+    }
+    check("dma_memcpy_async", MAX_LEN, 0, 0,
+          callback_result == 0 && !memcmp(dst_buf, src_buf, MAX_LEN));
+
+    SerialUSB.print("CPU loop iterations during a ");
+    SerialUSB.print(MAX_LEN);
+    SerialUSB.print("-byte dma_memcpy_async(): ");
+    SerialUSB.println(spins);
+}
+
+void setup() {
+    dwt_cyccnt_enable();
+
+    for (unsigned i = 0; i < sizeof(src_buf); i++) {
+        src_buf[i] = i * 37 + 11;
+    }
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    failures = 0;
+    bench_memcpy(0, 0);
+    bench_memcpy(2, 0);
+    bench_memcpy(1, 0);
+    bench_memset(0);
+    bench_memset(3);
+    bench_async();
+    SerialUSB.print("Failures: ");
+    SerialUSB.println(failures);
+    SerialUSB.print("DMA_MEMCPY_MIN_LEN is ");
+    SerialUSB.print(DMA_MEMCPY_MIN_LEN);
+    SerialUSB.println("; shorter buffers are copied by the CPU.");
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Asynchronous I2C transfer test.
+ *
+ * Instructions: Connect an MCP4725 DAC (or anything else which
+ * answers reads at address 0x60) to I2C2, with pullups on SDA and
+ * SCL. Connect via SerialUSB, and press any key to start.
+ *
+ * Keeps N_XFERS reads queued on the bus at all times, requeueing each
+ * from its callback, while the main loop counts how often it gets to
+ * run. Every second, prints how many reads finished, how many failed,
+ * and the main loop's count. Also reads from an address nobody
+ * answers, to check that errors come back through the queue.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/i2c.h>
+
+#define DEV_ADDR     0x60
+#define MISSING_ADDR 0x7E
+#define N_XFERS      3
+
+uint8 rx_data[N_XFERS][5];
+i2c_msg msgs[N_XFERS];
+i2c_xfer xfers[N_XFERS];
+
+volatile uint32 n_done, n_failed;
+
+void xferDone(i2c_xfer *xfer) {
+    if (xfer->result == 0) {
+        n_done++;
+    } else {
+        n_failed++;
+    }
+    i2c_master_xfer_async(I2C2, xfer, xfer->msgs, 1, 2, xferDone, NULL);
+}
+
+void setup() {
+    i2c_master_enable(I2C2, 0);
+
+    for (int i = 0; i < N_XFERS; i++) {
+        msgs[i].addr = DEV_ADDR;
+        msgs[i].flags = I2C_MSG_READ;
+        msgs[i].length = sizeof(rx_data[i]);
+        msgs[i].xferred = 0;
+        msgs[i].data = rx_data[i];
+    }
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+
+    for (int i = 0; i < N_XFERS; i++) {
+        i2c_master_xfer_async(I2C2, &xfers[i], &msgs[i], 1, 2,
+                              xferDone, NULL);
+    }
+}
+
+void loop() {
+    uint8 byte;
+    i2c_msg missing = {MISSING_ADDR, I2C_MSG_READ, 1, 0, &byte};
+    uint32 start = millis();
+    uint32 spins = 0;
+
+    while (millis() - start < 1000) {
+        spins++;
+    }
+
+    SerialUSB.print("Reads done: ");
+    SerialUSB.print(n_done);
+    SerialUSB.print(", failed: ");
+    SerialUSB.print(n_failed);
+    SerialUSB.print(", main loop spins: ");
+    SerialUSB.println(spins);
+
+    SerialUSB.print("Read from missing device returned ");
+    SerialUSB.println(i2c_master_xfer(I2C2, &missing, 1, 2));
+
+    n_done = n_failed = 0;
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
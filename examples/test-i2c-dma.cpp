@@ -0,0 +1,113 @@
+/*
+ * I2C DMA test.
+ *
+ * Instructions: Connect a 24LC256 (or similar) EEPROM to I2C2 at
+ * address 0x50, with pullups on SDA and SCL. Connect via SerialUSB,
+ * and press any key to start. This overwrites the EEPROM's first
+ * page.
+ *
+ * Writes a page and reads it back in one combined transaction, for
+ * several lengths on either side of I2C_DMA_THRESHOLD, including the
+ * one- and two-byte reads which need special care. Longer messages
+ * go by DMA.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/i2c.h>
+
+#include <string.h>
+
+#define EEPROM_ADDR 0x50
+#define PAGE_SIZE   64
+
+uint8 page[2 + PAGE_SIZE];      // Address, then data
+uint8 readback[PAGE_SIZE];
+
+const uint16 lengths[] = {1, 2, 3, I2C_DMA_THRESHOLD - 1, I2C_DMA_THRESHOLD,
+                          I2C_DMA_THRESHOLD + 1, 33, PAGE_SIZE};
+
+int test_length(uint16 len, uint8 seed) {
+    i2c_msg msgs[2];
+    int32 rc;
+
+    page[0] = page[1] = 0;
+    for (uint16 i = 0; i < len; i++) {
+        page[2 + i] = seed + i * 7;
+    }
+
+    msgs[0].addr = EEPROM_ADDR;
+    msgs[0].flags = 0;
+    msgs[0].length = 2 + len;
+    msgs[0].data = page;
+    rc = i2c_master_xfer(I2C2, msgs, 1, 10);
+    if (rc) {
+        return rc;
+    }
+
+    // Wait out the write cycle; the EEPROM NACKs until it's done.
+    do {
+        msgs[0].length = 2;
+        rc = i2c_master_xfer(I2C2, msgs, 1, 10);
+    } while (rc == I2C_ERROR_PROTOCOL);
+
+    // Set the address, then read with a repeated start.
+    memset(readback, 0, sizeof(readback));
+    msgs[1].addr = EEPROM_ADDR;
+    msgs[1].flags = I2C_MSG_READ;
+    msgs[1].length = len;
+    msgs[1].data = readback;
+    rc = i2c_master_xfer(I2C2, msgs, 2, 10);
+    if (rc) {
+        return rc;
+    }
+    return memcmp(page + 2, readback, len) ? 1 : 0;
+}
+
+void setup() {
+    i2c_master_enable(I2C2, I2C_FAST_MODE);
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    static uint8 seed = 0;
+
+    for (unsigned i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        int rc = test_length(lengths[i], seed++);
+        SerialUSB.print("Length ");
+        SerialUSB.print(lengths[i]);
+        SerialUSB.print(": ");
+        if (rc == 0) {
+            SerialUSB.println("OK");
+        } else if (rc > 0) {
+            SerialUSB.println("data mismatch");
+        } else {
+            SerialUSB.print("error ");
+            SerialUSB.println(rc);
+        }
+    }
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
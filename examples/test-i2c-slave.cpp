@@ -0,0 +1,145 @@
+/*
+ * I2C slave mode test.
+ *
+ * Instructions: Connect I2C1's SDA and SCL to I2C2's, with pullups.
+ * Connect via SerialUSB, and press any key to start.
+ *
+ * I2C2 acts as a slave with a bank of registers, and I2C1 as a
+ * master talking to it. The master writes a block of registers,
+ * then sets the register pointer and reads them back with a
+ * repeated start. Blocks are long enough for the slave to use DMA.
+ * The slave's read callback also asks to hold the bus once, and the
+ * main loop releases it a few milliseconds later, so the master's
+ * read has to wait.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/i2c.h>
+
+#include <string.h>
+
+#define SLAVE_ADDR 0x42
+#define N_REGS     64
+#define BLOCK_REG  8
+#define BLOCK_LEN  40
+
+uint8 regs[N_REGS];
+i2c_slave slave;
+
+volatile uint32 n_reads, n_writes;
+volatile uint16 last_write_reg, last_write_len;
+volatile int hold_next_read;
+
+int slaveRead(i2c_slave *s, uint16 reg) {
+    n_reads++;
+    if (hold_next_read) {
+        hold_next_read = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int slaveWrite(i2c_slave *s, uint16 reg, uint16 len) {
+    n_writes++;
+    last_write_reg = reg;
+    last_write_len = len;
+    return 0;
+}
+
+void setup() {
+    slave.addr = SLAVE_ADDR;
+    slave.addr2 = 0;
+    slave.regs = regs;
+    slave.size = N_REGS;
+    slave.read_callback = slaveRead;
+    slave.write_callback = slaveWrite;
+    slave.arg = NULL;
+    i2c_slave_enable(I2C2, &slave, I2C_SLAVE_USE_DMA);
+
+    i2c_master_enable(I2C1, 0);
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    uint8 out[1 + BLOCK_LEN];
+    uint8 in[BLOCK_LEN];
+    uint8 reg = BLOCK_REG;
+    i2c_msg msgs[2];
+    i2c_xfer xfer;
+    uint32 start;
+    int32 rc;
+
+    n_reads = n_writes = 0;
+    out[0] = BLOCK_REG;
+    for (int i = 0; i < BLOCK_LEN; i++) {
+        out[1 + i] = random(256);
+    }
+
+    msgs[0].addr = SLAVE_ADDR;
+    msgs[0].flags = 0;
+    msgs[0].length = sizeof(out);
+    msgs[0].data = out;
+    rc = i2c_master_xfer(I2C1, msgs, 1, 10);
+    SerialUSB.print("Write: ");
+    SerialUSB.print(rc);
+    SerialUSB.print(", slave saw ");
+    SerialUSB.print(last_write_len);
+    SerialUSB.print(" registers at ");
+    SerialUSB.print(last_write_reg);
+    SerialUSB.print(", contents ");
+    SerialUSB.println(memcmp(out + 1, regs + BLOCK_REG, BLOCK_LEN) ?
+                      "WRONG" : "OK");
+
+    memset(in, 0, sizeof(in));
+    msgs[0].length = 1;
+    msgs[0].data = &reg;
+    msgs[1].addr = SLAVE_ADDR;
+    msgs[1].flags = I2C_MSG_READ;
+    msgs[1].length = sizeof(in);
+    msgs[1].data = in;
+    hold_next_read = 1;
+    i2c_master_xfer_async(I2C1, &xfer, msgs, 2, 50, NULL, NULL);
+
+    start = millis();
+    while (millis() - start < 5)
+        ;
+    SerialUSB.print("Read held: ");
+    SerialUSB.println(i2c_xfer_is_done(&xfer) ? "NO" : "yes");
+    i2c_slave_release(I2C2);
+    while (!i2c_xfer_is_done(&xfer))
+        ;
+    SerialUSB.print("Read: ");
+    SerialUSB.print(xfer.result);
+    SerialUSB.print(", contents ");
+    SerialUSB.println(memcmp(out + 1, in, BLOCK_LEN) ? "WRONG" : "OK");
+
+    SerialUSB.print("Slave callbacks, reads/writes: ");
+    SerialUSB.print(n_reads);
+    SerialUSB.print("/");
+    SerialUSB.println(n_writes);
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Print number formatting benchmark.
+ *
+ * Measures how many CPU cycles println(uint32) takes to format its
+ * argument, using the Cortex-M3 DWT cycle counter. Output goes to a
+ * Print which throws it away, so only the formatting is timed, not
+ * the serial port. For comparison, the same values are also run
+ * through a copy of the old printNumber(), which divided a 64-bit
+ * value once per digit.
+ *
+ * To test:
+ *
+ *     - Connect a serial monitor to SerialUSB
+ *     - Press any key
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/dwt.h>
+
+#include <limits.h>
+
+class NullPrint : public Print {
+public:
+    virtual void write(uint8) { }
+    virtual void write(const void*, uint32) { }
+    using Print::write;
+};
+
+/* The old Print::printNumber(), for comparison. */
+class OldPrint : public NullPrint {
+public:
+    void oldPrintln(uint32 n) {
+        unsigned long long nn = n;
+        unsigned char buf[CHAR_BIT * sizeof(long long)];
+        unsigned long i = 0;
+
+        if (nn == 0) {
+            write('0');
+        } else {
+            while (nn > 0) {
+                buf[i++] = nn % 10;
+                nn /= 10;
+            }
+            for (; i > 0; i--) {
+                write((uint8)('0' + buf[i - 1]));
+            }
+        }
+        write('\r');
+        write('\n');
+    }
+};
+
+NullPrint newPrint;
+OldPrint oldPrint;
+
+const uint32 values[] = {0, 7, 42, 1234, 65535, 1000000, 123456789,
+                         4294967295U};
+#define N_VALUES (sizeof(values) / sizeof(values[0]))
+#define N_REPS 100
+
+void setup() {
+    dwt_cyccnt_enable();
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    SerialUSB.println("Cycles per println(uint32), old vs. new:");
+    for (uint32 i = 0; i < N_VALUES; i++) {
+        uint32 start, oldCycles, newCycles;
+
+        start = dwt_cyccnt();
+        for (int rep = 0; rep < N_REPS; rep++) {
+            oldPrint.oldPrintln(values[i]);
+        }
+        oldCycles = (dwt_cyccnt() - start) / N_REPS;
+
+        start = dwt_cyccnt();
+        for (int rep = 0; rep < N_REPS; rep++) {
+            newPrint.println(values[i]);
+        }
+        newCycles = (dwt_cyccnt() - start) / N_REPS;
+
+        SerialUSB.print(values[i]);
+        SerialUSB.print(":\t");
+        SerialUSB.print(oldCycles);
+        SerialUSB.print("\t");
+        SerialUSB.println(newCycles);
+    }
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
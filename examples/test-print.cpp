@@ -160,6 +160,22 @@ void test_floating_point(void) {
     SerialUSB.println(-5.67f);
     SerialUSB.print("Float max: ");
     SerialUSB.println(fmax);
+
+    SerialUSB.println();
+
+    SerialUSB.print("println(0.1f, SHORTEST) (expect 0.1): ");
+    SerialUSB.println(0.1f, SHORTEST);
+    SerialUSB.print("println(0.1, 20); from snprintf(): ");
+    SerialUSB.print(0.1, 20);
+    SerialUSB.print("; ");
+    snprintf(buf, BUF_SIZE, "%.20f", 0.1);
+    SerialUSB.println(buf);
+    SerialUSB.print("DBL_MAX, SHORTEST (expect 1.7976931348623157e+308): ");
+    SerialUSB.println(dmax, SHORTEST);
+    SerialUSB.print("println(2.5, 0), println(3.5, 0) (expect 2, 4): ");
+    SerialUSB.print(2.5, 0);
+    SerialUSB.print(", ");
+    SerialUSB.println(3.5, 0);
 }
 
 void print_separator(void) {
@@ -0,0 +1,146 @@
+/*
+ * Bulk ring_buffer test.
+ *
+ * Exercises rb_write_n(), rb_read_n(), rb_peek_span()/rb_consume(),
+ * and rb_reserve_span()/rb_commit() on a power-of-two ring buffer,
+ * across wraparound, and checks the results against the single-byte
+ * routines.
+ *
+ * To test:
+ *
+ *     - Connect a serial monitor to SerialUSB
+ *     - Press any key
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+
+#include <libmaple/ring_buffer.h>
+
+#define BUF_SIZE 64
+ring_buffer ring_buf;
+ring_buffer *rb;
+uint8 rb_buffer[BUF_SIZE];
+
+uint8 next_in;                  // Next value we expect to write
+uint8 next_out;                 // Next value we expect to read
+int failures;
+
+void check(bool ok, const char what[]);
+void test_write_read(uint16 chunk);
+void test_spans(uint16 chunk);
+
+void setup() {
+    rb = &ring_buf;
+    rb_init(rb, BUF_SIZE, rb_buffer);
+
+    while (!SerialUSB.available())
+        ;
+
+    SerialUSB.println("Beginning test.");
+    SerialUSB.println();
+}
+
+void loop() {
+    check(rb_is_pow2(rb), "rb_is_pow2()");
+    // Odd chunk sizes make sure we wrap around in different places.
+    for (uint16 chunk = 1; chunk < BUF_SIZE; chunk += 7) {
+        test_write_read(chunk);
+        test_spans(chunk);
+    }
+
+    SerialUSB.println();
+    SerialUSB.print("Test finished, failures: ");
+    SerialUSB.println(failures);
+    while (true)
+        ;
+}
+
+void check(bool ok, const char what[]) {
+    if (!ok) {
+        failures++;
+        SerialUSB.print("FAIL: ");
+        SerialUSB.println(what);
+    }
+}
+
+void test_write_read(uint16 chunk) {
+    uint8 in[BUF_SIZE];
+    uint8 out[BUF_SIZE];
+
+    SerialUSB.print("rb_write_n()/rb_read_n(), chunk = ");
+    SerialUSB.println(chunk);
+    for (int pass = 0; pass < 10; pass++) {
+        for (uint16 i = 0; i < chunk; i++) {
+            in[i] = next_in++;
+        }
+        uint16 written = rb_write_n(rb, in, chunk);
+        check(written == chunk, "rb_write_n() count");
+        check(rb_masked_count(rb) == rb_full_count(rb), "rb_masked_count()");
+
+        uint16 nread = rb_read_n(rb, out, BUF_SIZE);
+        check(nread == written, "rb_read_n() count");
+        for (uint16 i = 0; i < nread; i++) {
+            check(out[i] == next_out++, "rb_read_n() data");
+        }
+        check(rb_is_empty(rb), "empty after rb_read_n()");
+    }
+
+    // Overfilling must stop at capacity, like rb_safe_insert().
+    uint16 total = 0;
+    while (rb_masked_space(rb)) {
+        in[0] = next_in++;
+        total += rb_write_n(rb, in, 1);
+    }
+    check(total == BUF_SIZE - 1, "capacity");
+    check(rb_write_n(rb, in, 1) == 0, "rb_write_n() when full");
+    while (!rb_is_empty(rb)) {
+        check(rb_remove(rb) == next_out++, "rb_remove() data");
+    }
+}
+
+void test_spans(uint16 chunk) {
+    SerialUSB.print("rb_reserve_span()/rb_peek_span(), chunk = ");
+    SerialUSB.println(chunk);
+    for (int pass = 0; pass < 10; pass++) {
+        uint16 left = chunk;
+        while (left) {
+            uint8 *span;
+            uint16 n = rb_reserve_span(rb, &span);
+            check(n > 0, "rb_reserve_span() nonempty");
+            if (n > left) {
+                n = left;
+            }
+            for (uint16 i = 0; i < n; i++) {
+                span[i] = next_in++;
+            }
+            rb_commit(rb, n);
+            left -= n;
+        }
+
+        while (!rb_is_empty(rb)) {
+            uint8 *span;
+            uint16 n = rb_peek_span(rb, &span);
+            for (uint16 i = 0; i < n; i++) {
+                check(span[i] == next_out++, "rb_peek_span() data");
+            }
+            rb_consume(rb, n);
+        }
+    }
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -7,7 +7,8 @@
 #define BIGSTUFF    1
 #define NUMBERS     2
 #define SIMPLE      3
-#define ONOFF       4
+#define READ        4
+#define ONOFF       5
 
 uint32 state = 0;
 
@@ -92,6 +93,20 @@ void loop() {
             Serial2.println("Trying println(\"DONE\")");
             SerialUSB.println("DONE");
             break;
+        case READ: {
+            char buf[8];
+            uint32 n;
+            SerialUSB.println("Type up to 8 characters in the next 2 seconds");
+            n = SerialUSB.readBytes(buf, sizeof(buf), 2000);
+            Serial2.print("readBytes() got ");
+            Serial2.println(n, DEC);
+            SerialUSB.write(buf, n);
+            SerialUSB.println();
+            n = SerialUSB.readAvailable(buf, sizeof(buf));
+            Serial2.print("readAvailable() got ");
+            Serial2.println(n, DEC);
+            break;
+        }
         case ONOFF:
             Serial2.println("Shutting down...");
             SerialUSB.println("Shutting down...");
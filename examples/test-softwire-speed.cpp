@@ -0,0 +1,90 @@
+/*
+ * Software I2C (TwoWire) clock rate test.
+ *
+ * Instructions: Connect an I2C device which can keep up with
+ * Fast-mode Plus (or Fast mode; the 1 MHz run will then fail) to
+ * pins 19 (SDA) and 20 (SCL), with pullups strong enough for the
+ * speed. Set DEV_ADDR to its address. It gets written with zeros,
+ * so don't use anything whose contents matter. Connect via
+ * SerialUSB, and press any key to start.
+ *
+ * For each supported frequency, sends a batch of writes, and prints
+ * the resulting SCL rate, worked out from the number of clock
+ * cycles (9 per byte) and the time taken. Start and stop conditions
+ * are counted as a clock each, so the result is a slight
+ * underestimate. Check the waveform with a scope or logic analyzer
+ * to be sure.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <Wire/Wire.h>
+
+#include <string.h>
+
+#define DEV_ADDR 0x50
+#define N_BYTES  16
+#define N_WRITES 100
+
+const uint32 freqs[] = {SOFT_STANDARD, SOFT_FAST, SOFT_FAST_PLUS};
+
+void test_freq(uint32 freq) {
+    TwoWire bus(SCL, SDA, freq);
+    uint8 data[N_BYTES];
+    uint32 start, elapsed, clocks;
+    int errors = 0;
+
+    memset(data, 0, sizeof(data));
+    bus.begin();
+
+    start = micros();
+    for (int i = 0; i < N_WRITES; i++) {
+        bus.beginTransmission(DEV_ADDR);
+        bus.send(data, sizeof(data));
+        if (bus.endTransmission() != SUCCESS) {
+            errors++;
+        }
+    }
+    elapsed = micros() - start;
+    clocks = N_WRITES * (9 * (1 + N_BYTES) + 2);
+
+    SerialUSB.print("Asked for ");
+    SerialUSB.print(freq / 1000);
+    SerialUSB.print(" kHz, got ");
+    SerialUSB.print(clocks * 1000 / elapsed);
+    SerialUSB.print(" kHz, errors: ");
+    SerialUSB.println(errors);
+}
+
+void setup() {
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    for (unsigned i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++) {
+        test_freq(freqs[i]);
+    }
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
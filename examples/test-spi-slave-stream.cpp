@@ -0,0 +1,162 @@
+/*
+ * SPI slave streaming test.
+ *
+ * Instructions: On a Maple, connect SPI1's SCK, MOSI and MISO to
+ * SPI2's (pins 13, 11, 12 to 32, 34, 33), and pin 10 to SPI2's NSS
+ * (pin 31). Connect via SerialUSB, and press any key to start.
+ *
+ * SPI2 streams everything it receives into a ring buffer, and SPI1
+ * plays the part of an FPGA, sending it numbered frames in bursts
+ * of varying length. The main loop drains the ring buffer and checks
+ * that nothing was lost, and that a burst ended at each NSS release.
+ * SPI2 sends a fixed pattern back the whole time. Finally, SPI1
+ * sends a few buffers' worth without the main loop reading, to check
+ * that the overrun is noticed.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+
+HardwareSPI master(1);
+HardwareSPI slave(2);
+
+#define MASTER_CS 10
+#define RING_LEN  64
+#define N_BURSTS  100
+
+uint8 ring[RING_LEN];
+uint8 pattern[RING_LEN];
+uint8 burst[RING_LEN / 2];
+uint8 echo[RING_LEN / 2];
+
+volatile uint32 n_halves, n_asserted, n_released, n_errors;
+volatile uint16 burst_end;
+
+void streamEvent(spi_stream_event event) {
+    switch (event) {
+    case SPI_STREAM_HALF:
+    case SPI_STREAM_FULL:
+        n_halves++;
+        break;
+    case SPI_STREAM_ERROR:
+        n_errors++;
+        break;
+    case SPI_STREAM_NSS_ASSERTED:
+        n_asserted++;
+        break;
+    case SPI_STREAM_NSS_RELEASED:
+        burst_end = slave.streamPosition();
+        n_released++;
+        break;
+    }
+}
+
+void setup() {
+    for (int i = 0; i < RING_LEN; i++) {
+        pattern[i] = 0xA0 + (i & 0xF);
+    }
+
+    pinMode(MASTER_CS, OUTPUT);
+    digitalWrite(MASTER_CS, HIGH);
+    master.begin(SPI_1_125MHZ, MSBFIRST, 0);
+    slave.beginSlave(MSBFIRST, 0);
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    uint8 expected = 0, next = 0, got;
+    uint32 received = 0, bad = 0, bad_echo = 0, misframed = 0;
+
+    n_halves = n_asserted = n_released = n_errors = 0;
+    if (!slave.beginSlaveStream(ring, pattern, RING_LEN, streamEvent)) {
+        SerialUSB.println("Couldn't start the stream!");
+        while (true)
+            ;
+    }
+
+    for (int i = 0; i < N_BURSTS; i++) {
+        uint32 len = 1 + i % sizeof(burst);
+        for (uint32 j = 0; j < len; j++) {
+            burst[j] = next++;
+        }
+
+        digitalWrite(MASTER_CS, LOW);
+        master.transfer(burst, echo, len);
+        digitalWrite(MASTER_CS, HIGH);
+        delayMicroseconds(20);
+
+        for (uint32 j = 1; j < len; j++) {
+            if ((echo[j] & 0xF0) != 0xA0) {
+                bad_echo++;
+            }
+        }
+        while (slave.streamRead(&got, 1)) {
+            if (got != expected++) {
+                bad++;
+            }
+            received++;
+        }
+        if (burst_end != slave.streamPosition()) {
+            misframed++;
+        }
+    }
+    bool overrun_early = slave.streamOverrun();
+
+    // Fall a few laps behind.
+    for (int i = 0; i < 3 * RING_LEN / (int)sizeof(burst); i++) {
+        digitalWrite(MASTER_CS, LOW);
+        master.transfer(burst, echo, sizeof(burst));
+        digitalWrite(MASTER_CS, HIGH);
+    }
+    delayMicroseconds(20);
+    bool overrun_late = slave.streamOverrun();
+    uint32 left_over = slave.streamAvailable();
+    slave.endSlaveStream();
+
+    SerialUSB.print("Frames received: ");
+    SerialUSB.print(received);
+    SerialUSB.print(", out of sequence: ");
+    SerialUSB.println(bad);
+    SerialUSB.print("Bad echoes: ");
+    SerialUSB.println(bad_echo);
+    SerialUSB.print("Half buffers: ");
+    SerialUSB.print(n_halves);
+    SerialUSB.print(", DMA errors: ");
+    SerialUSB.println(n_errors);
+    SerialUSB.print("NSS asserted/released: ");
+    SerialUSB.print(n_asserted);
+    SerialUSB.print("/");
+    SerialUSB.print(n_released);
+    SerialUSB.print(", misframed bursts: ");
+    SerialUSB.println(misframed);
+    SerialUSB.print("Overrun while keeping up: ");
+    SerialUSB.print(overrun_early ? "yes (FAILED)" : "no");
+    SerialUSB.print(", after falling behind: ");
+    SerialUSB.print(overrun_late ? "yes" : "no (FAILED)");
+    SerialUSB.print(", frames left: ");
+    SerialUSB.println(left_over);
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
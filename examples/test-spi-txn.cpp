@@ -0,0 +1,121 @@
+/*
+ * Shared SPI bus transaction queue test.
+ *
+ * Instructions: Connect SPI1's MISO to its MOSI. Optionally, watch
+ * SCK and pins 9 and 10, which stand in for two devices' chip
+ * selects, with a logic analyzer. Connect via SerialUSB, and press
+ * any key to start.
+ *
+ * Queues transactions for two devices with different settings,
+ * then checks that each one's data came back and its callback ran.
+ * The main loop only waits on the last one.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/spi_txn.h>
+
+#include <string.h>
+
+HardwareSPI spi(1);
+
+#define DEV_A_CS 9
+#define DEV_B_CS 10
+
+spi_txn_device dev_a, dev_b;
+
+uint8 cmd[4] = {0x9F, 0x01, 0x02, 0x03};
+uint8 cmd_rx[4];
+uint16 samples[64];
+uint16 samples_rx[64];
+uint8 tail[200];
+uint8 tail_rx[200];
+
+spi_txn txns[3];
+volatile int n_callbacks;
+
+void txnDone(spi_txn *txn) {
+    n_callbacks++;
+}
+
+void initDevice(spi_txn_device *dev, uint8 cs_pin, spi_baud_rate baud,
+                spi_mode mode, uint32 flags) {
+    pinMode(cs_pin, OUTPUT);
+    spi_txn_device_init(dev, spi.c_dev(), PIN_MAP[cs_pin].gpio_device,
+                        PIN_MAP[cs_pin].gpio_bit, baud, mode, flags);
+}
+
+void queue(spi_txn *txn, spi_txn_device *dev, const void *tx, void *rx,
+           uint16 len, uint8 flags) {
+    txn->device = dev;
+    txn->tx_buf = tx;
+    txn->rx_buf = rx;
+    txn->len = len;
+    txn->flags = flags;
+    txn->callback = txnDone;
+    if (spi_txn_submit(txn)) {
+        SerialUSB.println("spi_txn_submit() FAILED");
+    }
+}
+
+void setup() {
+    spi.begin(SPI_9MHZ, MSBFIRST, 0);
+    initDevice(&dev_a, DEV_A_CS, SPI_BAUD_PCLK_DIV_8, SPI_MODE_0, 0);
+    initDevice(&dev_b, DEV_B_CS, SPI_BAUD_PCLK_DIV_4, SPI_MODE_3,
+               SPI_DFF_16_BIT);
+
+    for (unsigned i = 0; i < 64; i++) {
+        samples[i] = i * 1031;
+    }
+    for (unsigned i = 0; i < sizeof(tail); i++) {
+        tail[i] = i;
+    }
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    memset(cmd_rx, 0, sizeof(cmd_rx));
+    memset(samples_rx, 0, sizeof(samples_rx));
+    memset(tail_rx, 0, sizeof(tail_rx));
+    n_callbacks = 0;
+
+    /* A command and its payload under one chip select, with the
+     * other device's transaction in between. */
+    queue(&txns[0], &dev_a, cmd, cmd_rx, sizeof(cmd), SPI_TXN_KEEP_CS);
+    queue(&txns[1], &dev_b, samples, samples_rx, 64, 0);
+    queue(&txns[2], &dev_a, tail, tail_rx, sizeof(tail), 0);
+    spi_txn_wait(&txns[2]);
+
+    SerialUSB.print("8-bit: ");
+    SerialUSB.println(memcmp(cmd, cmd_rx, sizeof(cmd)) ||
+                      memcmp(tail, tail_rx, sizeof(tail)) ? "FAILED" : "ok");
+    SerialUSB.print("16-bit: ");
+    SerialUSB.println(memcmp(samples, samples_rx, sizeof(samples)) ?
+                      "FAILED" : "ok");
+    SerialUSB.print("Callbacks: ");
+    SerialUSB.println(n_callbacks);
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * spsc_queue stress test.
+ *
+ * A timer interrupt pushes an increasing sequence of 32-bit values
+ * into a spsc_queue while loop() pops them, without either side ever
+ * disabling interrupts. With SPSC_DROP_NEWEST, the consumer must see
+ * every value that wasn't dropped, in order. With
+ * SPSC_OVERWRITE_OLDEST, it may miss values, but what it sees must
+ * still be strictly increasing.
+ *
+ * Before that, it checks the byte queue routines (spsc_write_n(),
+ * spsc_read_n() and friends) once, from loop() alone.
+ *
+ * To test:
+ *
+ *     - Connect a serial monitor to SerialUSB
+ *     - Press any key
+ *     - Press the button to switch between policies
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+
+#include <libmaple/spsc_queue.h>
+
+#include <string.h>
+
+#define N_ELTS 16
+spsc_queue queue;
+uint32 storage[N_ELTS];
+spsc_policy policy = SPSC_DROP_NEWEST;
+
+volatile uint32 produced;       // Producer-side only
+uint32 expected;                // Consumer-side only
+uint32 received;
+uint32 errors;
+
+HardwareTimer timer(2);
+
+void producer(void) {
+    uint32 value = produced++;
+    spsc_push(&queue, &value);
+}
+
+void start(void) {
+    timer.pause();
+    spsc_init(&queue, storage, sizeof(storage[0]), N_ELTS, policy);
+    produced = expected = received = errors = 0;
+
+    SerialUSB.print("Policy: ");
+    SerialUSB.println(policy == SPSC_DROP_NEWEST ?
+                      "SPSC_DROP_NEWEST" : "SPSC_OVERWRITE_OLDEST");
+
+    timer.setPeriod(20);        // microseconds
+    timer.setMode(TIMER_CH1, TIMER_OUTPUT_COMPARE);
+    timer.setCompare(TIMER_CH1, 1);
+    timer.attachInterrupt(TIMER_CH1, producer);
+    timer.refresh();
+    timer.resume();
+}
+
+// Returns the number of failed checks.
+uint32 test_bytes(void) {
+    spsc_queue q;
+    uint8 buf[8];
+    uint8 in[12];
+    uint8 out[12];
+    uint32 failed = 0;
+
+    for (unsigned i = 0; i < sizeof(in); i++) {
+        in[i] = i + 1;
+    }
+    spsc_init(&q, buf, 1, sizeof(buf), SPSC_DROP_NEWEST);
+
+    // Fill, wrap around the end, and peek across it.
+    failed += spsc_write_n(&q, in, 5) != 5;
+    failed += spsc_read_n(&q, out, 5) != 5 || memcmp(out, in, 5);
+    failed += spsc_write_n(&q, in, 12) != 8;
+    failed += spsc_take_dropped(&q) != 4;
+    failed += spsc_peek_n(&q, out, 12) != 8 || memcmp(out, in, 8);
+    failed += spsc_read_n(&q, out, 3) != 3 || memcmp(out, in, 3);
+    spsc_clear(&q);
+    failed += !spsc_is_empty(&q);
+
+    // Bytes stored in place, as by DMA, overwriting the oldest.
+    spsc_init(&q, buf, 1, sizeof(buf), SPSC_OVERWRITE_OLDEST);
+    memcpy(buf, in, sizeof(buf));
+    spsc_produced(&q, 6);
+    spsc_produced(&q, 4);
+    failed += spsc_count(&q) != 8 || spsc_take_dropped(&q) != 2;
+    failed += spsc_read_n(&q, out, 2) != 2 || out[0] != in[2];
+
+    return failed;
+}
+
+void setup() {
+    pinMode(BOARD_LED_PIN, OUTPUT);
+    pinMode(BOARD_BUTTON_PIN, INPUT);
+
+    while (!SerialUSB.available())
+        ;
+
+    SerialUSB.print("Byte queue checks failed: ");
+    SerialUSB.println(test_bytes());
+    SerialUSB.println("Beginning test.");
+    start();
+}
+
+void loop() {
+    uint32 value;
+
+    // Pop in bursts, with pauses, so the queue fills up sometimes.
+    for (int i = 0; i < 1000; i++) {
+        if (!spsc_pop(&queue, &value)) {
+            continue;
+        }
+        received++;
+        if (value < expected) {
+            errors++;
+        }
+        expected = value + 1;
+    }
+    delayMicroseconds(500);
+
+    static uint32 last_report;
+    if (millis() - last_report > 1000) {
+        last_report = millis();
+        toggleLED();
+        SerialUSB.print("received: ");
+        SerialUSB.print(received);
+        SerialUSB.print("\tlast: ");
+        SerialUSB.print(expected);
+        SerialUSB.print("\terrors: ");
+        SerialUSB.println(errors);
+    }
+
+    if (isButtonPressed()) {
+        policy = (policy == SPSC_DROP_NEWEST ?
+                  SPSC_OVERWRITE_OLDEST : SPSC_DROP_NEWEST);
+        start();
+    }
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
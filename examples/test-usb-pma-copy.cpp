@@ -0,0 +1,177 @@
+/*
+ * USB packet memory (PMA) copy benchmark.
+ *
+ * Measures how many CPU cycles usb_copy_to_pma() and
+ * usb_copy_from_pma() take to move a packet, using the Cortex-M3 DWT
+ * cycle counter, for word-aligned and odd-aligned buffers. For
+ * comparison, the same copies are also run through the old routines,
+ * which moved one halfword per loop iteration. Each copy is checked
+ * by reading it back.
+ *
+ * The copies use a corner of the PMA which the CDC ACM driver
+ * leaves alone, so SerialUSB keeps working throughout. With
+ * USB_VENDOR_BULK, the endpoints fill the whole PMA, so this refuses
+ * to build.
+ *
+ * To test:
+ *
+ *     - Connect a serial monitor to SerialUSB
+ *     - Press any key
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <libmaple/dwt.h>
+#include <libmaple/usb_vendor.h>
+
+#include <string.h>
+
+/* These are private to libmaple's USB stack; see
+ * libmaple/usb/stm32f1/usb_reg_map.h. */
+extern "C" {
+    void usb_copy_to_pma(const uint8 *buf, uint16 len, uint16 pma_offset);
+    void usb_copy_from_pma(uint8 *buf, uint16 len, uint16 pma_offset);
+}
+
+#define PMA_BASE       0x40006000
+#if USB_VENDOR_BULK
+#error "No PMA is free with USB_VENDOR_BULK; build without it"
+#endif
+
+#define SCRATCH_OFFSET 0x1C0    // Unused by usb_cdcacm.c (0x190-0x1FF)
+#define PACKET_SIZE    64
+
+/* The old routines, for comparison. */
+
+void old_copy_to_pma(const uint8 *buf, uint16 len, uint16 pma_offset) {
+    uint16 *dst = (uint16*)(PMA_BASE + 2 * pma_offset);
+    uint16 n = len >> 1;
+    uint16 i;
+    for (i = 0; i < n; i++) {
+        *dst = (uint16)(*buf) | *(buf + 1) << 8;
+        buf += 2;
+        dst += 2;
+    }
+    if (len & 1) {
+        *dst = *buf;
+    }
+}
+
+void old_copy_from_pma(uint8 *buf, uint16 len, uint16 pma_offset) {
+    uint32 *src = (uint32*)(PMA_BASE + 2 * pma_offset);
+    uint16 *dst = (uint16*)buf;
+    uint16 n = len >> 1;
+    uint16 i;
+    for (i = 0; i < n; i++) {
+        *dst++ = *src++;
+    }
+    if (len & 1) {
+        *dst = *src & 0xFF;
+    }
+}
+
+typedef void (*to_pma_fn)(const uint8*, uint16, uint16);
+typedef void (*from_pma_fn)(uint8*, uint16, uint16);
+
+/* One extra byte, so we can start at an odd address. */
+uint8 src_buf[PACKET_SIZE + 1] __attribute__((aligned(4)));
+uint8 dst_buf[PACKET_SIZE + 1] __attribute__((aligned(4)));
+
+#define N_REPS 100
+int failures;
+
+uint32 time_to_pma(to_pma_fn fn, const uint8 *buf) {
+    uint32 start = dwt_cyccnt();
+    for (int rep = 0; rep < N_REPS; rep++) {
+        fn(buf, PACKET_SIZE, SCRATCH_OFFSET);
+    }
+    return (dwt_cyccnt() - start) / N_REPS;
+}
+
+uint32 time_from_pma(from_pma_fn fn, uint8 *buf) {
+    uint32 start = dwt_cyccnt();
+    for (int rep = 0; rep < N_REPS; rep++) {
+        fn(buf, PACKET_SIZE, SCRATCH_OFFSET);
+    }
+    return (dwt_cyccnt() - start) / N_REPS;
+}
+
+void check_round_trip(unsigned src_align, unsigned dst_align) {
+    for (uint16 len = 0; len <= PACKET_SIZE; len++) {
+        memset(dst_buf, 0, sizeof(dst_buf));
+        usb_copy_to_pma(src_buf + src_align, len, SCRATCH_OFFSET);
+        usb_copy_from_pma(dst_buf + dst_align, len, SCRATCH_OFFSET);
+        if (memcmp(src_buf + src_align, dst_buf + dst_align, len)) {
+            SerialUSB.print("FAILED: length ");
+            SerialUSB.print(len);
+            SerialUSB.print(", alignments ");
+            SerialUSB.print(src_align);
+            SerialUSB.print("/");
+            SerialUSB.println(dst_align);
+            failures++;
+        }
+    }
+}
+
+void setup() {
+    dwt_cyccnt_enable();
+
+    for (unsigned i = 0; i < sizeof(src_buf); i++) {
+        src_buf[i] = i * 37 + 11;
+    }
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    failures = 0;
+    for (unsigned src_align = 0; src_align < 2; src_align++) {
+        for (unsigned dst_align = 0; dst_align < 2; dst_align++) {
+            check_round_trip(src_align, dst_align);
+        }
+    }
+    SerialUSB.print("Round trip failures: ");
+    SerialUSB.println(failures);
+
+    SerialUSB.println("Cycles per 64-byte packet, old vs. new:");
+    for (unsigned align = 0; align < 2; align++) {
+        const char *what = align ? " (odd)" : " (aligned)";
+
+        SerialUSB.print("to PMA");
+        SerialUSB.print(what);
+        SerialUSB.print(":\t");
+        SerialUSB.print(time_to_pma(old_copy_to_pma, src_buf + align));
+        SerialUSB.print("\t");
+        SerialUSB.println(time_to_pma(usb_copy_to_pma, src_buf + align));
+
+        SerialUSB.print("from PMA");
+        SerialUSB.print(what);
+        SerialUSB.print(":\t");
+        SerialUSB.print(time_from_pma(old_copy_from_pma, dst_buf + align));
+        SerialUSB.print("\t");
+        SerialUSB.println(time_from_pma(usb_copy_from_pma, dst_buf + align));
+    }
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * USB vendor bulk interface loopback.
+ *
+ * Echoes every packet received on the vendor-specific bulk OUT
+ * endpoint back on the bulk IN endpoint, while SerialUSB keeps
+ * working alongside it.
+ *
+ * Build with "make USB_VENDOR_BULK=1". Then, e.g. with pyusb, write
+ * to endpoint 0x05 and read the same data back from endpoint 0x84.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+
+#include <libmaple/usb_vendor.h>
+
+#include <string.h>
+
+#if !USB_VENDOR_BULK
+#error "This example needs libmaple built with USB_VENDOR_BULK=1"
+#endif
+
+uint32 n_packets;
+
+void setup() {
+}
+
+void loop() {
+    uint16 len;
+    const uint8 *rx = usb_vendor_rx_packet(&len);
+    uint8 *tx = usb_vendor_tx_buffer();
+
+    if (rx && tx) {
+        memcpy(tx, rx, len);
+        usb_vendor_rx_release();
+        usb_vendor_tx_submit(len);
+        n_packets++;
+    }
+
+    if (SerialUSB.available()) {
+        SerialUSB.read();
+        SerialUSB.print("Packets echoed: ");
+        SerialUSB.println(n_packets);
+    }
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
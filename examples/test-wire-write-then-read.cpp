@@ -0,0 +1,102 @@
+/*
+ * Wire repeated start test.
+ *
+ * Instructions: Connect a 24LC256 (or similar) EEPROM to pins 19
+ * (SDA) and 20 (SCL) at address 0x50, with pullups. Connect via
+ * SerialUSB, and press any key to start.
+ *
+ * Reads a block from the EEPROM two ways: the Arduino way, with
+ * endTransmission() to set the address and requestFrom() in 32-byte
+ * chunks, and with a single writeThenRead() into a caller-provided
+ * buffer. Checks that both get the same data, and prints how long
+ * each took.
+ *
+ * This file is released into the public domain.
+ */
+
+#include <wirish/wirish.h>
+#include <Wire/Wire.h>
+
+#include <string.h>
+
+#define EEPROM_ADDR 0x50
+#define BLOCK_LEN   128
+
+TwoWire bus(SCL, SDA, SOFT_FAST);
+
+uint8 chunked[BLOCK_LEN];
+uint8 combined[BLOCK_LEN];
+
+uint32 read_chunked(void) {
+    uint32 start = micros();
+    uint16 got = 0;
+
+    while (got < BLOCK_LEN) {
+        uint16 n = min(BLOCK_LEN - got, WIRE_BUFSIZ);
+        bus.beginTransmission(EEPROM_ADDR);
+        bus.send((uint8)(got >> 8));
+        bus.send((uint8)got);
+        bus.endTransmission();
+        bus.requestFrom(EEPROM_ADDR, n);
+        while (bus.available()) {
+            chunked[got++] = bus.receive();
+        }
+    }
+    return micros() - start;
+}
+
+uint32 read_combined(void) {
+    uint8 mem_addr[2] = {0, 0};
+    uint32 start = micros();
+
+    if (bus.writeThenRead(EEPROM_ADDR, mem_addr, sizeof(mem_addr),
+                          combined, sizeof(combined)) != SUCCESS) {
+        SerialUSB.println("writeThenRead() failed!");
+    }
+    return micros() - start;
+}
+
+void setup() {
+    bus.begin();
+
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+void loop() {
+    uint32 t_chunked, t_combined;
+
+    memset(chunked, 0, sizeof(chunked));
+    memset(combined, 0xAA, sizeof(combined));
+    t_chunked = read_chunked();
+    t_combined = read_combined();
+
+    SerialUSB.print("Chunked: ");
+    SerialUSB.print(t_chunked);
+    SerialUSB.print(" us, writeThenRead(): ");
+    SerialUSB.print(t_combined);
+    SerialUSB.print(" us, data ");
+    SerialUSB.println(memcmp(chunked, combined, BLOCK_LEN) ?
+                      "DIFFERS" : "matches");
+
+    SerialUSB.println("Done; press any key to run again.");
+    while (!SerialUSB.available())
+        ;
+    SerialUSB.read();
+}
+
+// Force init to be called *first*, i.e. before static object allocation.
+// Otherwise, statically allocated objects that need libmaple may fail.
+__attribute__((constructor)) void premain() {
+    init();
+}
+
+int main(void) {
+    setup();
+
+    while (true) {
+        loop();
+    }
+    return 0;
+}
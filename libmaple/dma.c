@@ -33,6 +33,7 @@
  */
 
 #include <libmaple/dma.h>
+#include <libmaple/nvic.h>
 #include "dma_private.h"
 #include "stm32_private.h"
 
@@ -48,6 +49,132 @@ void dma_init(dma_dev *dev) {
     rcc_clk_enable(dev->clk_id);
 }
 
+/*
+ * Tube ownership
+ */
+
+/**
+ * @brief Claim a DMA tube.
+ *
+ * Claiming a tube doesn't configure or enable it; it just keeps
+ * other drivers which claim tubes from using it until it's released.
+ * This may be called from interrupt handlers.
+ *
+ * @param dev DMA device.
+ * @param tube Tube to claim.
+ * @param owner Pointer identifying the claimant, not NULL.
+ * @return 0 if owner now has the tube (including if it already did),
+ *         or -1 if something else has it.
+ * @see dma_tube_release()
+ * @see dma_tube_owner()
+ */
+int dma_tube_claim(dma_dev *dev, dma_tube tube, const void *owner) {
+    dma_handler_config *state = _dma_tube_state(dev, tube);
+    uint32 primask;
+    int ret = -1;
+
+    ASSERT(owner);
+    primask = nvic_globalirq_save();
+    if (!state->owner || state->owner == owner) {
+        state->owner = owner;
+        ret = 0;
+    }
+    nvic_globalirq_restore(primask);
+    return ret;
+}
+
+/**
+ * @brief Release a DMA tube.
+ *
+ * Does nothing unless owner has the tube. The tube should be disabled
+ * first.
+ *
+ * @param dev DMA device.
+ * @param tube Tube to release.
+ * @param owner Pointer which claimed it.
+ * @see dma_tube_claim()
+ */
+void dma_tube_release(dma_dev *dev, dma_tube tube, const void *owner) {
+    dma_handler_config *state = _dma_tube_state(dev, tube);
+
+    if (state->owner == owner) {
+        state->owner = NULL;
+    }
+}
+
+/**
+ * @brief Find out who has claimed a DMA tube.
+ * @param dev DMA device.
+ * @param tube Tube to check.
+ * @return The owner passed to dma_tube_claim(), or NULL if the tube
+ *         is free.
+ */
+const void* dma_tube_owner(dma_dev *dev, dma_tube tube) {
+    return _dma_tube_state(dev, tube)->owner;
+}
+
+/**
+ * @brief Claim a tube which can serve a DMA request source.
+ *
+ * On some series, a request source can be served by more than one
+ * tube; this claims the first free one. If *dev isn't NULL, *dev's
+ * *tube is tried before the others.
+ *
+ * @param req_src Request source to serve.
+ * @param owner Pointer identifying the claimant, not NULL.
+ * @param dev Set to the DMA device claimed. Set it to NULL, or to a
+ *            preferred device, before calling.
+ * @param tube Set to the tube claimed, or a preferred tube on *dev
+ *             before calling.
+ * @return 0 on success, or -1 if every tube which can serve req_src
+ *         is taken.
+ * @see dma_tube_release()
+ */
+int dma_claim_req_src(dma_request_src req_src, const void *owner,
+                      dma_dev **dev, dma_tube *tube) {
+    dma_dev *d;
+    dma_tube t;
+    unsigned n;
+
+    if (*dev && dma_tube_claim(*dev, *tube, owner) == 0) {
+        return 0;
+    }
+    for (n = 0; _dma_req_src_tube(req_src, n, &d, &t); n++) {
+        if (dma_tube_claim(d, t, owner) == 0) {
+            *dev = d;
+            *tube = t;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Claim any free tube which can do memory-to-memory transfers.
+ *
+ * Don't forget to call dma_init() on the device.
+ *
+ * @param owner Pointer identifying the claimant, not NULL.
+ * @param dev Set to the DMA device claimed.
+ * @param tube Set to the tube claimed.
+ * @param req_src Set to a request source to use in the tube's
+ *                dma_tube_config; the tube ignores it in
+ *                memory-to-memory mode, but dma_tube_cfg() checks it.
+ * @return 0 on success, or -1 if every such tube is taken.
+ * @see dma_tube_release()
+ */
+int dma_claim_mem2mem(const void *owner, dma_dev **dev, dma_tube *tube,
+                      dma_request_src *req_src) {
+    unsigned n;
+
+    for (n = 0; _dma_mem2mem_tube(n, dev, tube, req_src); n++) {
+        if (dma_tube_claim(*dev, *tube, owner) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
 /*
  * Private API
  */
@@ -0,0 +1,323 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/dma_memcpy.c
+ * @brief Memory copies and fills with DMA
+ */
+
+#include <libmaple/dma_memcpy.h>
+#include <libmaple/nvic.h>
+
+#include <string.h>
+
+static void memcpy_irq(void);
+
+static dma_tube_config cfg;     /* Piece of the operation in progress */
+static dma_dev *dma;            /* Tube we've claimed, if dma isn't NULL */
+static dma_tube tube;
+static uint32 left;             /* Data not yet handed to the tube */
+static uint32 fill;             /* Source for dma_memset_async() */
+static dma_memcpy_callback done_callback;
+static void *done_arg;
+static volatile uint8 busy;
+static volatile int8 result;
+
+/* An operation can be started from interrupt handlers, including the
+ * tube's own (by a callback), so this saves and restores PRIMASK. */
+static int reserve(void) {
+    uint32 primask = nvic_globalirq_save();
+    int ok = !busy;
+    busy = 1;
+    nvic_globalirq_restore(primask);
+    return ok;
+}
+
+/* Whether the tube's interrupt might be unable to run while we wait
+ * for it: interrupts are disabled, or we're in an interrupt handler. */
+static __always_inline int cant_wait(void) {
+    return nvic_globalirq_disabled() || nvic_in_handler();
+}
+
+static void finish(int res) {
+    dma_memcpy_callback callback = done_callback;
+
+    if (dma) {
+        dma_disable(dma, tube);
+        dma_tube_release(dma, tube, &cfg);
+        dma = NULL;
+    }
+    result = res;
+    busy = 0;
+    if (callback) {
+        callback(done_arg, res);
+    }
+}
+
+/* Hand the tube up to 65,535 more data. */
+static int start_piece(void) {
+    unsigned n = left > 65535 ? 65535 : left;
+    int ret;
+
+    cfg.tube_nr_xfers = n;
+    ret = dma_tube_cfg(dma, tube, &cfg);
+    if (ret < 0) {
+        return ret;
+    }
+    left -= n;
+    dma_enable(dma, tube);
+    return 0;
+}
+
+/* Start moving len bytes, a multiple of the transfer size, to dst.
+ * Call after reserve(). */
+static int start(uint8 *dst, __io void *src, uint32 len,
+                 dma_xfer_size size, unsigned flags,
+                 dma_memcpy_callback callback, void *arg) {
+    done_callback = callback;
+    done_arg = arg;
+    if (!len) {
+        finish(0);
+        return 0;
+    }
+    if (dma_claim_mem2mem(&cfg, &dma, &tube, &cfg.tube_req_src) < 0) {
+        dma = NULL;
+        busy = 0;
+        return -1;
+    }
+    dma_init(dma);
+    dma_attach_interrupt(dma, tube, memcpy_irq);
+
+    cfg.tube_src = src;
+    cfg.tube_src_size = size;
+    cfg.tube_dst = dst;
+    cfg.tube_dst_size = size;
+    cfg.tube_flags = (flags | DMA_CFG_DST_INC |
+                      DMA_CFG_CMPLT_IE | DMA_CFG_ERR_IE);
+    cfg.target_data = NULL;
+    left = len >> size;
+    if (start_piece() < 0) {
+        dma_tube_release(dma, tube, &cfg);
+        dma = NULL;
+        busy = 0;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Start copying memory with DMA.
+ *
+ * The widest transfers allowed by the relative alignment of dst and
+ * src are used. Odd bytes at either end are copied by the CPU before
+ * this returns.
+ *
+ * @param dst Destination. Mustn't overlap src.
+ * @param src Source.
+ * @param len Number of bytes to copy.
+ * @param callback Called when the copy is done, or NULL. If there's
+ *                 nothing for the DMA controller to do, it's called
+ *                 before this returns.
+ * @param arg Passed to callback.
+ * @return 0 if the copy started, or -1 if another copy or fill is
+ *         running, no tube is free, or the tube couldn't be
+ *         configured for dst and src (e.g. because one isn't memory).
+ * @see dma_memcpy_wait()
+ */
+int dma_memcpy_async(void *dst, const void *src, uint32 len,
+                     dma_memcpy_callback callback, void *arg) {
+    uint8 *d = dst;
+    const uint8 *s = src;
+    uint32 misalign = (uint32)d ^ (uint32)s;
+    dma_xfer_size size;
+    uint32 head, tail;
+
+    if (!reserve()) {
+        return -1;
+    }
+
+    if (!(misalign & 0x3)) {
+        size = DMA_SIZE_32BITS;
+    } else if (!(misalign & 0x1)) {
+        size = DMA_SIZE_16BITS;
+    } else {
+        size = DMA_SIZE_8BITS;
+    }
+    head = -(uint32)d & ((1U << size) - 1);
+    if (head > len) {
+        head = len;
+    }
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    len -= head;
+    tail = len & ((1U << size) - 1);
+    len -= tail;
+    memcpy(d + len, s + len, tail);
+
+    return start(d, (__io void*)s, len, size, DMA_CFG_SRC_INC,
+                 callback, arg);
+}
+
+/**
+ * @brief Start filling memory with DMA.
+ *
+ * Words are written where dst's alignment allows it; odd bytes at
+ * either end are filled by the CPU before this returns.
+ *
+ * @param dst Memory to fill.
+ * @param c Value to fill it with.
+ * @param len Number of bytes to fill.
+ * @param callback Called when the fill is done, or NULL. If there's
+ *                 nothing for the DMA controller to do, it's called
+ *                 before this returns.
+ * @param arg Passed to callback.
+ * @return 0 if the fill started, or -1 if another copy or fill is
+ *         running, no tube is free, or the tube couldn't be
+ *         configured for dst.
+ * @see dma_memcpy_wait()
+ */
+int dma_memset_async(void *dst, uint8 c, uint32 len,
+                     dma_memcpy_callback callback, void *arg) {
+    uint8 *d = dst;
+    uint32 head, tail;
+
+    if (!reserve()) {
+        return -1;
+    }
+
+    head = -(uint32)d & 0x3;
+    if (head > len) {
+        head = len;
+    }
+    memset(d, c, head);
+    d += head;
+    len -= head;
+    tail = len & 0x3;
+    len -= tail;
+    memset(d + len, c, tail);
+
+    fill = c * 0x01010101U;
+    return start(d, &fill, len, DMA_SIZE_32BITS, 0, callback, arg);
+}
+
+/**
+ * @brief Determine whether a copy or fill is running.
+ * @return Nonzero, iff dma_memcpy_async() or dma_memset_async() would
+ *         fail because an operation is already running.
+ */
+uint8 dma_memcpy_busy(void) {
+    return busy;
+}
+
+/**
+ * @brief Wait for the running copy or fill to finish.
+ *
+ * Don't call this from an interrupt handler, or with interrupts
+ * disabled, which would keep the tube's interrupt from running.
+ *
+ * @return 0 if the last copy or fill finished, or -1 on error.
+ */
+int dma_memcpy_wait(void) {
+    while (busy)
+        ;
+    return result;
+}
+
+/**
+ * @brief Copy memory with DMA, and wait for it.
+ *
+ * Copies shorter than DMA_MEMCPY_MIN_LEN, copies requested from
+ * interrupt handlers or with interrupts disabled, and copies requested while another is running
+ * or no tube is free are done with memcpy() instead, as are ones the
+ * DMA controller fails.
+ *
+ * @param dst Destination. Mustn't overlap src.
+ * @param src Source.
+ * @param len Number of bytes to copy.
+ * @return dst.
+ */
+void* dma_memcpy(void *dst, const void *src, uint32 len) {
+    if (len < DMA_MEMCPY_MIN_LEN || cant_wait() ||
+        dma_memcpy_async(dst, src, len, NULL, NULL) < 0 ||
+        dma_memcpy_wait() < 0) {
+        return memcpy(dst, src, len);
+    }
+    return dst;
+}
+
+/**
+ * @brief Fill memory with DMA, and wait for it.
+ *
+ * Falls back to memset() in the same cases as dma_memcpy() falls
+ * back to memcpy().
+ *
+ * @param dst Memory to fill.
+ * @param c Value to fill it with.
+ * @param len Number of bytes to fill.
+ * @return dst.
+ */
+void* dma_memset(void *dst, uint8 c, uint32 len) {
+    if (len < DMA_MEMCPY_MIN_LEN || cant_wait() ||
+        dma_memset_async(dst, c, len, NULL, NULL) < 0 ||
+        dma_memcpy_wait() < 0) {
+        return memset(dst, c, len);
+    }
+    return dst;
+}
+
+/*
+ * IRQ handler
+ */
+
+static void memcpy_irq(void) {
+    uint32 bytes;
+
+    if (!dma) {
+        return;
+    }
+    switch (dma_get_irq_cause(dma, tube)) {
+    case DMA_TRANSFER_HALF_COMPLETE:
+        return;
+    case DMA_TRANSFER_COMPLETE:
+        if (!left) {
+            finish(0);
+            return;
+        }
+        bytes = cfg.tube_nr_xfers << cfg.tube_dst_size;
+        cfg.tube_dst = (uint8*)cfg.tube_dst + bytes;
+        if (cfg.tube_flags & DMA_CFG_SRC_INC) {
+            cfg.tube_src = (uint8*)cfg.tube_src + bytes;
+        }
+        if (start_piece() == 0) {
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    finish(-1);
+}
@@ -46,6 +46,24 @@ static __always_inline void dma_irq_handler(dma_dev *dev, dma_tube tube) {
 }
 #endif
 
+/*
+ * Tube ownership; the series support files provide these.
+ */
+
+/* State for dev's tube. */
+struct dma_handler_config* _dma_tube_state(dma_dev *dev, dma_tube tube);
+
+/* Find the nth (from 0) tube which can serve req_src. Returns 0 if
+ * there isn't one. */
+int _dma_req_src_tube(dma_request_src req_src, unsigned n,
+                      dma_dev **dev, dma_tube *tube);
+
+/* Find the nth (from 0) tube which can do memory-to-memory
+ * transfers, and a request source dma_tube_cfg() will accept for it.
+ * Returns 0 if there isn't one. */
+int _dma_mem2mem_tube(unsigned n, dma_dev **dev, dma_tube *tube,
+                      dma_request_src *req_src);
+
 /*
  * Conveniences for dealing with tube sources/destinations
  */
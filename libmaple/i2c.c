@@ -30,7 +30,7 @@
  * @author Perry Hung <perry@leaflabs.com>
  * @brief Inter-Integrated Circuit (I2C) support.
  *
- * Currently, only master mode is supported.
+ * Master and slave modes are supported. 10-bit addressing isn't.
  */
 
 #include "i2c_private.h"
@@ -41,13 +41,23 @@
 #include <libmaple/nvic.h>
 #include <libmaple/i2c.h>
 #include <libmaple/systick.h>
+#include <libmaple/dma.h>
 
 #include <string.h>
 
-static inline int32 wait_for_state_change(i2c_dev *dev,
-                                          i2c_state state,
-                                          uint32 timeout);
+static void xfer_start(i2c_dev *dev);
+static void xfer_finish(i2c_dev *dev, int32 result);
 static void set_ccr_trise(i2c_dev *dev, uint32 flags);
+static int dma_msg_start(i2c_dev *dev, i2c_msg *msg);
+static void dma_msg_stop(i2c_dev *dev);
+static uint16 dma_left(i2c_dev *dev, int rx);
+static int slave_busy(i2c_dev *dev);
+static void slave_irq_handler(i2c_dev *dev);
+static void slave_irq_error_handler(i2c_dev *dev);
+
+#if I2C_DMA_THRESHOLD != 0 && I2C_DMA_THRESHOLD < 2
+#error "I2C_DMA_THRESHOLD must be 0 or at least 2"
+#endif
 
 /**
  * @brief Fill data register with slave address
@@ -201,6 +211,7 @@ void i2c_master_enable(i2c_dev *dev, uint32 flags) {
     /* Make it go! */
     i2c_peripheral_enable(dev);
 
+    dev->slave = NULL;
     dev->state = I2C_STATE_IDLE;
 }
 
@@ -211,6 +222,9 @@ void i2c_master_enable(i2c_dev *dev, uint32 flags) {
  * or write tranfers.  Multiple i2c_msg's will generate a repeated
  * start in between messages.
  *
+ * If asynchronous transfers are queued on dev, this waits for them
+ * to finish first.
+ *
  * @param dev I2C device
  * @param msgs Messages to send/receive
  * @param num Number of messages to send/receive
@@ -219,63 +233,132 @@ void i2c_master_enable(i2c_dev *dev, uint32 flags) {
  * @return 0 on success,
  *         I2C_ERROR_PROTOCOL if there was a protocol error,
  *         I2C_ERROR_TIMEOUT if the transfer timed out.
+ * @see i2c_master_xfer_async()
  */
 int32 i2c_master_xfer(i2c_dev *dev,
                       i2c_msg *msgs,
                       uint16 num,
                       uint32 timeout) {
+    i2c_xfer xfer;
     int32 rc;
 
-    ASSERT(dev->state == I2C_STATE_IDLE);
-
-    dev->msg = msgs;
-    dev->msgs_left = num;
-    dev->timestamp = systick_uptime();
-    dev->state = I2C_STATE_BUSY;
-
-    i2c_enable_irq(dev, I2C_IRQ_EVENT);
-    i2c_start_condition(dev);
-
-    rc = wait_for_state_change(dev, I2C_STATE_XFER_DONE, timeout);
+    rc = i2c_master_xfer_async(dev, &xfer, msgs, num, timeout, NULL, NULL);
     if (rc < 0) {
-        goto out;
+        return rc;
     }
-
-    dev->state = I2C_STATE_IDLE;
-out:
-    return rc;
+    while (!i2c_xfer_is_done(&xfer))
+        ;
+    return xfer.result;
 }
 
 /**
- * @brief Wait for an I2C event, or time out in case of error.
+ * @brief Queue an i2c transaction, and return without waiting for it.
+ *
+ * The transaction is as for i2c_master_xfer(). Transactions on a
+ * device are carried out one after another, in the order they were
+ * queued. When this one is done, xfer->result is set, and then
+ * callback is called from an interrupt handler. As I2C interrupts
+ * preempt everything else, callback should be quick; it may queue
+ * further transfers.
+ *
+ * Timeouts are checked once a millisecond by the SysTick handler. A
+ * transfer which times out is abandoned after requesting a stop
+ * condition; a slave which holds the bus may need i2c_bus_reset().
+ *
  * @param dev I2C device
- * @param state I2C_state state to wait for
- * @param timeout Timeout, in milliseconds
- * @return 0 if target state is reached, a negative value on error.
+ * @param xfer Transfer to fill in. Must not be touched until done.
+ * @param msgs Messages to send/receive
+ * @param num Number of messages to send/receive
+ * @param timeout Bus idle timeout in milliseconds before aborting the
+ *                transfer.  0 denotes no timeout.
+ * @param callback Function to call when done, or NULL.
+ * @param arg Stored in xfer->arg, for callback's use.
+ * @return 0 if the transfer was queued, or I2C_ERROR_PROTOCOL if
+ *         num is 0.
+ * @see i2c_xfer_is_done()
  */
-static inline int32 wait_for_state_change(i2c_dev *dev,
-                                          i2c_state state,
-                                          uint32 timeout) {
-    i2c_state tmp;
+int32 i2c_master_xfer_async(i2c_dev *dev, i2c_xfer *xfer,
+                            i2c_msg *msgs, uint16 num, uint32 timeout,
+                            i2c_xfer_callback callback, void *arg) {
+    uint32 primask;
 
-    while (1) {
-        tmp = dev->state;
+    ASSERT(dev->state != I2C_STATE_DISABLED);
+    if (num == 0) {
+        return I2C_ERROR_PROTOCOL;
+    }
 
-        if (tmp == I2C_STATE_ERROR) {
-            return I2C_STATE_ERROR;
-        }
+    xfer->msgs = msgs;
+    xfer->num = num;
+    xfer->timeout = timeout;
+    xfer->callback = callback;
+    xfer->arg = arg;
+    xfer->result = I2C_XFER_PENDING;
+    xfer->next = NULL;
 
-        if (tmp == state) {
-            return 0;
-        }
+    /* I2C interrupts preempt everything else (see
+     * _i2c_irq_priority_fixup()), so the queue is protected by
+     * masking all interrupts. Transfers can be queued from interrupt
+     * handlers, so PRIMASK is saved and restored. */
+    primask = nvic_globalirq_save();
+    if (dev->xfer_tail) {
+        dev->xfer_tail->next = xfer;
+    } else {
+        dev->xfer_head = xfer;
+    }
+    dev->xfer_tail = xfer;
+    if (dev->xfer_head == xfer) {
+        xfer_start(dev);
+    }
+    nvic_globalirq_restore(primask);
+    return 0;
+}
 
-        if (timeout) {
-            if (systick_uptime() > (dev->timestamp + timeout)) {
-                /* TODO: overflow? */
-                /* TODO: racy? */
-                return I2C_ERROR_TIMEOUT;
-            }
-        }
+/* Start the transfer at the head of dev's queue. If a slave access
+ * is under way, it stays queued until slave_finish() (or, if another
+ * master has the bus, _i2c_timeout_tick()) tries again. */
+static void xfer_start(i2c_dev *dev) {
+    i2c_xfer *xfer = dev->xfer_head;
+
+    if (slave_busy(dev)) {
+        return;
+    }
+    dev->msg = xfer->msgs;
+    dev->msgs_left = xfer->num;
+    dev->timestamp = systick_uptime();
+    dev->state = I2C_STATE_BUSY;
+
+    i2c_enable_irq(dev, I2C_IRQ_EVENT | I2C_IRQ_ERROR);
+    i2c_start_condition(dev);
+}
+
+/* Finish the transfer at the head of dev's queue, and start the next
+ * one before calling back, to keep the bus busy. Called with dev's
+ * interrupts unable to fire. */
+static void xfer_finish(i2c_dev *dev, int32 result) {
+    i2c_xfer *xfer = dev->xfer_head;
+    i2c_xfer_callback callback = xfer->callback;
+
+    if (dev->dma_active) {
+        dma_msg_stop(dev);
+    }
+    dev->xfer_head = xfer->next;
+    if (!dev->xfer_head) {
+        dev->xfer_tail = NULL;
+    }
+    dev->state = I2C_STATE_IDLE;
+    if (dev->xfer_head) {
+        xfer_start(dev);
+    }
+    if (dev->state != I2C_STATE_BUSY && dev->slave) {
+        /* Get ready to be addressed again. */
+        i2c_enable_ack(dev);
+        i2c_enable_irq(dev, I2C_IRQ_EVENT | I2C_IRQ_ERROR);
+    }
+
+    xfer->next = NULL;
+    xfer->result = result;
+    if (callback) {
+        callback(xfer);
     }
 }
 
@@ -291,11 +374,17 @@ void _i2c_irq_handler(i2c_dev *dev) {
      * - Where is I2C_MSG_10BIT_ADDR handled?
      */
     i2c_msg *msg = dev->msg;
+    uint8 read;
+    uint32 sr1, sr2;
 
-    uint8 read = msg->flags & I2C_MSG_READ;
+    if (dev->slave && dev->state != I2C_STATE_BUSY) {
+        slave_irq_handler(dev);
+        return;
+    }
 
-    uint32 sr1 = dev->regs->SR1;
-    uint32 sr2 = dev->regs->SR2;
+    read = msg->flags & I2C_MSG_READ;
+    sr1 = dev->regs->SR1;
+    sr2 = dev->regs->SR2;
     I2C_CRUMB(IRQ_ENTRY, sr1, sr2);
 
     /*
@@ -308,7 +397,14 @@ void _i2c_irq_handler(i2c_dev *dev) {
      */
     if (sr1 & I2C_SR1_SB) {
         msg->xferred = 0;
-        i2c_enable_irq(dev, I2C_IRQ_BUFFER);
+        /*
+         * Long messages go by DMA, without TXE/RXNE interrupts.
+         */
+        if (dma_msg_start(dev, msg)) {
+            i2c_disable_irq(dev, I2C_IRQ_BUFFER);
+        } else {
+            i2c_enable_irq(dev, I2C_IRQ_BUFFER);
+        }
 
         /*
          * Master receiver
@@ -345,9 +441,9 @@ void _i2c_irq_handler(i2c_dev *dev) {
             /*
              * Master transmitter: write first byte to fill shift
              * register.  We should get another TXE interrupt
-             * immediately to fill DR again.
+             * immediately to fill DR again. (Unless DMA's doing it.)
              */
-            if (msg->length != 1) {
+            if (msg->length != 1 && !dev->dma_active) {
                 i2c_write(dev, msg->data[msg->xferred++]);
             }
         }
@@ -359,7 +455,7 @@ void _i2c_irq_handler(i2c_dev *dev) {
      * Transmit buffer empty, but we haven't finished transmitting the last
      * byte written.
      */
-    if ((sr1 & I2C_SR1_TXE) && !(sr1 & I2C_SR1_BTF)) {
+    if ((sr1 & I2C_SR1_TXE) && !(sr1 & I2C_SR1_BTF) && !dev->dma_active) {
         I2C_CRUMB(TXE_ONLY, 0, 0);
         if (dev->msgs_left) {
             i2c_write(dev, msg->data[msg->xferred++]);
@@ -384,6 +480,20 @@ void _i2c_irq_handler(i2c_dev *dev) {
      * EV8_2: Master transmitter
      * Last byte sent, program repeated start/stop
      */
+    if ((sr1 & I2C_SR1_TXE) && (sr1 & I2C_SR1_BTF) && dev->dma_active) {
+        if (dma_left(dev, 0)) {
+            /*
+             * DMA fell behind the bus for a moment; it'll catch up.
+             */
+            sr1 = sr2 = 0;
+        } else {
+            /*
+             * DMA has loaded the last byte, and it's gone out.
+             */
+            dma_msg_stop(dev);
+            dev->msgs_left--;
+        }
+    }
     if ((sr1 & I2C_SR1_TXE) && (sr1 & I2C_SR1_BTF)) {
         I2C_CRUMB(TXE_BTF, 0, 0);
         if (dev->msgs_left) {
@@ -408,7 +518,7 @@ void _i2c_irq_handler(i2c_dev *dev) {
              */
             i2c_disable_irq(dev, I2C_IRQ_EVENT);
             I2C_CRUMB(STOP_SENT, 0, 0);
-            dev->state = I2C_STATE_XFER_DONE;
+            xfer_finish(dev, 0);
         }
         sr1 = sr2 = 0;
     }
@@ -416,7 +526,7 @@ void _i2c_irq_handler(i2c_dev *dev) {
     /*
      * EV7: Master Receiver
      */
-    if (sr1 & I2C_SR1_RXNE) {
+    if ((sr1 & I2C_SR1_RXNE) && !dev->dma_active) {
         I2C_CRUMB(RXNE_ONLY, 0, 0);
         msg->data[msg->xferred++] = dev->regs->DR;
 
@@ -441,7 +551,7 @@ void _i2c_irq_handler(i2c_dev *dev) {
                  * We're done.
                  */
                 I2C_CRUMB(RXNE_DONE, 0, 0);
-                dev->state = I2C_STATE_XFER_DONE;
+                xfer_finish(dev, 0);
             } else {
                 dev->msg++;
             }
@@ -454,9 +564,14 @@ void _i2c_irq_handler(i2c_dev *dev) {
  * transactions.
  */
 void _i2c_irq_error_handler(i2c_dev *dev) {
+    if (dev->slave && dev->state != I2C_STATE_BUSY) {
+        slave_irq_error_handler(dev);
+        return;
+    }
+
     I2C_CRUMB(ERROR_ENTRY, dev->regs->SR1, dev->regs->SR2);
 
-    dev->error_flags = dev->regs->SR2 & (I2C_SR1_BERR |
+    dev->error_flags = dev->regs->SR1 & (I2C_SR1_BERR |
                                          I2C_SR1_ARLO |
                                          I2C_SR1_AF |
                                          I2C_SR1_OVR);
@@ -467,6 +582,490 @@ void _i2c_irq_error_handler(i2c_dev *dev) {
     i2c_stop_condition(dev);
     i2c_disable_irq(dev, I2C_IRQ_BUFFER | I2C_IRQ_EVENT | I2C_IRQ_ERROR);
     dev->state = I2C_STATE_ERROR;
+    if (dev->xfer_head) {
+        xfer_finish(dev, I2C_ERROR_PROTOCOL);
+    }
+}
+
+/*
+ * DMA support
+ *
+ * A long message is moved by DMA between its buffer and DR, so it
+ * takes one interrupt instead of one per byte. A write finishes at
+ * the BTF event after the DMA transfer is done, which is handled by
+ * _i2c_irq_handler() as usual. A read finishes at the DMA transfer
+ * complete interrupt: with CR2_LAST set, the peripheral NACKs the
+ * last byte itself, and we just have to program a stop or repeated
+ * start (RM0008, Section 26.3.7). Since that works for reads of two
+ * bytes or more, the usual method 2 dance for short reads (errata
+ * 2.11.1 and 2.11.2) is left to the interrupt-driven path.
+ */
+
+/* Start moving len bytes between buf and DR with DMA. If rx and irq,
+ * the RX tube interrupts when done. Returns nonzero on success. */
+static int dma_start(i2c_dev *dev, int rx, uint8 *buf, uint16 len, int irq) {
+    dma_tube_config cfg;
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube, tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+
+    if (!_i2c_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                        &tx_tube, &tx_req_src, &handler)) {
+        return 0;
+    }
+    dma_init(dma);
+
+    if (rx) {
+        tube = rx_tube;
+        cfg.tube_src = &dev->regs->DR;
+        cfg.tube_dst = buf;
+        cfg.tube_flags = DMA_CFG_DST_INC;
+        if (irq) {
+            cfg.tube_flags |= DMA_CFG_CMPLT_IE | DMA_CFG_ERR_IE;
+        }
+        cfg.tube_req_src = rx_req_src;
+    } else {
+        tube = tx_tube;
+        cfg.tube_src = buf;
+        cfg.tube_dst = &dev->regs->DR;
+        cfg.tube_flags = DMA_CFG_SRC_INC;
+        cfg.tube_req_src = tx_req_src;
+    }
+    cfg.tube_src_size = DMA_SIZE_8BITS;
+    cfg.tube_dst_size = DMA_SIZE_8BITS;
+    cfg.tube_nr_xfers = len;
+    cfg.target_data = NULL;
+    /* The tubes are shared with other peripherals; if one's using
+     * ours, do without. */
+    if (dma_tube_claim(dma, tube, dev) < 0) {
+        return 0;
+    }
+    if (dma_tube_cfg(dma, tube, &cfg) != DMA_TUBE_CFG_SUCCESS) {
+        dma_tube_release(dma, tube, dev);
+        return 0;
+    }
+    if (rx && irq) {
+        dma_attach_interrupt(dma, tube, handler);
+    }
+    dma_enable(dma, tube);
+
+    dev->regs->CR2 |= I2C_CR2_DMAEN;
+    dev->dma_active = 1;
+    return 1;
+}
+
+/* Stop DMA started by dma_start(). Returns the number of bytes it
+ * didn't get to. */
+static uint16 dma_stop(i2c_dev *dev, int rx) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube, tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+    uint16 left;
+
+    _i2c_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+    tube = rx ? rx_tube : tx_tube;
+    dev->regs->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+    left = dma_get_count(dma, tube);
+    dma_disable(dma, tube);
+    if (rx) {
+        dma_detach_interrupt(dma, tube);
+    }
+    dma_tube_release(dma, tube, dev);
+    dev->dma_active = 0;
+    return left;
+}
+
+/* Number of bytes DMA has yet to move. */
+static uint16 dma_left(i2c_dev *dev, int rx) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+
+    _i2c_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+    return dma_get_count(dma, rx ? rx_tube : tx_tube);
+}
+
+/* Start DMA for msg, if it's long enough, before its address is
+ * sent. Returns nonzero if it did. */
+static int dma_msg_start(i2c_dev *dev, i2c_msg *msg) {
+    uint8 read = msg->flags & I2C_MSG_READ;
+
+    if (!I2C_DMA_THRESHOLD || msg->length < I2C_DMA_THRESHOLD ||
+        !dma_start(dev, read, msg->data, msg->length, read)) {
+        return 0;
+    }
+    if (read) {
+        dev->regs->CR2 |= I2C_CR2_LAST;
+    }
+    /* There won't be event interrupts to reset the timeout while DMA
+     * runs; _i2c_timeout_tick() watches the DMA count instead. */
+    dev->dma_last_left = msg->length;
+    dev->timestamp = systick_uptime();
+    return 1;
+}
+
+/* Stop the current message's DMA, and count what it moved. */
+static void dma_msg_stop(i2c_dev *dev) {
+    i2c_msg *msg = dev->msg;
+    msg->xferred = msg->length - dma_stop(dev, msg->flags & I2C_MSG_READ);
+}
+
+/*
+ * Called from the RX tube's DMA interrupt.
+ */
+void _i2c_dma_irq_handler(i2c_dev *dev) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+
+    if (!dev->dma_active) {
+        return;
+    }
+    _i2c_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+
+    /* Keep the event and error handlers out until we're done. */
+    nvic_irq_disable(dev->ev_nvic_line);
+    nvic_irq_disable(dev->er_nvic_line);
+    if (dma_get_irq_cause(dma, rx_tube) != DMA_TRANSFER_COMPLETE) {
+        i2c_stop_condition(dev);
+        xfer_finish(dev, I2C_ERROR_PROTOCOL);
+    } else if (dev->xfer_head) {
+        dma_msg_stop(dev);
+        if (--dev->msgs_left) {
+            dev->msg++;
+            i2c_start_condition(dev);
+        } else {
+            i2c_stop_condition(dev);
+            xfer_finish(dev, 0);
+        }
+    }
+    nvic_irq_enable(dev->ev_nvic_line);
+    nvic_irq_enable(dev->er_nvic_line);
+}
+
+/*
+ * Called every millisecond from the SysTick handler. Aborts the
+ * transfer in progress if the bus has been idle for too long.
+ */
+void _i2c_timeout_tick(i2c_dev *dev) {
+    i2c_xfer *xfer = dev->xfer_head;
+    uint16 left;
+
+    if (!xfer) {
+        return;
+    }
+
+    /* Waiting for the bus; see xfer_start(). The timeout only counts
+     * once the transfer has started. */
+    if (dev->state != I2C_STATE_BUSY) {
+        nvic_irq_disable(dev->ev_nvic_line);
+        nvic_irq_disable(dev->er_nvic_line);
+        if (dev->xfer_head == xfer && dev->state != I2C_STATE_BUSY) {
+            xfer_start(dev);
+        }
+        nvic_irq_enable(dev->ev_nvic_line);
+        nvic_irq_enable(dev->er_nvic_line);
+        return;
+    }
+
+    if (!xfer->timeout) {
+        return;
+    }
+
+    /* A message moved by DMA gets no event interrupts until it's
+     * done. It's only idle if DMA hasn't moved anything since the
+     * last tick. (If DMA stops under us, the count we read doesn't
+     * matter: the event handler has just reset the timestamp.) */
+    if (dev->dma_active) {
+        left = dma_left(dev, dev->msg->flags & I2C_MSG_READ);
+        if (left != dev->dma_last_left) {
+            dev->dma_last_left = left;
+            dev->timestamp = systick_uptime();
+        }
+    }
+
+    if (systick_uptime() - dev->timestamp <= xfer->timeout) {
+        return;
+    }
+
+    /* The transfer may finish while we're deciding. */
+    nvic_irq_disable(dev->ev_nvic_line);
+    nvic_irq_disable(dev->er_nvic_line);
+    if (dev->xfer_head == xfer &&
+        systick_uptime() - dev->timestamp > xfer->timeout) {
+        i2c_disable_irq(dev, I2C_IRQ_BUFFER | I2C_IRQ_EVENT | I2C_IRQ_ERROR);
+        /* Don't wait for the stop condition; the bus may be stuck. */
+        dev->regs->CR1 |= I2C_CR1_STOP;
+        xfer_finish(dev, I2C_ERROR_TIMEOUT);
+    }
+    nvic_irq_enable(dev->ev_nvic_line);
+    nvic_irq_enable(dev->er_nvic_line);
+}
+
+/*
+ * Slave mode
+ */
+
+/* i2c_slave.dir values */
+enum {
+    SLAVE_IDLE,
+    SLAVE_RX,                   /* Master is writing */
+    SLAVE_TX,                   /* Master is reading */
+};
+
+/* Must the master keep off the bus? That's during a slave access,
+ * while the bus is held (reading SR2 would clear ADDR and let it
+ * go), and while the bus is busy at all, which covers other masters
+ * and the moment between a repeated start and its address. */
+static int slave_busy(i2c_dev *dev) {
+    i2c_slave *slave = dev->slave;
+
+    return slave && (slave->dir != SLAVE_IDLE || slave->held ||
+                     (dev->regs->SR2 & I2C_SR2_BUSY));
+}
+
+/* OAR1 bit 14 must be kept set by software (RM0008, Section 26.6.3). */
+#define OAR1_MUST_SET           (1U << 14)
+
+/**
+ * @brief Enable an I2C device as a slave.
+ *
+ * The device answers to slave->addr, slave->addr2 (if nonzero), and,
+ * with I2C_SLAVE_GENERAL_CALL, the general call address. Accesses
+ * are served from slave->regs by the interrupt handlers. The clock
+ * is only stretched while the handlers run, or when a callback asks
+ * to hold the bus.
+ *
+ * With I2C_SLAVE_USE_DMA, runs of at least I2C_DMA_THRESHOLD
+ * registers are read and written by DMA, so that bulk transfers
+ * don't take an interrupt per byte. This uses the same DMA channels
+ * as master mode.
+ *
+ * The device may also be used as a master while the bus is free.
+ * Master transfers queued during a slave access, or while another
+ * master has the bus, wait for the bus to be free before starting.
+ *
+ * @param dev Device to enable
+ * @param slave Slave configuration
+ * @param flags As for i2c_master_enable(), plus:
+ *              I2C_SLAVE_GENERAL_CALL: Answer general calls,
+ *              I2C_SLAVE_USE_DMA: Use DMA for bulk register access.
+ * @see i2c_slave
+ */
+void i2c_slave_enable(i2c_dev *dev, i2c_slave *slave, uint32 flags) {
+    slave->reg = 0;
+    slave->count = 0;
+    slave->matched = slave->addr;
+    slave->dir = SLAVE_IDLE;
+    slave->held = 0;
+    slave->flags = flags;
+
+    i2c_master_enable(dev, flags);
+    dev->regs->OAR1 = OAR1_MUST_SET | (slave->addr << 1);
+    dev->regs->OAR2 = slave->addr2 ? (slave->addr2 << 1) | I2C_OAR2_ENDUAL : 0;
+    if (flags & I2C_SLAVE_GENERAL_CALL) {
+        dev->regs->CR1 |= I2C_CR1_ENGC;
+    }
+    dev->slave = slave;
+    i2c_enable_ack(dev);
+}
+
+/**
+ * @brief Let go of a bus held at a callback's request.
+ *
+ * Call once the registers are ready, after a read or write callback
+ * has returned nonzero.
+ *
+ * @param dev Device enabled with i2c_slave_enable().
+ */
+void i2c_slave_release(i2c_dev *dev) {
+    dev->slave->held = 0;
+    i2c_enable_irq(dev, I2C_IRQ_EVENT | I2C_IRQ_BUFFER);
+}
+
+/* Move the rest of the register window with DMA, if allowed and
+ * worthwhile. Returns nonzero if it did. */
+static int slave_dma_start(i2c_dev *dev, int rx) {
+    i2c_slave *slave = dev->slave;
+    uint16 len;
+
+    if (!(slave->flags & I2C_SLAVE_USE_DMA) || !I2C_DMA_THRESHOLD ||
+        slave->reg_start >= slave->size) {
+        return 0;
+    }
+    len = slave->size - slave->reg_start;
+    if (len < I2C_DMA_THRESHOLD ||
+        !dma_start(dev, rx, slave->regs + slave->reg_start, len, 0)) {
+        return 0;
+    }
+    slave->dma_len = len;
+    i2c_disable_irq(dev, I2C_IRQ_BUFFER);
+    return 1;
+}
+
+/* Account for what DMA moved, and go back to interrupts. */
+static void slave_dma_stop(i2c_dev *dev, int rx) {
+    i2c_slave *slave = dev->slave;
+
+    slave->count += slave->dma_len - dma_stop(dev, rx);
+    i2c_enable_irq(dev, I2C_IRQ_BUFFER);
+}
+
+/* Finish the current access, at a stop condition, repeated start, or
+ * NACK from a reading master. */
+static void slave_finish(i2c_dev *dev) {
+    i2c_slave *slave = dev->slave;
+    uint8 dir = slave->dir;
+    uint16 len;
+
+    if (dir == SLAVE_IDLE) {
+        return;
+    }
+    slave->dir = SLAVE_IDLE;
+    if (dev->dma_active) {
+        slave_dma_stop(dev, dir == SLAVE_RX);
+    }
+    if (dir == SLAVE_TX && slave->count &&
+        !(dev->regs->SR1 & I2C_SR1_TXE)) {
+        /* The master stopped before the last byte we loaded. */
+        slave->count--;
+    }
+
+    len = slave->count;
+    if (slave->reg_start >= slave->size) {
+        len = 0;
+    } else if (len > slave->size - slave->reg_start) {
+        len = slave->size - slave->reg_start;
+    }
+    slave->reg = slave->reg_start + len;
+
+    if (dir == SLAVE_RX && len && slave->write_callback &&
+        slave->write_callback(slave, slave->reg_start, len)) {
+        slave->held = 1;
+    }
+
+    /* A master transfer may have been queued during the access. */
+    if (dev->xfer_head && dev->state != I2C_STATE_BUSY) {
+        xfer_start(dev);
+    }
+}
+
+static void slave_irq_handler(i2c_dev *dev) {
+    i2c_slave *slave = dev->slave;
+    uint32 sr1 = dev->regs->SR1;
+    uint32 sr2;
+    uint16 pos;
+    uint8 byte;
+
+    /*
+     * Address matched. Reading SR2 releases the clock, so leave it
+     * be to hold the bus.
+     */
+    if (sr1 & I2C_SR1_ADDR) {
+        slave_finish(dev);      /* In case of a repeated start */
+        if (slave->held) {
+            i2c_disable_irq(dev, I2C_IRQ_EVENT | I2C_IRQ_BUFFER);
+            return;
+        }
+        sr2 = dev->regs->SR2;
+        if (sr2 & I2C_SR2_GENCALL) {
+            slave->matched = 0;
+        } else {
+            slave->matched = (sr2 & I2C_SR2_DUALF) ? slave->addr2 : slave->addr;
+        }
+        slave->count = 0;
+        slave->reg_start = slave->reg;
+        if (sr2 & I2C_SR2_TRA) {
+            slave->dir = SLAVE_TX;
+            if (slave->read_callback &&
+                slave->read_callback(slave, slave->reg_start)) {
+                /* Hold the bus with DR empty until released. */
+                slave->held = 1;
+                i2c_disable_irq(dev, I2C_IRQ_EVENT | I2C_IRQ_BUFFER);
+                return;
+            }
+        } else {
+            slave->dir = SLAVE_RX;
+            slave->have_reg = 0;
+        }
+        i2c_enable_irq(dev, I2C_IRQ_BUFFER);
+        return;
+    }
+
+    /*
+     * Master is reading
+     */
+    if (slave->dir == SLAVE_TX && (sr1 & I2C_SR1_TXE)) {
+        if (dev->dma_active) {
+            if (dma_left(dev, 0)) {
+                return;         /* DMA fell behind; it'll catch up. */
+            }
+            slave_dma_stop(dev, 0);
+        } else if (slave->count == 0 && slave_dma_start(dev, 0)) {
+            return;
+        }
+        pos = slave->reg_start + slave->count++;
+        dev->regs->DR = pos < slave->size ? slave->regs[pos] : 0xFF;
+        return;
+    }
+
+    /*
+     * Master is writing
+     */
+    if (slave->dir == SLAVE_RX && (sr1 & I2C_SR1_RXNE)) {
+        if (dev->dma_active) {
+            if (dma_left(dev, 1)) {
+                return;
+            }
+            slave_dma_stop(dev, 1);
+        }
+        byte = dev->regs->DR;
+        if (!slave->have_reg) {
+            slave->have_reg = 1;
+            slave->reg = slave->reg_start = byte;
+            slave_dma_start(dev, 1);
+        } else {
+            pos = slave->reg_start + slave->count++;
+            if (pos < slave->size) {
+                slave->regs[pos] = byte;
+            }
+        }
+        return;
+    }
+
+    /*
+     * Stop condition. Clear STOPF by writing CR1.
+     */
+    if (sr1 & I2C_SR1_STOPF) {
+        dev->regs->CR1 = dev->regs->CR1;
+        slave_finish(dev);
+    }
+}
+
+static void slave_irq_error_handler(i2c_dev *dev) {
+    i2c_slave *slave = dev->slave;
+    uint32 sr1 = dev->regs->SR1;
+
+    dev->regs->SR1 = 0;
+    if (sr1 & I2C_SR1_AF) {
+        /* A reading master NACKs its last byte. */
+        slave_finish(dev);
+        return;
+    }
+
+    /* The hardware releases the bus; drop the access. */
+    dev->error_flags = sr1 & (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);
+    if (dev->dma_active) {
+        dma_stop(dev, slave->dir == SLAVE_RX);
+    }
+    slave->dir = SLAVE_IDLE;
 }
 
 /*
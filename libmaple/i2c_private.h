@@ -28,6 +28,7 @@
 #define _LIBMAPLE_I2C_PRIVATE_H_
 
 #include <libmaple/i2c_common.h>
+#include <libmaple/dma.h>
 
 /* For old-style definitions (SDA/SCL on same GPIO device) */
 #define I2C_DEV_OLD(num, port, sda, scl)          \
@@ -61,6 +62,20 @@
 
 void _i2c_irq_handler(i2c_dev *dev);
 void _i2c_irq_error_handler(i2c_dev *dev);
+void _i2c_timeout_tick(i2c_dev *dev);
+
+/*
+ * DMA support
+ */
+
+/* Series-specific. Finds the DMA tubes which serve dev's RX and TX
+ * requests, and the DMA interrupt handler which calls
+ * _i2c_dma_irq_handler(dev). Returns 0 if dev can't use DMA. */
+int _i2c_dma_route(i2c_dev *dev, dma_dev **dma,
+                   dma_tube *rx_tube, dma_request_src *rx_req_src,
+                   dma_tube *tx_tube, dma_request_src *tx_req_src,
+                   voidFuncPtr *handler);
+void _i2c_dma_irq_handler(i2c_dev *dev);
 
 struct gpio_dev;
 
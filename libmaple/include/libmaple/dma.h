@@ -119,6 +119,22 @@ struct dma_tube_reg_map;
 
 void dma_init(dma_dev *dev);
 
+/* Tube ownership
+ *
+ * Several peripherals' requests can share a tube, and nothing in the
+ * hardware stops two drivers from using it at once. Drivers claim
+ * tubes before using them, and release them afterwards, so that
+ * contention fails cleanly instead of corrupting both transfers.
+ * An owner is any pointer unique to the user, such as its device. */
+
+int dma_tube_claim(dma_dev *dev, dma_tube tube, const void *owner);
+void dma_tube_release(dma_dev *dev, dma_tube tube, const void *owner);
+const void* dma_tube_owner(dma_dev *dev, dma_tube tube);
+int dma_claim_req_src(dma_request_src req_src, const void *owner,
+                      dma_dev **dev, dma_tube *tube);
+int dma_claim_mem2mem(const void *owner, dma_dev **dev, dma_tube *tube,
+                      dma_request_src *req_src);
+
 /* dma_tube configuration
  *
  * Use these types and functions to set up DMA transfers, handle
@@ -362,6 +378,19 @@ extern void dma_disable(dma_dev *dev, dma_tube tube);
  */
 static inline uint8 dma_is_enabled(dma_dev *dev, dma_tube tube);
 
+/**
+ * @brief Get the number of data a DMA tube has left to transfer.
+ *
+ * In circular mode, the count is reloaded when it reaches zero, so
+ * this can be used to find the tube's current position within its
+ * buffer.
+ *
+ * @param dev DMA device.
+ * @param tube Tube to check.
+ * @return Number of data remaining in the current transfer.
+ */
+static inline uint16 dma_get_count(dma_dev *dev, dma_tube tube);
+
 /* Other conveniences */
 
 /**
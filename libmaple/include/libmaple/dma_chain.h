@@ -0,0 +1,142 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/dma_chain.h
+ * @brief Linked lists of DMA transfers
+ *
+ * A DMA tube runs one transfer at a time. A dma_chain runs a list of
+ * them back to back on the same tube: each dma_chain_desc holds an
+ * ordinary dma_tube_config, and when one transfer completes, the
+ * tube's interrupt loads the next descriptor and restarts the tube
+ * before calling the finished descriptor's callback. Pointing the
+ * last descriptor's next field back at an earlier one makes the
+ * chain loop until it's stopped.
+ *
+ * Each descriptor is checked and converted to register values once,
+ * by dma_chain_start(), so reloading the tube costs a few register
+ * writes. The chain only moves data; the peripheral's DMA requests
+ * (e.g. USART_CR3_DMAT, SPI_CR2_TXDMAEN, or a timer's DIER bits)
+ * must be enabled by whatever is driving it.
+ *
+ * This is currently only supported on STM32F1.
+ *
+ * IMPORTANT: this API is unstable, and may change without notice.
+ */
+
+#ifndef _LIBMAPLE_DMA_CHAIN_H_
+#define _LIBMAPLE_DMA_CHAIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmaple/libmaple_types.h>
+#include <libmaple/dma.h>
+
+struct dma_chain;
+struct dma_chain_desc;
+
+/**
+ * Descriptor callback. Called from the tube's interrupt once the
+ * descriptor's transfer completes (or fails), after the next
+ * descriptor has been started. It may call dma_chain_stop().
+ */
+typedef void (*dma_chain_callback)(struct dma_chain *chain,
+                                   struct dma_chain_desc *desc);
+
+/** One transfer in a dma_chain. */
+typedef struct dma_chain_desc {
+    /**
+     * The transfer. Its interrupt enable flags are ignored, and it
+     * can't use DMA_CFG_CIRC; loop the chain instead.
+     */
+    dma_tube_config cfg;
+    dma_chain_callback callback; /**< Called when done, or NULL */
+    void *arg;                   /**< For the callback's use */
+    /** Next descriptor, NULL to end, or an earlier one to loop */
+    struct dma_chain_desc *next;
+
+    /* Private; register values computed by dma_chain_start() */
+    uint32 ccr;
+    uint32 cpar;
+    uint32 cmar;
+    uint32 cndtr;
+} dma_chain_desc;
+
+/** dma_chain states */
+typedef enum dma_chain_state {
+    DMA_CHAIN_IDLE,             /**< Not started, finished, or stopped */
+    DMA_CHAIN_RUNNING,          /**< Moving data */
+    DMA_CHAIN_ERROR,            /**< Stopped by a transfer error */
+} dma_chain_state;
+
+/** A list of DMA transfers running on one tube. */
+typedef struct dma_chain {
+    dma_dev *dev;                      /**< DMA device */
+    dma_tube tube;                     /**< Tube the chain runs on */
+    dma_chain_desc * volatile current; /**< Transfer in progress */
+    volatile uint8 state;              /**< A dma_chain_state */
+} dma_chain;
+
+int dma_chain_start(dma_chain *chain, dma_dev *dev, dma_tube tube,
+                    dma_chain_desc *head, dma_priority priority);
+void dma_chain_stop(dma_chain *chain);
+
+/**
+ * @brief Determine whether a chain is still moving data.
+ * @param chain Chain to check.
+ * @return Nonzero, iff chain is running.
+ */
+static inline uint8 dma_chain_is_running(dma_chain *chain) {
+    return chain->state == DMA_CHAIN_RUNNING;
+}
+
+/**
+ * @brief Point a started descriptor at a different memory buffer.
+ *
+ * Use this instead of changing desc->cfg, which is only read by
+ * dma_chain_start(). It takes effect the next time desc is loaded,
+ * so it's safe to call from a callback on any descriptor other than
+ * the one which was just started (the finished descriptor's next).
+ *
+ * @param desc Descriptor to change.
+ * @param mem New memory address. For memory-to-memory transfers,
+ *            this is the destination.
+ * @param nr_xfers New number of data to transfer, nonzero.
+ */
+static inline void dma_chain_desc_set_mem(dma_chain_desc *desc,
+                                          __io void *mem,
+                                          uint16 nr_xfers) {
+    desc->cmar = (uint32)mem;
+    desc->cndtr = nr_xfers;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -58,12 +58,14 @@ extern "C"{
 
 struct dma_reg_map;
 
-/* Encapsulates state related to user interrupt handlers. You
- * shouldn't touch these directly; use dma_attach_interrupt() and
- * dma_detach_interupt() instead. */
+/* Encapsulates per-tube state: user interrupt handlers, and who owns
+ * the tube. You shouldn't touch these directly; use
+ * dma_attach_interrupt(), dma_detach_interupt(), dma_tube_claim(),
+ * etc. instead. */
 typedef struct dma_handler_config {
     void (*handler)(void);     /* User handler */
     nvic_irq_num irq_line;     /* IRQ line for interrupt */
+    const void *owner;         /* Claimed by, or NULL */
 } dma_handler_config;
 
 /** DMA device type */
@@ -0,0 +1,82 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/dma_memcpy.h
+ * @brief Memory copies and fills with DMA
+ *
+ * dma_memcpy_async() and dma_memset_async() hand a copy or fill to a
+ * DMA tube, and return while it runs. The callback is made from the
+ * tube's interrupt when it's done. Only one operation runs at a time.
+ * Each claims a free memory-to-memory tube with dma_claim_mem2mem(),
+ * and releases it when it's done.
+ *
+ * Data move a word at a time where the alignment of the buffers
+ * allows it; any odd bytes at either end are done by the CPU before
+ * the DMA transfer starts. Buffers mustn't overlap.
+ *
+ * dma_memcpy() and dma_memset() are blocking versions, which fall
+ * back to the C library for short buffers, or if no tube is free.
+ *
+ * IMPORTANT: this API is unstable, and may change without notice.
+ */
+
+#ifndef _LIBMAPLE_DMA_MEMCPY_H_
+#define _LIBMAPLE_DMA_MEMCPY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmaple/libmaple_types.h>
+#include <libmaple/dma.h>
+
+/** dma_memcpy() and dma_memset() use the CPU below this many bytes. */
+#ifndef DMA_MEMCPY_MIN_LEN
+#define DMA_MEMCPY_MIN_LEN 256
+#endif
+
+/**
+ * Completion callback. result is 0 if the operation finished, or -1
+ * if the DMA controller reported an error.
+ */
+typedef void (*dma_memcpy_callback)(void *arg, int result);
+
+int dma_memcpy_async(void *dst, const void *src, uint32 len,
+                     dma_memcpy_callback callback, void *arg);
+int dma_memset_async(void *dst, uint8 c, uint32 len,
+                     dma_memcpy_callback callback, void *arg);
+uint8 dma_memcpy_busy(void);
+int dma_memcpy_wait(void);
+
+void* dma_memcpy(void *dst, const void *src, uint32 len);
+void* dma_memset(void *dst, uint8 c, uint32 len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/dwt.h
+ * @brief Data watchpoint and trace unit header
+ *
+ * Only the parts needed to use the DWT's cycle counter are here.
+ */
+
+#ifndef _LIBMAPLE_DWT_H_
+#define _LIBMAPLE_DWT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmaple/libmaple_types.h>
+
+/*
+ * Register maps and base pointers
+ */
+
+/** Data watchpoint and trace unit register map type */
+typedef struct dwt_reg_map {
+    __io uint32 CTRL;     /**< Control Register */
+    __io uint32 CYCCNT;   /**< Cycle Count Register */
+    __io uint32 CPICNT;   /**< CPI Count Register */
+    __io uint32 EXCCNT;   /**< Exception Overhead Count Register */
+    __io uint32 SLEEPCNT; /**< Sleep Count Register */
+    __io uint32 LSUCNT;   /**< LSU Count Register */
+    __io uint32 FOLDCNT;  /**< Folded-instruction Count Register */
+    __io uint32 PCSR;     /**< Program Counter Sample Register */
+} dwt_reg_map;
+
+/** Data watchpoint and trace unit register map base pointer */
+#define DWT_BASE                        ((struct dwt_reg_map*)0xE0001000)
+
+/**
+ * Debug Exception and Monitor Control Register. This belongs to the
+ * core debug registers, but its TRCENA bit must be set before the
+ * DWT can be used.
+ */
+#define DWT_DEMCR                       (*(__io uint32*)0xE000EDFC)
+
+/*
+ * Register bit definitions
+ */
+
+/* Debug exception and monitor control register (DWT_DEMCR) */
+
+#define DWT_DEMCR_TRCENA                (1U << 24)
+
+/* Control register (DWT_CTRL) */
+
+#define DWT_CTRL_NUMCOMP                (0xFU << 28)
+#define DWT_CTRL_CYCCNTENA              (1U << 0)
+
+/*
+ * Convenience functions
+ */
+
+/**
+ * @brief Start the cycle counter.
+ *
+ * The counter is left running if it already is, so this doesn't
+ * disturb other users of it.
+ */
+static inline void dwt_cyccnt_enable(void) {
+    DWT_DEMCR |= DWT_DEMCR_TRCENA;
+    DWT_BASE->CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+/**
+ * @brief Read the cycle counter.
+ *
+ * The counter counts core clock cycles, and wraps around every 2^32
+ * of them, so subtract readings to time intervals.
+ *
+ * @see dwt_cyccnt_enable()
+ */
+static inline uint32 dwt_cyccnt(void) {
+    return DWT_BASE->CYCCNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,12 +29,20 @@
  * @file libmaple/include/libmaple/i2c.h
  * @brief Inter-Integrated Circuit (I2C) peripheral support
  *
- * Currently master-only. Usage notes:
+ * Master usage notes:
  *
  * - Enable an I2C device with i2c_master_enable().
  * - Initialize an array of struct i2c_msg to suit the bus
  *   transactions (reads/writes) you wish to perform.
- * - Call i2c_master_xfer() to do the work.
+ * - Call i2c_master_xfer() to do the work, or
+ *   i2c_master_xfer_async() to queue it up and carry on.
+ *
+ * Slave usage notes:
+ *
+ * - Initialize a struct i2c_slave with your address(es), a buffer
+ *   holding your registers, and callbacks.
+ * - Enable an I2C device with i2c_slave_enable(). It can still be
+ *   used as a master when the bus is free.
  */
 
 #ifndef _LIBMAPLE_I2C_H_
@@ -199,10 +207,139 @@ typedef struct i2c_msg {
 #define I2C_BUS_RESET           0x8           // Perform a bus reset
 void i2c_master_enable(i2c_dev *dev, uint32 flags);
 
+/**
+ * @brief Shortest message which is transferred with DMA.
+ *
+ * Longer messages take one interrupt each, instead of one per byte.
+ * Define to 0 to always use interrupts. Single-byte reads can't use
+ * DMA (RM0008, Section 26.3.7), so this can't be less than 2.
+ */
+#ifndef I2C_DMA_THRESHOLD
+#define I2C_DMA_THRESHOLD       8
+#endif
+
 #define I2C_ERROR_PROTOCOL      (-1)
 #define I2C_ERROR_TIMEOUT       (-2)
 int32 i2c_master_xfer(i2c_dev *dev, i2c_msg *msgs, uint16 num, uint32 timeout);
 
+/** i2c_xfer result while the transfer is queued or in progress */
+#define I2C_XFER_PENDING        1
+
+struct i2c_xfer;
+
+/**
+ * @brief Asynchronous transfer completion callback.
+ * @see i2c_master_xfer_async()
+ */
+typedef void (*i2c_xfer_callback)(struct i2c_xfer *xfer);
+
+/**
+ * @brief Asynchronous I2C transfer.
+ *
+ * Filled in by i2c_master_xfer_async(). Must stay put until the
+ * transfer is done.
+ */
+typedef struct i2c_xfer {
+    i2c_msg *msgs;              /**< Messages to send/receive */
+    uint16 num;                 /**< Number of messages */
+    uint32 timeout;             /**< Bus idle timeout, ms; 0 for none */
+    i2c_xfer_callback callback; /**< Called when done, or NULL */
+    void *arg;                  /**< For use by callback */
+
+    /**
+     * I2C_XFER_PENDING until done, then as i2c_master_xfer()'s
+     * return value. */
+    volatile int32 result;
+
+    struct i2c_xfer *next;      /**< For internal use */
+} i2c_xfer;
+
+int32 i2c_master_xfer_async(i2c_dev *dev, i2c_xfer *xfer,
+                            i2c_msg *msgs, uint16 num, uint32 timeout,
+                            i2c_xfer_callback callback, void *arg);
+
+/*
+ * Slave mode
+ */
+
+/* i2c_slave_enable() options, in addition to i2c_master_enable()'s */
+#define I2C_SLAVE_GENERAL_CALL  0x10          // Answer general calls
+#define I2C_SLAVE_USE_DMA       0x20          // Move registers with DMA
+
+struct i2c_slave;
+
+/**
+ * @brief Called when a master starts reading a slave's registers.
+ *
+ * @param slave Slave being read.
+ * @param reg First register to be read.
+ * @return 0 if the registers are ready, or nonzero to hold the bus,
+ *         by stretching the clock, until i2c_slave_release().
+ */
+typedef int (*i2c_slave_read_callback)(struct i2c_slave *slave, uint16 reg);
+
+/**
+ * @brief Called when a master has finished writing a slave's
+ *        registers.
+ *
+ * @param slave Slave written.
+ * @param reg First register written.
+ * @param len Number of registers written.
+ * @return 0, or nonzero to hold the bus, by stretching the clock,
+ *         at the next access until i2c_slave_release().
+ */
+typedef int (*i2c_slave_write_callback)(struct i2c_slave *slave,
+                                        uint16 reg, uint16 len);
+
+/**
+ * @brief I2C slave configuration and state.
+ *
+ * The slave looks like a bank of byte-wide registers to masters. The
+ * first byte of each write sets the register pointer, and the rest
+ * are stored in consecutive registers. Reads come from consecutive
+ * registers, starting at the pointer. Writes past the last register
+ * are dropped, and reads past it return 0xFF.
+ *
+ * Callbacks are called from an interrupt handler, and should be
+ * quick.
+ *
+ * @see i2c_slave_enable()
+ */
+typedef struct i2c_slave {
+    uint8 addr;                 /**< 7-bit address */
+    uint8 addr2;                /**< Second 7-bit address, or 0 */
+    uint8 *regs;                /**< Registers */
+    uint16 size;                /**< Number of registers, at most 256 */
+    i2c_slave_read_callback read_callback; /**< Or NULL */
+    i2c_slave_write_callback write_callback; /**< Or NULL */
+    void *arg;                  /**< For use by callbacks */
+
+    /* Maintained by the driver */
+    uint16 reg;                 /**< Register pointer */
+    uint16 count;               /**< Bytes moved in the last access */
+    uint8 matched;              /**< Address of the last access;
+                                   0 for a general call. */
+
+    /* For internal use */
+    uint8 dir;
+    uint8 have_reg;
+    volatile uint8 held;
+    uint16 reg_start;
+    uint16 dma_len;
+    uint32 flags;
+} i2c_slave;
+
+void i2c_slave_enable(i2c_dev *dev, i2c_slave *slave, uint32 flags);
+void i2c_slave_release(i2c_dev *dev);
+
+/**
+ * @brief Determine whether an asynchronous transfer is done.
+ * @param xfer Transfer, as passed to i2c_master_xfer_async().
+ */
+static inline int i2c_xfer_is_done(i2c_xfer *xfer) {
+    return xfer->result != I2C_XFER_PENDING;
+}
+
 void i2c_bus_reset(const i2c_dev *dev);
 
 /**
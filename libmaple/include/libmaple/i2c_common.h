@@ -45,6 +45,8 @@
 struct gpio_dev;
 struct i2c_reg_map;
 struct i2c_msg;
+struct i2c_xfer;
+struct i2c_slave;
 
 /** I2C device states */
 typedef enum i2c_state {
@@ -88,6 +90,14 @@ typedef struct i2c_dev {
     nvic_irq_num ev_nvic_line;  /**< Event IRQ number */
     nvic_irq_num er_nvic_line;  /**< Error IRQ number */
     volatile i2c_state state;   /**< Device state */
+    volatile uint8 dma_active;  /**< Nonzero while a message uses DMA */
+    uint16 dma_last_left;       /**< For internal use */
+
+    /** Transfer in progress, followed by those waiting their turn */
+    struct i2c_xfer *volatile xfer_head;
+    struct i2c_xfer *xfer_tail; /**< Last queued transfer */
+
+    struct i2c_slave *slave;    /**< Slave mode configuration, or NULL */
 } i2c_dev;
 
 #endif
@@ -118,6 +118,56 @@ static __always_inline void nvic_globalirq_disable() {
     asm volatile("cpsid i");
 }
 
+/**
+ * @brief Disable interrupts, returning the previous PRIMASK value.
+ *
+ * Use this with nvic_globalirq_restore() for critical sections which
+ * may be entered with interrupts already disabled.
+ *
+ * @return Value to pass to nvic_globalirq_restore().
+ */
+static __always_inline uint32 nvic_globalirq_save(void) {
+    uint32 primask;
+    asm volatile("mrs %0, primask\n\t"
+                 "cpsid i"
+                 : "=r" (primask) : : "memory");
+    return primask;
+}
+
+/**
+ * @brief Restore PRIMASK as saved by nvic_globalirq_save().
+ * @param primask Value returned by nvic_globalirq_save().
+ */
+static __always_inline void nvic_globalirq_restore(uint32 primask) {
+    asm volatile("msr primask, %0" : : "r" (primask) : "memory");
+}
+
+/**
+ * @brief Check whether interrupts are disabled (PRIMASK is set).
+ * @return Nonzero if PRIMASK is set, 0 otherwise.
+ */
+static __always_inline int nvic_globalirq_disabled(void) {
+    uint32 primask;
+    asm volatile("mrs %0, primask" : "=r" (primask));
+    return primask & 1;
+}
+
+/**
+ * @brief Check whether an exception handler is running.
+ *
+ * Code which waits for an interrupt to do something can use this to
+ * detect that it may be running at or above that interrupt's
+ * priority, so the interrupt can't preempt it.
+ *
+ * @return Nonzero in an exception handler (IPSR is nonzero), 0 in
+ *         thread mode.
+ */
+static __always_inline int nvic_in_handler(void) {
+    uint32 ipsr;
+    asm volatile("mrs %0, ipsr" : "=r" (ipsr));
+    return ipsr != 0;
+}
+
 /**
  * @brief Enable interrupt irq_num
  * @param irq_num Interrupt to enable
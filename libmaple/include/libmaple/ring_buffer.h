@@ -30,6 +30,9 @@
  *
  * This implementation is not thread-safe.  In particular, none of
  * these functions is guaranteed re-entrant.
+ *
+ * If you need to pass data between an interrupt handler and the rest
+ * of your program, see <libmaple/spsc_queue.h> instead.
  */
 
 #ifndef _LIBMAPLE_RING_BUFFER_H_
@@ -181,6 +184,118 @@ static inline void rb_reset(ring_buffer *rb) {
     rb->tail = rb->head;
 }
 
+/*
+ * Bulk operations
+ *
+ * These move data in contiguous spans rather than a byte at a time.
+ * They use mask arithmetic instead of comparisons to wrap indices, so
+ * they require the buffer length passed to rb_init() to be a power of
+ * two (rb->size is then the index mask). The single-byte routines
+ * above may still be used on such a buffer.
+ *
+ * As with the rest of this file, none of these are re-entrant.
+ */
+
+/**
+ * @brief Returns true if and only if rb can be used with the bulk
+ *        operations.
+ * @param rb Buffer to test.
+ */
+static inline int rb_is_pow2(ring_buffer *rb) {
+    return !((rb->size + 1) & rb->size);
+}
+
+/**
+ * @brief Return the number of elements stored in a power-of-two
+ *        ring buffer.
+ *
+ * Like rb_full_count(), without branching on wraparound.
+ *
+ * @param rb Buffer whose elements to count.
+ */
+static inline uint16 rb_masked_count(ring_buffer *rb) {
+    __io ring_buffer *arb = rb;
+    return (uint16)(arb->tail - arb->head) & rb->size;
+}
+
+/**
+ * @brief Return the number of elements which can be inserted into a
+ *        power-of-two ring buffer before it becomes full.
+ * @param rb Buffer to check.
+ */
+static inline uint16 rb_masked_space(ring_buffer *rb) {
+    return rb->size - rb_masked_count(rb);
+}
+
+/**
+ * @brief Get the longest contiguous run of elements at the head of a
+ *        power-of-two ring buffer.
+ *
+ * This lets a consumer read elements in place. Once it is done with
+ * them, it removes them using rb_consume(). There may be more
+ * elements than this available, starting at the beginning of the
+ * buffer; call again after rb_consume() to get them.
+ *
+ * @param rb Buffer to read from.
+ * @param span Set to point at the first element.
+ * @return Number of elements available at *span.
+ * @see rb_consume()
+ */
+static inline uint16 rb_peek_span(ring_buffer *rb, uint8 **span) {
+    uint16 head = rb->head;
+    uint16 count = rb_masked_count(rb);
+    uint16 to_end = rb->size + 1 - head;
+    *span = (uint8*)rb->buf + head;
+    return count < to_end ? count : to_end;
+}
+
+/**
+ * @brief Remove elements from the head of a power-of-two ring buffer.
+ * @param rb Buffer to remove from.
+ * @param n Number of elements to remove. Must not exceed the number
+ *          most recently returned by rb_peek_span().
+ * @see rb_peek_span()
+ */
+static inline void rb_consume(ring_buffer *rb, uint16 n) {
+    rb->head = (rb->head + n) & rb->size;
+}
+
+/**
+ * @brief Get the longest contiguous run of free space at the tail of
+ *        a power-of-two ring buffer.
+ *
+ * This lets a producer (a DMA transfer, say) fill the buffer in
+ * place. Once it has written some elements there, it makes them
+ * visible to the consumer using rb_commit().
+ *
+ * @param rb Buffer to write to.
+ * @param span Set to point at the first free element.
+ * @return Number of elements which may be written at *span.
+ * @see rb_commit()
+ */
+static inline uint16 rb_reserve_span(ring_buffer *rb, uint8 **span) {
+    uint16 tail = rb->tail;
+    uint16 space = rb_masked_space(rb);
+    uint16 to_end = rb->size + 1 - tail;
+    *span = (uint8*)rb->buf + tail;
+    return space < to_end ? space : to_end;
+}
+
+/**
+ * @brief Append elements written in place onto a power-of-two ring
+ *        buffer.
+ * @param rb Buffer to append onto.
+ * @param n Number of elements to append. Must not exceed the number
+ *          most recently returned by rb_reserve_span().
+ * @see rb_reserve_span()
+ */
+static inline void rb_commit(ring_buffer *rb, uint16 n) {
+    rb->tail = (rb->tail + n) & rb->size;
+}
+
+uint16 rb_write_n(ring_buffer *rb, const uint8 *buf, uint16 len);
+uint16 rb_read_n(ring_buffer *rb, uint8 *buf, uint16 len);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
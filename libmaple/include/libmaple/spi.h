@@ -44,6 +44,7 @@ extern "C" {
 #include <libmaple/libmaple_types.h>
 #include <libmaple/rcc.h>
 #include <libmaple/nvic.h>
+#include <libmaple/dma.h>
 #include <series/spi.h>
 
 /*
@@ -199,11 +200,44 @@ typedef struct spi_reg_map {
  * Devices
  */
 
+/**
+ * @brief Events in a slave's DMA stream.
+ * @see spi_slave_stream_start()
+ */
+typedef enum spi_stream_event {
+    SPI_STREAM_HALF,            /**< First half of the buffer filled */
+    SPI_STREAM_FULL,            /**< Second half filled; wrapping around */
+    SPI_STREAM_ERROR,           /**< DMA error; the stream has stopped */
+    SPI_STREAM_NSS_ASSERTED,    /**< NSS went low (not reported by
+                                   libmaple; see HardwareSPI) */
+    SPI_STREAM_NSS_RELEASED,    /**< NSS went high (likewise) */
+} spi_stream_event;
+
+/** Slave DMA stream event handler */
+typedef void (*spi_stream_callback)(void *arg, spi_stream_event event);
+
 /** SPI device type */
 typedef struct spi_dev {
     spi_reg_map *regs;          /**< Register map */
     rcc_clk_id clk_id;          /**< RCC clock information */
     nvic_irq_num irq_num;       /**< NVIC interrupt number */
+    volatile uint8 dma_busy;    /**< @brief Nonzero while a DMA transfer
+                                 * is in progress.
+                                 * @see spi_dma_xfer_start() */
+    voidArgumentFuncPtr dma_callback; /**< DMA transfer completion
+                                       * callback, or NULL */
+    void *dma_callback_arg;     /**< Argument to dma_callback or
+                                 * stream_callback */
+    uint16 stream_len;          /**< @brief Slave stream buffer length,
+                                 * in frames, or 0 if not streaming.
+                                 * @see spi_slave_stream_start() */
+    spi_stream_callback stream_callback; /**< Slave stream event
+                                          * handler, or NULL */
+    struct spi_txn *txn_head;   /**< @brief Running transaction, or NULL.
+                                 * @see spi_txn_submit() */
+    struct spi_txn *txn_tail;   /**< Last queued transaction */
+    struct spi_txn_device *txn_cs; /**< Device whose chip select is
+                                    * asserted, or NULL */
 } spi_dev;
 
 /*
@@ -324,6 +358,36 @@ void spi_tx_dma_disable(spi_dev *dev);
 void spi_rx_dma_enable(spi_dev *dev);
 void spi_rx_dma_disable(spi_dev *dev);
 
+int spi_dma_xfer_start(spi_dev *dev, const void *tx_buf, void *rx_buf,
+                       uint32 len, voidArgumentFuncPtr callback, void *arg);
+
+int spi_slave_stream_start(spi_dev *dev, void *rx_buf, const void *tx_buf,
+                           uint16 len, spi_stream_callback callback,
+                           void *arg);
+void spi_slave_stream_stop(spi_dev *dev);
+uint16 spi_slave_stream_pos(spi_dev *dev);
+
+/**
+ * @brief Determine whether a DMA transfer is in progress.
+ * @param dev SPI device
+ * @return Nonzero, iff a transfer started by spi_dma_xfer_start()
+ *         hasn't finished yet.
+ * @see spi_dma_xfer_start()
+ */
+static inline uint8 spi_dma_xfer_busy(spi_dev *dev) {
+    return dev->dma_busy;
+}
+
+/**
+ * @brief Wait for a DMA transfer to finish.
+ * @param dev SPI device
+ * @see spi_dma_xfer_start()
+ */
+static inline void spi_dma_xfer_wait(spi_dev *dev) {
+    while (dev->dma_busy)
+        ;
+}
+
 /**
  * @brief Determine if a SPI peripheral is enabled.
  * @param dev SPI device
@@ -393,6 +457,8 @@ static inline spi_cfg_flag spi_dff(spi_dev *dev) {
             SPI_DFF_16_BIT);
 }
 
+void spi_set_dff(spi_dev *dev, spi_cfg_flag dff);
+
 /**
  * @brief Determine whether the device's peripheral receive (RX)
  *        register is empty.
@@ -459,6 +525,79 @@ static inline uint8 spi_is_busy(spi_dev *dev) {
     return dev->regs->SR & SPI_SR_BSY;
 }
 
+/*
+ * Hardware CRC
+ *
+ * With CRC enabled, the peripheral runs a CRC over every frame it
+ * sends and receives. After a transfer's last frame, it sends its TX
+ * CRC, and checks the CRC frame it receives against its RX CRC,
+ * setting SPI_SR_CRCERR on a mismatch. The CRC is 8 or 16 bits wide,
+ * following the data frame format.
+ *
+ * spi_dma_xfer_start() does all of this itself. Polled transfers
+ * must call spi_crc_reset() first, spi_crc_next() right after
+ * loading the last frame, and then read the CRC frame out of the RX
+ * register.
+ */
+
+void spi_crc_enable(spi_dev *dev, uint16 polynomial);
+void spi_crc_disable(spi_dev *dev);
+void spi_crc_reset(spi_dev *dev);
+
+/**
+ * @brief Determine whether a SPI device's hardware CRC is enabled.
+ * @param dev SPI device
+ * @see spi_crc_enable()
+ */
+static inline uint8 spi_crc_is_enabled(spi_dev *dev) {
+    return (dev->regs->CR1 & SPI_CR1_CRCEN) != 0;
+}
+
+/**
+ * @brief Send the TX CRC after the frame in the TX register.
+ *
+ * Call this right after loading a polled transfer's last frame.
+ *
+ * @param dev SPI device
+ */
+static inline void spi_crc_next(spi_dev *dev) {
+    dev->regs->CR1 |= SPI_CR1_CRCNEXT;
+}
+
+/**
+ * @brief Determine whether a received CRC didn't match.
+ * @param dev SPI device
+ * @return Nonzero, iff a CRC mismatch happened since the last call
+ *         to spi_clear_crc_error().
+ */
+static inline uint8 spi_is_crc_error(spi_dev *dev) {
+    return (dev->regs->SR & SPI_SR_CRCERR) != 0;
+}
+
+/**
+ * @brief Clear a SPI device's CRC error flag.
+ * @param dev SPI device
+ */
+static inline void spi_clear_crc_error(spi_dev *dev) {
+    dev->regs->SR = ~SPI_SR_CRCERR;
+}
+
+/**
+ * @brief Get the CRC of the frames a SPI device has received.
+ * @param dev SPI device
+ */
+static inline uint16 spi_rx_crc(spi_dev *dev) {
+    return (uint16)dev->regs->RXCRCR;
+}
+
+/**
+ * @brief Get the CRC of the frames a SPI device has sent.
+ * @param dev SPI device
+ */
+static inline uint16 spi_tx_crc(spi_dev *dev) {
+    return (uint16)dev->regs->TXCRCR;
+}
+
 /*
  * I2S convenience functions (TODO)
  */
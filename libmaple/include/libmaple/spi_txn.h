@@ -0,0 +1,125 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/spi_txn.h
+ * @brief Queued SPI transactions for buses shared between devices
+ *
+ * Each device on a bus gets a spi_txn_device, which holds its
+ * settings (baud rate, mode, bit order, frame size) and its chip
+ * select pin. Transactions submitted with spi_txn_submit() are
+ * queued per bus, and run back to back with DMA: when one finishes,
+ * the DMA interrupt releases its chip select, starts the next, then
+ * calls the finished one's callback. The peripheral is only
+ * reconfigured when the next device's settings differ.
+ *
+ * Don't use the bus in any other way (e.g. through HardwareSPI)
+ * while transactions are queued on it.
+ *
+ * IMPORTANT: this API is unstable, and may change without notice.
+ */
+
+#ifndef _LIBMAPLE_SPI_TXN_H_
+#define _LIBMAPLE_SPI_TXN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <libmaple/libmaple_types.h>
+#include <libmaple/spi.h>
+#include <libmaple/gpio.h>
+
+/** A device on a shared SPI bus. */
+typedef struct spi_txn_device {
+    spi_dev *bus;               /**< Bus the device is on */
+    gpio_dev *cs_dev;           /**< Chip select pin's GPIO device */
+    uint8 cs_bit;               /**< Chip select pin's bit on cs_dev */
+    uint32 cr1;                 /**< Bus configuration, as a CR1 value */
+} spi_txn_device;
+
+void spi_txn_device_init(spi_txn_device *device, spi_dev *bus,
+                         gpio_dev *cs_dev, uint8 cs_bit,
+                         spi_baud_rate baud, spi_mode mode, uint32 flags);
+
+/** spi_txn states */
+typedef enum spi_txn_state {
+    SPI_TXN_IDLE,               /**< Not submitted, or finished */
+    SPI_TXN_QUEUED,             /**< Waiting for the bus */
+    SPI_TXN_RUNNING,            /**< On the bus */
+    SPI_TXN_ERROR,              /**< Couldn't start its DMA transfer */
+} spi_txn_state;
+
+/* Transaction flags */
+
+/** Leave chip select asserted afterwards, for a following
+ * transaction on the same device. */
+#define SPI_TXN_KEEP_CS 0x1
+
+/** A transaction on a shared SPI bus. */
+typedef struct spi_txn {
+    spi_txn_device *device;     /**< Device to talk to */
+    const void *tx_buf;         /**< Frames to send, or NULL for all ones */
+    void *rx_buf;               /**< Received frames, or NULL to drop them */
+    uint16 len;                 /**< Number of frames */
+    uint8 flags;                /**< OR of SPI_TXN_* flags */
+    volatile uint8 state;       /**< An spi_txn_state */
+
+    /** Called from the DMA interrupt when the transaction is over,
+     * or NULL. It may submit more transactions. */
+    void (*callback)(struct spi_txn *txn);
+    void *arg;                  /**< For the callback's use */
+
+    struct spi_txn *next;       /**< Private */
+} spi_txn;
+
+int spi_txn_submit(spi_txn *txn);
+
+/**
+ * @brief Determine whether a transaction is over.
+ * @param txn Transaction to check.
+ * @return Nonzero, iff txn isn't queued or running.
+ */
+static inline uint8 spi_txn_is_done(spi_txn *txn) {
+    return txn->state == SPI_TXN_IDLE || txn->state == SPI_TXN_ERROR;
+}
+
+/**
+ * @brief Wait for a transaction to finish.
+ * @param txn Transaction to wait for.
+ * @return 0 if it ran, or -1 if it couldn't.
+ */
+static inline int spi_txn_wait(spi_txn *txn) {
+    while (!spi_txn_is_done(txn))
+        ;
+    return txn->state == SPI_TXN_ERROR ? -1 : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/spsc_queue.h
+ * @brief Lock-free single-producer, single-consumer queue
+ *
+ * Unlike ring_buffer, a spsc_queue may be shared between one producer
+ * and one consumer running in different contexts (an interrupt
+ * handler and the main loop, two interrupt handlers at different
+ * priorities, or two FreeRTOS tasks) without disabling interrupts.
+ * Only one context may insert, and only one may remove.
+ *
+ * The producer owns the tail index and the consumer owns the head
+ * index. Stores to an element are ordered before the index update
+ * which publishes it, using DMB barriers.
+ *
+ * When the queue is full, new elements are either dropped
+ * (SPSC_DROP_NEWEST) or replace the oldest element
+ * (SPSC_OVERWRITE_OLDEST). In the latter case the producer also moves
+ * the head index, so both sides update it with LDREX/STREX, and the
+ * consumer throws away any element overwritten while it was being
+ * read.
+ *
+ * Queues of bytes (elt_size 1) can also move several bytes at once,
+ * and can be filled in place by e.g. a DMA controller; see
+ * spsc_write_n(), spsc_produced(), spsc_read_n() and spsc_peek_n().
+ */
+
+#ifndef _LIBMAPLE_SPSC_QUEUE_H_
+#define _LIBMAPLE_SPSC_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include <libmaple/libmaple_types.h>
+
+/** What to do when inserting into a full spsc_queue. */
+typedef enum spsc_policy {
+    SPSC_DROP_NEWEST,           /**< Discard the element being inserted */
+    SPSC_OVERWRITE_OLDEST,      /**< Discard the oldest queued element */
+} spsc_policy;
+
+/**
+ * Single-producer, single-consumer queue type.
+ *
+ * head and tail count elements removed and inserted, and are allowed
+ * to wrap around; the queue holds tail - head elements. This means
+ * all n_elts slots can be used.
+ *
+ * Don't touch these fields directly; use the functions below.
+ */
+typedef struct spsc_queue {
+    volatile uint8 *buf;    /**< Element storage */
+    __io uint32 head;       /**< Number of elements removed */
+    __io uint32 tail;       /**< Number of elements inserted */
+    __io uint32 n_dropped;  /**< Number of elements discarded when full */
+    uint32 mask;            /**< Number of elements, minus one */
+    uint16 elt_size;        /**< Size of each element, in bytes */
+    uint8 policy;           /**< An spsc_policy */
+} spsc_queue;
+
+void spsc_init(spsc_queue *q, void *buf, uint16 elt_size, uint32 n_elts,
+               spsc_policy policy);
+int spsc_push(spsc_queue *q, const void *elt);
+int spsc_pop(spsc_queue *q, void *elt);
+int spsc_peek(spsc_queue *q, void *elt);
+void spsc_clear(spsc_queue *q);
+
+uint32 spsc_write_n(spsc_queue *q, const uint8 *buf, uint32 len);
+void spsc_produced(spsc_queue *q, uint32 n);
+uint32 spsc_read_n(spsc_queue *q, uint8 *buf, uint32 len);
+uint32 spsc_peek_n(spsc_queue *q, uint8 *buf, uint32 len);
+
+/**
+ * @brief Return the number of elements in a queue.
+ *
+ * Safe to call from either side; the result may be stale by the time
+ * it's used, but never by more than the other side can have changed.
+ *
+ * @param q Queue whose elements to count.
+ */
+static inline uint32 spsc_count(spsc_queue *q) {
+    return q->tail - q->head;
+}
+
+/**
+ * @brief Return the number of free slots in a queue.
+ *
+ * Like spsc_count(), this is safe to call from either side.
+ *
+ * @param q Queue to check.
+ */
+static inline uint32 spsc_space(spsc_queue *q) {
+    return q->mask + 1 - spsc_count(q);
+}
+
+/**
+ * @brief Returns true if and only if a queue is empty.
+ * @param q Queue to test.
+ */
+static inline int spsc_is_empty(spsc_queue *q) {
+    return q->tail == q->head;
+}
+
+/**
+ * @brief Returns true if and only if a queue is full.
+ * @param q Queue to test.
+ */
+static inline int spsc_is_full(spsc_queue *q) {
+    return q->tail - q->head > q->mask;
+}
+
+/**
+ * @brief Return and reset the number of elements discarded because
+ *        the queue was full.
+ *
+ * Call this from the producer's side.
+ *
+ * @param q Queue to check.
+ */
+static inline uint32 spsc_take_dropped(spsc_queue *q) {
+    uint32 n = q->n_dropped;
+    q->n_dropped = 0;
+    return n;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
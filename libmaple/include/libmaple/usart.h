@@ -43,6 +43,8 @@ extern "C"{
 #include <libmaple/rcc.h>
 #include <libmaple/nvic.h>
 #include <libmaple/ring_buffer.h>
+#include <libmaple/spsc_queue.h>
+#include <libmaple/dma.h>
 #include <series/usart.h>
 
 /*
@@ -378,19 +380,37 @@ typedef struct usart_reg_map {
 #ifndef USART_RX_BUF_SIZE
 #define USART_RX_BUF_SIZE               64
 #endif
+/* The RX queue needs a power of two, so it rounds up. */
+#define USART_RX_QUEUE_SIZE     POWER_OF_TWO_CEIL(USART_RX_BUF_SIZE)
+
+#ifndef USART_TX_BUF_SIZE
+#define USART_TX_BUF_SIZE               64
+#endif
+/* The TX queue needs a power of two, so it rounds up. */
+#define USART_TX_QUEUE_SIZE     POWER_OF_TWO_CEIL(USART_TX_BUF_SIZE)
 
 /** USART device type */
 typedef struct usart_dev {
     usart_reg_map *regs;             /**< Register map */
-    ring_buffer *rb;                 /**< RX ring buffer */
+    spsc_queue *rxq;                 /**< RX queue. This replaces the
+                                      * old ring_buffer *rb; use the
+                                      * usart_*() functions to get at
+                                      * received data. */
     uint32 max_baud;                 /**< @brief Deprecated.
                                       * Maximum baud rate. */
-    uint8 rx_buf[USART_RX_BUF_SIZE]; /**< @brief Deprecated.
-                                      * Actual RX buffer used by rb.
-                                      * This field will be removed in
-                                      * a future release. */
+    uint8 rx_buf[USART_RX_QUEUE_SIZE]; /**< @brief Deprecated.
+                                        * Actual RX buffer used by rxq.
+                                        * This field will be removed
+                                        * in a future release. */
+    spsc_queue *txq;                 /**< TX queue */
+    uint8 tx_buf[USART_TX_QUEUE_SIZE]; /**< TX queue storage */
     rcc_clk_id clk_id;               /**< RCC clock information */
     nvic_irq_num irq_num;            /**< USART NVIC interrupt */
+    dma_dev *rx_dma_dev;             /**< @brief RX DMA controller.
+                                      * NULL unless RX is served by DMA;
+                                      * see usart_rx_dma_enable(). */
+    dma_tube rx_dma_tube;            /**< RX DMA tube, if rx_dma_dev
+                                      * is not NULL. */
 } usart_dev;
 
 void usart_init(usart_dev *dev);
@@ -421,6 +441,42 @@ uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len);
 uint32 usart_rx(usart_dev *dev, uint8 *buf, uint32 len);
 void usart_putudec(usart_dev *dev, uint32 val);
 
+uint32 usart_tx_queue(usart_dev *dev, const uint8 *buf, uint32 len);
+void usart_tx_wait(usart_dev *dev);
+void usart_tx_flush(usart_dev *dev);
+
+int usart_rx_dma_enable(usart_dev *dev);
+void usart_rx_dma_disable(usart_dev *dev);
+
+/**
+ * @brief Bring a DMA-driven RX queue up to date.
+ *
+ * When a serial port's receiver is served by DMA, the bytes it
+ * stores are normally only added to the RX queue by interrupts (DMA
+ * half-transfer, transfer complete, and USART IDLE line). Call this
+ * to account for any bytes the DMA controller has stored since then.
+ *
+ * Does nothing if dev's receiver isn't using DMA.
+ *
+ * @param dev Serial port whose RX queue to update.
+ * @see usart_rx_dma_enable()
+ */
+static inline void usart_rx_dma_sync(usart_dev *dev) {
+    uint32 primask;
+    uint32 pos;
+    if (!dev->rx_dma_dev) {
+        return;
+    }
+    /* The DMA controller is the queue's producer, but it's published
+     * from several contexts, so keep them from racing each other. */
+    primask = nvic_globalirq_save();
+    pos = USART_RX_QUEUE_SIZE - dma_get_count(dev->rx_dma_dev,
+                                              dev->rx_dma_tube);
+    spsc_produced(dev->rxq,
+                  (pos - dev->rxq->tail) & (USART_RX_QUEUE_SIZE - 1));
+    nvic_globalirq_restore(primask);
+}
+
 /**
  * @brief Disable all serial ports.
  */
@@ -428,6 +484,17 @@ static inline void usart_disable_all(void) {
     usart_foreach(usart_disable);
 }
 
+/**
+ * @brief Return the number of bytes waiting in a serial port's TX queue.
+ * @param dev Serial port to check
+ * @return Number of bytes queued by usart_tx_queue() which haven't
+ *         yet been handed to the USART.
+ * @see usart_tx_queue()
+ */
+static inline uint32 usart_tx_pending(usart_dev *dev) {
+    return spsc_count(dev->txq);
+}
+
 /**
  * @brief Transmit one character on a serial port.
  *
@@ -460,15 +527,16 @@ static inline void usart_putstr(usart_dev *dev, const char* str) {
 /**
  * @brief Read one character from a serial port.
  *
- * It's not safe to call this function if the serial port has no data
- * available.
+ * If the serial port has no data available, this returns 0.
  *
  * @param dev Serial port to read from
  * @return byte read
  * @see usart_data_available()
  */
 static inline uint8 usart_getc(usart_dev *dev) {
-    return rb_remove(dev->rb);
+    uint8 byte = 0;
+    spsc_pop(dev->rxq, &byte);
+    return byte;
 }
 
 /**
@@ -477,7 +545,7 @@ static inline uint8 usart_getc(usart_dev *dev) {
  * @return Number of bytes in dev's RX buffer.
  */
 static inline uint32 usart_data_available(usart_dev *dev) {
-    return rb_full_count(dev->rb);
+    return spsc_count(dev->rxq);
 }
 
 /**
@@ -485,7 +553,9 @@ static inline uint32 usart_data_available(usart_dev *dev) {
  * @param dev Serial port whose buffer to empty.
  */
 static inline void usart_reset_rx(usart_dev *dev) {
-    rb_reset(dev->rb);
+    /* Discard what the DMA controller has stored, too. */
+    usart_rx_dma_sync(dev);
+    spsc_clear(dev->rxq);
 }
 
 #ifdef __cplusplus
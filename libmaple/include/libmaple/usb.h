@@ -49,6 +49,7 @@ extern "C" {
 #define USB_DESCRIPTOR_TYPE_STRING        0x03
 #define USB_DESCRIPTOR_TYPE_INTERFACE     0x04
 #define USB_DESCRIPTOR_TYPE_ENDPOINT      0x05
+#define USB_DESCRIPTOR_TYPE_IAD           0x0B
 
 /* Descriptor structs and declaration helpers */
 
@@ -110,6 +111,19 @@ typedef struct usb_descriptor_endpoint {
     uint8  bInterval;
 } __packed usb_descriptor_endpoint;
 
+/* Interface association descriptor, which groups the interfaces of
+ * one function on a composite device. */
+typedef struct usb_descriptor_iad {
+    uint8 bLength;
+    uint8 bDescriptorType;
+    uint8 bFirstInterface;
+    uint8 bInterfaceCount;
+    uint8 bFunctionClass;
+    uint8 bFunctionSubClass;
+    uint8 bFunctionProtocol;
+    uint8 iFunction;
+} __packed usb_descriptor_iad;
+
 typedef struct usb_descriptor_string {
     uint8 bLength;
     uint8 bDescriptorType;
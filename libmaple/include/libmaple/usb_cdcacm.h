@@ -96,6 +96,17 @@ extern "C" {
  * CDC ACM interface
  */
 
+/* Sizes of the queues in front of the TX and RX endpoints. They
+ * must be powers of two; one byte of the TX queue goes unused. The
+ * host can keep sending while a whole 64-byte packet fits in the RX
+ * queue. */
+#ifndef USB_CDCACM_TX_BUF_SIZE
+#define USB_CDCACM_TX_BUF_SIZE 256
+#endif
+#ifndef USB_CDCACM_RX_BUF_SIZE
+#define USB_CDCACM_RX_BUF_SIZE 256
+#endif
+
 void usb_cdcacm_enable(gpio_dev*, uint8);
 void usb_cdcacm_disable(gpio_dev*, uint8);
 
@@ -106,6 +117,7 @@ uint32 usb_cdcacm_peek(uint8* buf, uint32 len);
 
 uint32 usb_cdcacm_data_available(void); /* in RX buffer */
 uint16 usb_cdcacm_get_pending(void);
+uint32 usb_cdcacm_tx_space(void);       /* in TX buffer */
 
 uint8 usb_cdcacm_get_dtr(void);
 uint8 usb_cdcacm_get_rts(void);
@@ -138,11 +150,18 @@ int usb_cdcacm_get_parity(void);      /* bParityType */
 int usb_cdcacm_get_n_data_bits(void); /* bDataBits */
 
 /*
- * Hack: hooks for bootloader reset signalling
+ * Hooks, called from the USB interrupt
+ *
+ * USB_CDCACM_HOOK_RX runs after a packet lands in the RX queue, and
+ * USB_CDCACM_HOOK_TX after the host takes a packet, making room in
+ * the TX queue. Both are also handy for waking up a main loop which
+ * sleeps between packets. (Wirish's SerialUSB uses the RX and
+ * interface setup hooks for bootloader reset signalling.)
  */
 
 #define USB_CDCACM_HOOK_RX 0x1
 #define USB_CDCACM_HOOK_IFACE_SETUP 0x2
+#define USB_CDCACM_HOOK_TX 0x4
 
 void usb_cdcacm_set_hooks(unsigned hook_flags, void (*hook)(unsigned, void*));
 
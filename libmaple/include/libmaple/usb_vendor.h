@@ -0,0 +1,91 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/include/libmaple/usb_vendor.h
+ * @brief Vendor-specific bulk interface, alongside USB CDC ACM
+ *
+ * Building with USB_VENDOR_BULK defined to 1 (e.g. "make
+ * USB_VENDOR_BULK=1"; run "make clean" when switching) turns the USB
+ * CDC ACM device into a composite device. It keeps the virtual serial
+ * port, and adds a vendor-specific interface with a bulk IN and a
+ * bulk OUT endpoint. The host reaches it with e.g. libusb; there's no
+ * line coding or other CDC machinery in the way.
+ *
+ * Packets are passed in place. To send, get the next free packet
+ * buffer with usb_vendor_tx_buffer(), fill it (a DMA transfer can
+ * write into it directly), and queue it with usb_vendor_tx_submit().
+ * To receive, look at the oldest packet with usb_vendor_rx_packet(),
+ * and give its buffer back with usb_vendor_rx_release(). The only
+ * copy is between these buffers and USB packet memory, which the CPU
+ * can't address linearly.
+ *
+ * All endpoints use 64-byte packets, but the packet memory is too
+ * small to double-buffer them all. The bulk IN endpoint is
+ * double-buffered, so the device can keep the host busy; the bulk
+ * OUT endpoint, and the virtual serial port's IN endpoint, are not.
+ *
+ * IMPORTANT: this API is unstable, and may change without notice.
+ */
+
+#ifndef _LIBMAPLE_USB_VENDOR_H_
+#define _LIBMAPLE_USB_VENDOR_H_
+
+#include <libmaple/libmaple_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef USB_VENDOR_BULK
+#define USB_VENDOR_BULK 0
+#endif
+
+#define USB_VENDOR_PACKET_SIZE 64
+
+/* Number of packet buffers in each direction. These must be powers
+ * of two. */
+#ifndef USB_VENDOR_TX_PACKETS
+#define USB_VENDOR_TX_PACKETS 4
+#endif
+#ifndef USB_VENDOR_RX_PACKETS
+#define USB_VENDOR_RX_PACKETS 4
+#endif
+
+#define USB_VENDOR_INTERFACE_CLASS 0xFF
+
+uint8* usb_vendor_tx_buffer(void);
+void usb_vendor_tx_submit(uint16 len);
+uint32 usb_vendor_tx_pending(void);
+
+const uint8* usb_vendor_rx_packet(uint16 *len);
+void usb_vendor_rx_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
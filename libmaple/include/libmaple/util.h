@@ -50,6 +50,14 @@ extern "C"{
 #define GET_BITS(x, m, n) ((((uint32)x) << (31 - (n))) >> ((31 - (n)) + (m)))
 /** True iff v is a power of two (1, 2, 4, 8, ...) */
 #define IS_POWER_OF_TWO(v)  ((v) && !((v) & ((v) - 1)))
+/** Smallest power of two which is at least v, for 1 <= v <= 2^31.
+ *  A constant expression if v is. */
+#define POWER_OF_TWO_CEIL(v) (__P2_SMEAR16((uint32)(v) - 1) + 1)
+#define __P2_SMEAR1(x)  ((x) | ((x) >> 1))
+#define __P2_SMEAR2(x)  (__P2_SMEAR1(x) | (__P2_SMEAR1(x) >> 2))
+#define __P2_SMEAR4(x)  (__P2_SMEAR2(x) | (__P2_SMEAR2(x) >> 4))
+#define __P2_SMEAR8(x)  (__P2_SMEAR4(x) | (__P2_SMEAR4(x) >> 8))
+#define __P2_SMEAR16(x) (__P2_SMEAR8(x) | (__P2_SMEAR8(x) >> 16))
 
 /*
  * Failure routines
@@ -0,0 +1,93 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/ring_buffer.c
+ * @brief Bulk ring buffer operations
+ */
+
+#include <libmaple/ring_buffer.h>
+#include <string.h>
+
+/**
+ * @brief Append a block of elements onto a power-of-two ring buffer.
+ *
+ * Copies as many elements as fit, using at most two calls to
+ * memcpy().
+ *
+ * @param rb Buffer to append onto. Its length must be a power of two.
+ * @param buf Elements to append.
+ * @param len Number of elements in buf.
+ * @return Number of elements appended.
+ * @see rb_is_pow2()
+ */
+uint16 rb_write_n(ring_buffer *rb, const uint8 *buf, uint16 len) {
+    uint16 tail = rb->tail;
+    uint16 space = rb_masked_space(rb);
+    uint16 first;
+
+    if (len > space) {
+        len = space;
+    }
+    first = rb->size + 1 - tail;
+    if (first > len) {
+        first = len;
+    }
+    memcpy((uint8*)rb->buf + tail, buf, first);
+    memcpy((uint8*)rb->buf, buf + first, len - first);
+    rb->tail = (tail + len) & rb->size;
+    return len;
+}
+
+/**
+ * @brief Remove a block of elements from a power-of-two ring buffer.
+ *
+ * Copies as many elements as are available, using at most two calls
+ * to memcpy().
+ *
+ * @param rb Buffer to remove from. Its length must be a power of two.
+ * @param buf Where to store removed elements.
+ * @param len Maximum number of elements to remove.
+ * @return Number of elements removed.
+ * @see rb_is_pow2()
+ */
+uint16 rb_read_n(ring_buffer *rb, uint8 *buf, uint16 len) {
+    uint16 head = rb->head;
+    uint16 count = rb_masked_count(rb);
+    uint16 first;
+
+    if (len > count) {
+        len = count;
+    }
+    first = rb->size + 1 - head;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(buf, (uint8*)rb->buf + head, first);
+    memcpy(buf + first, (uint8*)rb->buf, len - first);
+    rb->head = (head + len) & rb->size;
+    return len;
+}
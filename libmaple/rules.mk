@@ -14,6 +14,7 @@ CFLAGS_$(d) = $(LIBMAPLE_PRIVATE_INCLUDES) $(LIBMAPLE_INCLUDES) -Wall -Werror
 cSRCS_$(d) := adc.c
 cSRCS_$(d) += dac.c
 cSRCS_$(d) += dma.c
+cSRCS_$(d) += dma_memcpy.c
 cSRCS_$(d) += exti.c
 cSRCS_$(d) += flash.c
 cSRCS_$(d) += gpio.c
@@ -21,7 +22,10 @@ cSRCS_$(d) += iwdg.c
 cSRCS_$(d) += nvic.c
 cSRCS_$(d) += pwr.c
 cSRCS_$(d) += rcc.c
+cSRCS_$(d) += ring_buffer.c
 cSRCS_$(d) += spi.c
+cSRCS_$(d) += spi_txn.c
+cSRCS_$(d) += spsc_queue.c
 cSRCS_$(d) += systick.c
 cSRCS_$(d) += timer.c
 cSRCS_$(d) += usart.c
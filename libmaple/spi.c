@@ -34,8 +34,15 @@
 
 #include <libmaple/spi.h>
 #include <libmaple/bitband.h>
+#include <libmaple/dma.h>
+#include "spi_private.h"
 
 static void spi_reconfigure(spi_dev *dev, uint32 cr1_config);
+static void spi_cr1_update(spi_dev *dev, uint32 mask, uint32 bits);
+static int spi_dma_claim(spi_dev *dev, dma_dev *dma,
+                         dma_tube rx_tube, dma_tube tx_tube);
+static void spi_dma_release(spi_dev *dev, dma_dev *dma,
+                            dma_tube rx_tube, dma_tube tx_tube);
 
 /*
  * SPI convenience routines
@@ -152,13 +159,416 @@ void spi_rx_dma_disable(spi_dev *dev) {
     bb_peri_set_bit(&dev->regs->CR2, SPI_CR2_RXDMAEN_BIT, 0);
 }
 
+/**
+ * @brief Set a SPI device's data frame format.
+ *
+ * The device's peripheral will be briefly disabled, so don't call
+ * this in the middle of a transfer.
+ *
+ * @param dev SPI device
+ * @param dff SPI_DFF_8_BIT or SPI_DFF_16_BIT.
+ * @see spi_dff()
+ */
+void spi_set_dff(spi_dev *dev, spi_cfg_flag dff) {
+    spi_cr1_update(dev, SPI_CR1_DFF, dff);
+}
+
+/**
+ * @brief Enable a SPI device's hardware CRC.
+ *
+ * The device's peripheral will be briefly disabled, so don't call
+ * this in the middle of a transfer.
+ *
+ * @param dev SPI device
+ * @param polynomial CRC polynomial, without its top bit. E.g., 0x7
+ *                   is CRC-8's x^8 + x^2 + x + 1, and 0x1021 is
+ *                   CRC-16-CCITT's.
+ * @see spi_crc_disable()
+ */
+void spi_crc_enable(spi_dev *dev, uint16 polynomial) {
+    dev->regs->CRCPR = polynomial;
+    spi_cr1_update(dev, SPI_CR1_CRCEN, 0);
+    spi_cr1_update(dev, SPI_CR1_CRCEN, SPI_CR1_CRCEN);
+    spi_clear_crc_error(dev);
+}
+
+/**
+ * @brief Disable a SPI device's hardware CRC.
+ * @param dev SPI device
+ * @see spi_crc_enable()
+ */
+void spi_crc_disable(spi_dev *dev) {
+    spi_cr1_update(dev, SPI_CR1_CRCEN, 0);
+}
+
+/**
+ * @brief Zero a SPI device's CRC registers, before a new transfer.
+ *
+ * The device's peripheral will be briefly disabled. This does
+ * nothing unless the device's hardware CRC is enabled.
+ *
+ * @param dev SPI device
+ */
+void spi_crc_reset(spi_dev *dev) {
+    if (spi_crc_is_enabled(dev)) {
+        spi_crc_enable(dev, dev->regs->CRCPR);
+    }
+}
+
+/**
+ * @brief Start a full-duplex DMA transfer.
+ *
+ * Clocks len frames out of tx_buf while receiving len frames into
+ * rx_buf, then calls callback(arg) from the DMA interrupt. Frames
+ * are bytes or halfwords, following dev's data frame format. The
+ * transfer runs in the background; use spi_dma_xfer_busy() or
+ * spi_dma_xfer_wait() to find out when it's done, and don't touch
+ * the buffers or dev until then.
+ *
+ * dev must already be enabled, and should be a bus master. If its
+ * hardware CRC is enabled, the transfer starts a fresh CRC, and ends
+ * with a CRC frame in each direction; check the result with
+ * spi_is_crc_error() once it's done.
+ *
+ * @param dev SPI device
+ * @param tx_buf Frames to send, or NULL to send all ones.
+ * @param rx_buf Buffer for received frames, or NULL to discard them.
+ * @param len Number of frames to transfer, at most 65,535.
+ * @param callback Function to call when the transfer is done, or NULL.
+ * @param arg Argument to callback.
+ * @return 0 on success, -1 if dev is busy or can't use DMA (including
+ *         when another driver has claimed one of its DMA tubes), or
+ *         a negative dma_tube_cfg() error code.
+ * @see spi_dma_xfer_busy()
+ * @see spi_dma_xfer_wait()
+ */
+int spi_dma_xfer_start(spi_dev *dev, const void *tx_buf, void *rx_buf,
+                       uint32 len, voidArgumentFuncPtr callback, void *arg) {
+    /* Stand-ins for a missing tx_buf or rx_buf */
+    static const uint16 tx_dummy = 0xFFFF;
+    static uint16 rx_dummy;
+    dma_tube_config cfg;
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+    dma_xfer_size size;
+    int ret;
+
+    if (dev->dma_busy || len == 0 || len > 0xFFFF ||
+        !_spi_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                        &tx_tube, &tx_req_src, &handler) ||
+        !spi_dma_claim(dev, dma, rx_tube, tx_tube)) {
+        return -1;
+    }
+    size = spi_dff(dev) == SPI_DFF_8_BIT ? DMA_SIZE_8BITS : DMA_SIZE_16BITS;
+
+    dma_init(dma);
+    spi_crc_reset(dev);
+
+    /* Every transfer receives, even if the caller doesn't care, so
+     * RX completion tells us when the last frame is off the wire. */
+    cfg.tube_src = &dev->regs->DR;
+    cfg.tube_src_size = size;
+    cfg.tube_dst = rx_buf ? rx_buf : &rx_dummy;
+    cfg.tube_dst_size = size;
+    cfg.tube_nr_xfers = len;
+    cfg.tube_flags = ((rx_buf ? DMA_CFG_DST_INC : 0) |
+                      DMA_CFG_CMPLT_IE | DMA_CFG_ERR_IE);
+    cfg.target_data = NULL;
+    cfg.tube_req_src = rx_req_src;
+    ret = dma_tube_cfg(dma, rx_tube, &cfg);
+    if (ret != DMA_TUBE_CFG_SUCCESS) {
+        spi_dma_release(dev, dma, rx_tube, tx_tube);
+        return ret;
+    }
+
+    cfg.tube_src = (void*)(tx_buf ? tx_buf : &tx_dummy);
+    cfg.tube_dst = &dev->regs->DR;
+    cfg.tube_flags = tx_buf ? DMA_CFG_SRC_INC : 0;
+    cfg.tube_req_src = tx_req_src;
+    ret = dma_tube_cfg(dma, tx_tube, &cfg);
+    if (ret != DMA_TUBE_CFG_SUCCESS) {
+        spi_dma_release(dev, dma, rx_tube, tx_tube);
+        return ret;
+    }
+
+    /* Emptying DR before TX fills it keeps the RX tube from falling
+     * behind. */
+    dma_set_priority(dma, rx_tube, DMA_PRIORITY_HIGH);
+    dma_set_priority(dma, tx_tube, DMA_PRIORITY_MEDIUM);
+    dma_attach_interrupt(dma, rx_tube, handler);
+
+    dev->dma_callback = callback;
+    dev->dma_callback_arg = arg;
+    dev->dma_busy = 1;
+
+    /* Drop anything stale, or it'd be the first frame received. */
+    while (spi_is_rx_nonempty(dev)) {
+        (void)spi_rx_reg(dev);
+    }
+
+    dma_enable(dma, rx_tube);
+    dma_enable(dma, tx_tube);
+    spi_rx_dma_enable(dev);
+    spi_tx_dma_enable(dev);
+    return 0;
+}
+
+/**
+ * @brief Stream a slave's traffic through circular DMA buffers.
+ *
+ * Received frames go round and round rx_buf, and callback is called
+ * from the DMA interrupt each time a half of it fills up, so one half
+ * can be processed while the other fills. If tx_buf isn't NULL, its
+ * frames are sent over and over in the same way; otherwise, the
+ * slave's output isn't defined. Frames are bytes or halfwords,
+ * following dev's data frame format.
+ *
+ * Nothing stops the DMA controller from overwriting frames which
+ * haven't been processed yet, so keep up. Use spi_slave_stream_pos()
+ * to find out where the next frame will go.
+ *
+ * dev must already be enabled as a slave. It can't be used for other
+ * transfers until spi_slave_stream_stop().
+ *
+ * @param dev SPI device
+ * @param rx_buf Buffer for received frames.
+ * @param tx_buf Frames to send, or NULL.
+ * @param len Length of rx_buf, and tx_buf if used, in frames. Must be
+ *            even.
+ * @param callback Event handler, or NULL.
+ * @param arg Argument to callback.
+ * @return 0 on success, -1 if dev is busy or can't use DMA (including
+ *         when another driver has claimed one of its DMA tubes), or
+ *         a negative dma_tube_cfg() error code.
+ * @see spi_slave_stream_stop()
+ */
+int spi_slave_stream_start(spi_dev *dev, void *rx_buf, const void *tx_buf,
+                           uint16 len, spi_stream_callback callback,
+                           void *arg) {
+    dma_tube_config cfg;
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+    dma_xfer_size size;
+    int ret;
+
+    if (dev->dma_busy || len < 2 || (len & 1) ||
+        !_spi_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                        &tx_tube, &tx_req_src, &handler) ||
+        !spi_dma_claim(dev, dma, rx_tube, tx_tube)) {
+        return -1;
+    }
+    size = spi_dff(dev) == SPI_DFF_8_BIT ? DMA_SIZE_8BITS : DMA_SIZE_16BITS;
+
+    dma_init(dma);
+
+    cfg.tube_src = &dev->regs->DR;
+    cfg.tube_src_size = size;
+    cfg.tube_dst = rx_buf;
+    cfg.tube_dst_size = size;
+    cfg.tube_nr_xfers = len;
+    cfg.tube_flags = (DMA_CFG_DST_INC | DMA_CFG_CIRC | DMA_CFG_CMPLT_IE |
+                      DMA_CFG_HALF_CMPLT_IE | DMA_CFG_ERR_IE);
+    cfg.target_data = NULL;
+    cfg.tube_req_src = rx_req_src;
+    ret = dma_tube_cfg(dma, rx_tube, &cfg);
+    if (ret != DMA_TUBE_CFG_SUCCESS) {
+        spi_dma_release(dev, dma, rx_tube, tx_tube);
+        return ret;
+    }
+    /* The master sets the pace, so receiving must never wait. */
+    dma_set_priority(dma, rx_tube, DMA_PRIORITY_VERY_HIGH);
+
+    if (tx_buf) {
+        cfg.tube_src = (void*)tx_buf;
+        cfg.tube_dst = &dev->regs->DR;
+        cfg.tube_flags = DMA_CFG_SRC_INC | DMA_CFG_CIRC;
+        cfg.tube_req_src = tx_req_src;
+        ret = dma_tube_cfg(dma, tx_tube, &cfg);
+        if (ret != DMA_TUBE_CFG_SUCCESS) {
+            spi_dma_release(dev, dma, rx_tube, tx_tube);
+            return ret;
+        }
+        dma_set_priority(dma, tx_tube, DMA_PRIORITY_HIGH);
+    }
+
+    dma_attach_interrupt(dma, rx_tube, handler);
+    dev->stream_callback = callback;
+    dev->dma_callback_arg = arg;
+    dev->stream_len = len;
+    dev->dma_busy = 1;
+
+    while (spi_is_rx_nonempty(dev)) {
+        (void)spi_rx_reg(dev);
+    }
+
+    dma_enable(dma, rx_tube);
+    spi_rx_dma_enable(dev);
+    if (tx_buf) {
+        dma_enable(dma, tx_tube);
+        spi_tx_dma_enable(dev);
+    }
+    return 0;
+}
+
+/**
+ * @brief Stop a slave's DMA stream.
+ * @param dev SPI device
+ * @see spi_slave_stream_start()
+ */
+void spi_slave_stream_stop(spi_dev *dev) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+
+    if (!dev->stream_len) {
+        return;
+    }
+    _spi_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+    spi_tx_dma_disable(dev);
+    spi_rx_dma_disable(dev);
+    dma_disable(dma, tx_tube);
+    dma_disable(dma, rx_tube);
+    dma_detach_interrupt(dma, rx_tube);
+    spi_dma_release(dev, dma, rx_tube, tx_tube);
+    dev->stream_len = 0;
+    dev->dma_busy = 0;
+}
+
+/**
+ * @brief Get the index in a slave's stream buffer where the next
+ *        frame will be received.
+ * @param dev SPI device
+ * @see spi_slave_stream_start()
+ */
+uint16 spi_slave_stream_pos(spi_dev *dev) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+    uint16 left;
+
+    if (!dev->stream_len) {
+        return 0;
+    }
+    _spi_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+    left = dma_get_count(dma, rx_tube);
+    /* The count reloads from len, not 0, on wraparound. */
+    return left ? dev->stream_len - left : 0;
+}
+
+/* Called from the RX tube's DMA interrupt while streaming. */
+static void spi_stream_irq(spi_dev *dev, dma_dev *dma, dma_tube rx_tube) {
+    spi_stream_callback callback = dev->stream_callback;
+    void *arg = dev->dma_callback_arg;
+    spi_stream_event event;
+
+    switch (dma_get_irq_cause(dma, rx_tube)) {
+    case DMA_TRANSFER_HALF_COMPLETE:
+        event = SPI_STREAM_HALF;
+        break;
+    case DMA_TRANSFER_COMPLETE:
+        event = SPI_STREAM_FULL;
+        break;
+    default:
+        spi_slave_stream_stop(dev);
+        event = SPI_STREAM_ERROR;
+        break;
+    }
+    if (callback) {
+        callback(arg, event);
+    }
+}
+
+/* Called from the RX tube's DMA interrupt. */
+void _spi_dma_xfer_done(spi_dev *dev) {
+    dma_dev *dma;
+    dma_tube rx_tube, tx_tube;
+    dma_request_src rx_req_src, tx_req_src;
+    voidFuncPtr handler;
+    voidArgumentFuncPtr callback = dev->dma_callback;
+
+    _spi_dma_route(dev, &dma, &rx_tube, &rx_req_src,
+                   &tx_tube, &tx_req_src, &handler);
+
+    if (dev->stream_len) {
+        spi_stream_irq(dev, dma, rx_tube);
+        return;
+    }
+
+    /* If the last callback started this transfer, we can get an
+     * interrupt for the last transfer's flags. Ignore it: a finished
+     * tube has no frames left, and an error disables the tube. */
+    if (dma_is_enabled(dma, rx_tube) && dma_get_count(dma, rx_tube)) {
+        return;
+    }
+
+    spi_tx_dma_disable(dev);
+    spi_rx_dma_disable(dev);
+
+    /* The peripheral sends its CRC frame as soon as TX DMA is done,
+     * but we have to collect the one it receives. That's one frame
+     * time after the last data frame came in. */
+    if (spi_crc_is_enabled(dev)) {
+        while (!spi_is_rx_nonempty(dev))
+            ;
+        (void)spi_rx_reg(dev);
+    }
+
+    dma_disable(dma, tx_tube);
+    dma_disable(dma, rx_tube);
+    dma_clear_isr_bits(dma, rx_tube);
+    spi_dma_release(dev, dma, rx_tube, tx_tube);
+
+    dev->dma_busy = 0;
+    if (callback) {
+        callback(dev->dma_callback_arg);
+    }
+}
+
 /*
  * SPI auxiliary routines
  */
 
+/* DMA tubes are shared with other peripherals, so claim dev's for
+ * each transfer. Claims both or neither, and returns nonzero on
+ * success. */
+static int spi_dma_claim(spi_dev *dev, dma_dev *dma,
+                         dma_tube rx_tube, dma_tube tx_tube) {
+    if (dma_tube_claim(dma, rx_tube, dev) < 0) {
+        return 0;
+    }
+    if (dma_tube_claim(dma, tx_tube, dev) < 0) {
+        dma_tube_release(dma, rx_tube, dev);
+        return 0;
+    }
+    return 1;
+}
+
+static void spi_dma_release(spi_dev *dev, dma_dev *dma,
+                            dma_tube rx_tube, dma_tube tx_tube) {
+    dma_tube_release(dma, tx_tube, dev);
+    dma_tube_release(dma, rx_tube, dev);
+}
+
 static void spi_reconfigure(spi_dev *dev, uint32 cr1_config) {
     spi_irq_disable(dev, SPI_INTERRUPTS_ALL);
     spi_peripheral_disable(dev);
     dev->regs->CR1 = cr1_config;
     spi_peripheral_enable(dev);
 }
+
+/* Changes CR1 bits which may only be written while the peripheral is
+ * disabled. */
+static void spi_cr1_update(spi_dev *dev, uint32 mask, uint32 bits) {
+    uint32 cr1 = dev->regs->CR1;
+    dev->regs->CR1 = cr1 & ~SPI_CR1_SPE;
+    dev->regs->CR1 = ((cr1 & ~mask) | bits) & ~SPI_CR1_SPE;
+    dev->regs->CR1 = (cr1 & ~mask) | bits;
+}
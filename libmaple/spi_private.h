@@ -34,4 +34,18 @@
         .irq_num = NVIC_SPI##num,                 \
     }
 
+/*
+ * DMA support
+ */
+
+/* Series-specific. Finds the DMA tubes which serve dev's RX and TX
+ * requests, and the DMA interrupt handler which calls
+ * _spi_dma_xfer_done(dev). Returns 0 if dev can't use DMA. */
+int _spi_dma_route(spi_dev *dev, dma_dev **dma,
+                   dma_tube *rx_tube, dma_request_src *rx_req_src,
+                   dma_tube *tx_tube, dma_request_src *tx_req_src,
+                   voidFuncPtr *handler);
+
+void _spi_dma_xfer_done(spi_dev *dev);
+
 #endif
@@ -0,0 +1,198 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/spi_txn.c
+ * @brief Queued SPI transactions for buses shared between devices
+ */
+
+#include <libmaple/spi_txn.h>
+#include <libmaple/nvic.h>
+
+/* CR1 bits which make up a device's settings */
+#define SPI_TXN_CR1_MASK (SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA |    \
+                          SPI_CR1_LSBFIRST | SPI_CR1_DFF | SPI_CR1_MSTR | \
+                          SPI_CR1_SSM | SPI_CR1_SSI)
+
+static void txn_done(void *bus);
+
+/**
+ * @brief Set up a device on a shared SPI bus.
+ *
+ * The chip select pin must already be configured as an output; this
+ * drives it high (deasserted). The bus should already be enabled as
+ * a master, with its GPIOs configured.
+ *
+ * @param device Device to set up.
+ * @param bus Bus the device is on.
+ * @param cs_dev Chip select pin's GPIO device.
+ * @param cs_bit Chip select pin's bit on cs_dev.
+ * @param baud Bus baud rate to use with the device.
+ * @param mode SPI mode to use with the device.
+ * @param flags Logical OR of spi_cfg_flag values: SPI_FRAME_LSB,
+ *              SPI_DFF_16_BIT, or 0.
+ */
+void spi_txn_device_init(spi_txn_device *device, spi_dev *bus,
+                         gpio_dev *cs_dev, uint8 cs_bit,
+                         spi_baud_rate baud, spi_mode mode, uint32 flags) {
+    device->bus = bus;
+    device->cs_dev = cs_dev;
+    device->cs_bit = cs_bit;
+    device->cr1 = (baud | mode | flags |
+                   SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI);
+    gpio_write_bit(cs_dev, cs_bit, 1);
+}
+
+/* Releases the asserted chip select, once the last frame is out. */
+static void txn_release_cs(spi_dev *bus) {
+    spi_txn_device *device = bus->txn_cs;
+
+    if (device) {
+        while (spi_is_busy(bus))
+            ;
+        gpio_write_bit(device->cs_dev, device->cs_bit, 1);
+        bus->txn_cs = NULL;
+    }
+}
+
+/* Starts the transaction at the head of bus's queue, if there is
+ * one. Transactions which can't start are removed from the queue and
+ * returned as a list, for the caller to call back once interrupts
+ * are back on. Call with interrupts off. */
+static spi_txn* txn_start(spi_dev *bus) {
+    spi_txn *failed = NULL;
+    spi_txn **failed_tail = &failed;
+    spi_txn *txn;
+
+    while ((txn = bus->txn_head) != NULL) {
+        spi_txn_device *device = txn->device;
+
+        if (bus->txn_cs != device) {
+            txn_release_cs(bus);
+        }
+        if ((bus->regs->CR1 & SPI_TXN_CR1_MASK) != device->cr1) {
+            bus->regs->CR1 = device->cr1;
+            bus->regs->CR1 = device->cr1 | SPI_CR1_SPE;
+        }
+        if (!bus->txn_cs) {
+            gpio_write_bit(device->cs_dev, device->cs_bit, 0);
+            bus->txn_cs = device;
+        }
+
+        txn->state = SPI_TXN_RUNNING;
+        if (spi_dma_xfer_start(bus, txn->tx_buf, txn->rx_buf, txn->len,
+                               txn_done, bus) == 0) {
+            break;
+        }
+
+        txn_release_cs(bus);
+        bus->txn_head = txn->next;
+        txn->state = SPI_TXN_ERROR;
+        txn->next = NULL;
+        *failed_tail = txn;
+        failed_tail = &txn->next;
+    }
+    if (!bus->txn_head) {
+        bus->txn_tail = NULL;
+    }
+    return failed;
+}
+
+static void txn_call_back(spi_txn *list) {
+    while (list) {
+        spi_txn *next = list->next;
+        if (list->callback) {
+            list->callback(list);
+        }
+        list = next;
+    }
+}
+
+/**
+ * @brief Queue a transaction on its device's bus.
+ *
+ * Fill in txn first; its state must be SPI_TXN_IDLE, as it is when
+ * zero-initialized. It starts right away if the bus is free. Don't
+ * touch txn or its buffers until it's done; see spi_txn_is_done(),
+ * spi_txn_wait(), and txn->callback. This may be called from
+ * interrupt handlers, including transaction callbacks.
+ *
+ * @param txn Transaction to queue.
+ * @return 0 on success, or -1 if txn is empty or already queued.
+ */
+int spi_txn_submit(spi_txn *txn) {
+    spi_dev *bus = txn->device->bus;
+    spi_txn *failed = NULL;
+    uint32 primask;
+
+    if (txn->len == 0 || !spi_txn_is_done(txn)) {
+        return -1;
+    }
+    txn->state = SPI_TXN_QUEUED;
+    txn->next = NULL;
+
+    /* The queue is shared with the DMA interrupt, and with anything
+     * else which submits transactions. */
+    primask = nvic_globalirq_save();
+    if (bus->txn_tail) {
+        bus->txn_tail->next = txn;
+    } else {
+        bus->txn_head = txn;
+    }
+    bus->txn_tail = txn;
+    if (bus->txn_head == txn) {
+        failed = txn_start(bus);
+    }
+    nvic_globalirq_restore(primask);
+
+    txn_call_back(failed);
+    return 0;
+}
+
+/* Called from the DMA interrupt when the running transaction is
+ * over. Starts the next one before calling back, to keep the bus
+ * busy. */
+static void txn_done(void *arg) {
+    spi_dev *bus = (spi_dev*)arg;
+    spi_txn *txn;
+    spi_txn *failed;
+    uint32 primask;
+
+    primask = nvic_globalirq_save();
+    txn = bus->txn_head;
+    bus->txn_head = txn->next;
+    if (!(txn->flags & SPI_TXN_KEEP_CS)) {
+        txn_release_cs(bus);
+    }
+    txn->state = SPI_TXN_IDLE;
+    failed = txn_start(bus);
+    nvic_globalirq_restore(primask);
+
+    if (txn->callback) {
+        txn->callback(txn);
+    }
+    txn_call_back(failed);
+}
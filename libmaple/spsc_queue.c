@@ -0,0 +1,392 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/spsc_queue.c
+ * @brief Lock-free single-producer, single-consumer queue
+ */
+
+#include <libmaple/spsc_queue.h>
+#include <libmaple/util.h>
+#include <string.h>
+
+/*
+ * Barriers and atomics
+ */
+
+/* Keep memory accesses on either side of this in order, as seen by
+ * other contexts. */
+static __always_inline void spsc_dmb(void) {
+    asm volatile("dmb" : : : "memory");
+}
+
+/* Atomically: if *addr == old, set *addr = new and return 1;
+ * otherwise, return 0. Exception entry and return clear the exclusive
+ * monitor, so a preempting producer or consumer makes STREX fail. */
+static __always_inline int spsc_cas(__io uint32 *addr,
+                                    uint32 old, uint32 new) {
+    uint32 cur;
+    uint32 failed;
+    do {
+        asm volatile("ldrex %0, [%1]" : "=r" (cur) : "r" (addr) : "memory");
+        if (cur != old) {
+            asm volatile("clrex" : : : "memory");
+            return 0;
+        }
+        asm volatile("strex %0, %2, [%1]"
+                     : "=&r" (failed) : "r" (addr), "r" (new) : "memory");
+    } while (failed);
+    return 1;
+}
+
+/*
+ * Element access
+ */
+
+static __always_inline void copy_in(spsc_queue *q, uint32 idx,
+                                    const void *elt) {
+    uint8 *slot = (uint8*)q->buf + (idx & q->mask) * q->elt_size;
+    if (q->elt_size == 1) {
+        *slot = *(const uint8*)elt;
+    } else {
+        memcpy(slot, elt, q->elt_size);
+    }
+}
+
+static __always_inline void copy_out(spsc_queue *q, uint32 idx,
+                                     void *elt) {
+    const uint8 *slot = (const uint8*)q->buf + (idx & q->mask) * q->elt_size;
+    if (q->elt_size == 1) {
+        *(uint8*)elt = *slot;
+    } else {
+        memcpy(elt, slot, q->elt_size);
+    }
+}
+
+/* Byte queues only. Copy len bytes between buf and the queue,
+ * starting at element idx, wrapping around the end of the storage. */
+
+static void copy_in_n(spsc_queue *q, uint32 idx, const uint8 *buf,
+                      uint32 len) {
+    uint32 start = idx & q->mask;
+    uint32 first = q->mask + 1 - start;
+    if (first > len) {
+        first = len;
+    }
+    memcpy((uint8*)q->buf + start, buf, first);
+    memcpy((uint8*)q->buf, buf + first, len - first);
+}
+
+static void copy_out_n(spsc_queue *q, uint32 idx, uint8 *buf, uint32 len) {
+    uint32 start = idx & q->mask;
+    uint32 first = q->mask + 1 - start;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(buf, (const uint8*)q->buf + start, first);
+    memcpy(buf + first, (const uint8*)q->buf, len - first);
+}
+
+/*
+ * Routines
+ */
+
+/**
+ * @brief Initialise a queue.
+ *
+ * Call this before either side starts using the queue.
+ *
+ * @param q        Queue to initialise.
+ * @param buf      Element storage; must hold elt_size * n_elts bytes.
+ * @param elt_size Size of each element, in bytes.
+ * @param n_elts   Number of elements buf can hold. Must be a power
+ *                 of two. All of them can be used.
+ * @param policy   What to do when inserting into a full queue.
+ */
+void spsc_init(spsc_queue *q, void *buf, uint16 elt_size, uint32 n_elts,
+               spsc_policy policy) {
+    ASSERT(IS_POWER_OF_TWO(n_elts));
+    ASSERT(elt_size > 0);
+    q->buf = buf;
+    q->head = 0;
+    q->tail = 0;
+    q->n_dropped = 0;
+    q->mask = n_elts - 1;
+    q->elt_size = elt_size;
+    q->policy = (uint8)policy;
+}
+
+/**
+ * @brief Insert an element at the end of a queue.
+ *
+ * Only the producer may call this.
+ *
+ * If the queue is full, then with SPSC_DROP_NEWEST, elt is discarded;
+ * with SPSC_OVERWRITE_OLDEST, the oldest element is discarded to make
+ * room. Either way, the queue's dropped count is incremented.
+ *
+ * @param q   Queue to insert into.
+ * @param elt Element to copy into the queue.
+ * @return 1 if elt was inserted, 0 if it was dropped.
+ * @see spsc_take_dropped()
+ */
+int spsc_push(spsc_queue *q, const void *elt) {
+    uint32 tail = q->tail;
+    uint32 head = q->head;
+
+    if (tail - head > q->mask) {
+        if (q->policy == SPSC_DROP_NEWEST) {
+            q->n_dropped++;
+            return 0;
+        }
+        /* Discard the oldest element. If this fails, the consumer
+         * just removed it for us. */
+        if (spsc_cas(&q->head, head, head + 1)) {
+            q->n_dropped++;
+        }
+        spsc_dmb();             /* Release the slot before reusing it */
+    }
+
+    copy_in(q, tail, elt);
+    spsc_dmb();                 /* Element before index */
+    q->tail = tail + 1;
+    return 1;
+}
+
+/**
+ * @brief Remove the first element from a queue.
+ *
+ * Only the consumer may call this.
+ *
+ * @param q   Queue to remove from.
+ * @param elt Where to copy the removed element.
+ * @return 1 if an element was removed, 0 if the queue was empty.
+ */
+int spsc_pop(spsc_queue *q, void *elt) {
+    uint32 head;
+
+    do {
+        head = q->head;
+        if (head == q->tail) {
+            return 0;
+        }
+        spsc_dmb();             /* Index before element */
+        copy_out(q, head, elt);
+        spsc_dmb();             /* Element before releasing its slot */
+        if (q->policy == SPSC_DROP_NEWEST) {
+            /* We own head outright. */
+            q->head = head + 1;
+            return 1;
+        }
+        /* The producer may have overwritten this element while we
+         * were reading it. If so, it moved head, so try again. */
+    } while (!spsc_cas(&q->head, head, head + 1));
+    return 1;
+}
+
+/**
+ * @brief Copy the first element of a queue without removing it.
+ *
+ * Only the consumer may call this.
+ *
+ * @param q   Queue to examine.
+ * @param elt Where to copy the first element.
+ * @return 1 if an element was copied, 0 if the queue was empty.
+ */
+int spsc_peek(spsc_queue *q, void *elt) {
+    uint32 head;
+
+    do {
+        head = q->head;
+        if (head == q->tail) {
+            return 0;
+        }
+        spsc_dmb();
+        copy_out(q, head, elt);
+        spsc_dmb();
+    } while (q->head != head);
+    return 1;
+}
+
+/**
+ * @brief Remove every element from a queue.
+ *
+ * Only the consumer may call this.
+ *
+ * @param q Queue to empty.
+ */
+void spsc_clear(spsc_queue *q) {
+    uint32 head;
+
+    if (q->policy == SPSC_DROP_NEWEST) {
+        q->head = q->tail;
+        return;
+    }
+    do {
+        head = q->head;
+    } while (!spsc_cas(&q->head, head, q->tail));
+}
+
+/*
+ * Byte queues
+ *
+ * These move several elements at once, and only work on queues whose
+ * elt_size is 1.
+ */
+
+/**
+ * @brief Insert bytes at the end of a byte queue.
+ *
+ * Only the producer may call this.
+ *
+ * This never discards queued bytes, whatever q's policy: it inserts
+ * as many bytes from buf as fit, and counts the rest as dropped.
+ *
+ * @param q   Queue to insert into. Its elt_size must be 1.
+ * @param buf Bytes to insert.
+ * @param len Number of bytes in buf.
+ * @return Number of bytes inserted.
+ */
+uint32 spsc_write_n(spsc_queue *q, const uint8 *buf, uint32 len) {
+    uint32 tail = q->tail;
+    uint32 space = q->mask + 1 - (tail - q->head);
+
+    ASSERT(q->elt_size == 1);
+    if (len > space) {
+        q->n_dropped += len - space;
+        len = space;
+    }
+    copy_in_n(q, tail, buf, len);
+    spsc_dmb();                 /* Elements before index */
+    q->tail = tail + len;
+    return len;
+}
+
+/**
+ * @brief Account for bytes stored directly into a byte queue.
+ *
+ * For producers which write the queue's storage themselves, like a
+ * DMA controller filling it as a circular buffer: the n bytes after
+ * the last element inserted are published to the consumer. Only the
+ * producer may call this.
+ *
+ * With SPSC_OVERWRITE_OLDEST, if that overfills the queue, the oldest
+ * bytes are discarded, and counted as dropped. With SPSC_DROP_NEWEST,
+ * n must be no more than spsc_space(q).
+ *
+ * @param q Queue whose storage was written. Its elt_size must be 1.
+ * @param n Number of bytes written.
+ */
+void spsc_produced(spsc_queue *q, uint32 n) {
+    uint32 size = q->mask + 1;
+    uint32 tail = q->tail + n;
+    uint32 head;
+
+    ASSERT(q->elt_size == 1);
+    if (q->policy == SPSC_DROP_NEWEST) {
+        ASSERT(n <= spsc_space(q));
+    } else {
+        do {
+            head = q->head;
+            if (tail - head <= size) {
+                break;
+            }
+        } while (!spsc_cas(&q->head, head, tail - size));
+        if (tail - head > size) {
+            q->n_dropped += tail - head - size;
+        }
+    }
+    spsc_dmb();                 /* Elements before index */
+    q->tail = tail;
+}
+
+/**
+ * @brief Remove bytes from the front of a byte queue.
+ *
+ * Only the consumer may call this.
+ *
+ * @param q   Queue to remove from. Its elt_size must be 1.
+ * @param buf Where to copy the removed bytes.
+ * @param len Maximum number of bytes to remove.
+ * @return Number of bytes removed.
+ */
+uint32 spsc_read_n(spsc_queue *q, uint8 *buf, uint32 len) {
+    uint32 head;
+    uint32 n;
+
+    ASSERT(q->elt_size == 1);
+    do {
+        head = q->head;
+        n = q->tail - head;
+        if (n > len) {
+            n = len;
+        }
+        if (!n) {
+            return 0;
+        }
+        spsc_dmb();             /* Index before elements */
+        copy_out_n(q, head, buf, n);
+        spsc_dmb();             /* Elements before releasing their slots */
+        if (q->policy == SPSC_DROP_NEWEST) {
+            q->head = head + n;
+            return n;
+        }
+        /* As in spsc_pop(), try again if any were overwritten. */
+    } while (!spsc_cas(&q->head, head, head + n));
+    return n;
+}
+
+/**
+ * @brief Copy bytes from the front of a byte queue without removing
+ *        them.
+ *
+ * Only the consumer may call this.
+ *
+ * @param q   Queue to examine. Its elt_size must be 1.
+ * @param buf Where to copy the bytes.
+ * @param len Maximum number of bytes to copy.
+ * @return Number of bytes copied.
+ */
+uint32 spsc_peek_n(spsc_queue *q, uint8 *buf, uint32 len) {
+    uint32 head;
+    uint32 n;
+
+    ASSERT(q->elt_size == 1);
+    do {
+        head = q->head;
+        n = q->tail - head;
+        if (n > len) {
+            n = len;
+        }
+        if (!n) {
+            return 0;
+        }
+        spsc_dmb();
+        copy_out_n(q, head, buf, n);
+        spsc_dmb();
+    } while (q->head != head);
+    return n;
+}
@@ -71,18 +71,33 @@ static dma_dev dma2 = {
 dma_dev *DMA2 = &dma2;
 #endif
 
+/*
+ * Helpers for dealing with dma_request_src's bit encoding (see the
+ * comments in the dma_request_src definition).
+ */
+
+/* rcc_clk_id of dma_dev which supports src. */
+static __always_inline rcc_clk_id src_clk_id(dma_request_src src) {
+    return (rcc_clk_id)((uint32)src >> 3);
+}
+
+/* Channel corresponding to src. */
+static __always_inline dma_channel src_channel(dma_request_src src) {
+    return (dma_channel)(src & 0x7);
+}
+
 /*
  * Auxiliary routines
  */
 
 /* Can channel serve cfg->tube_req_src? */
 static int cfg_req_ok(dma_channel channel, dma_tube_config *cfg) {
-    return (cfg->tube_req_src & 0x7) == channel;
+    return src_channel(cfg->tube_req_src) == channel;
 }
 
 /* Can dev serve cfg->tube_req_src? */
 static int cfg_dev_ok(dma_dev *dev, dma_tube_config *cfg) {
-    return (rcc_clk_id)(cfg->tube_req_src >> 3) == dev->clk_id;
+    return src_clk_id(cfg->tube_req_src) == dev->clk_id;
 }
 
 /* Is addr acceptable for use as DMA src/dst? */
@@ -356,6 +371,56 @@ void dma_setup_transfer(dma_dev       *dev,
     channel_regs->CPAR = (uint32)peripheral_address;
 }
 
+/*
+ * Tube ownership
+ */
+
+dma_handler_config* _dma_tube_state(dma_dev *dev, dma_channel channel) {
+    return &dev->handlers[channel - 1];
+}
+
+/* Each request source has exactly one channel. */
+int _dma_req_src_tube(dma_request_src req_src, unsigned n,
+                      dma_dev **dev, dma_channel *channel) {
+    if (n > 0) {
+        return 0;
+    }
+    switch (src_clk_id(req_src)) {
+    case RCC_DMA1:
+        *dev = DMA1;
+        break;
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+    case RCC_DMA2:
+        *dev = DMA2;
+        break;
+#endif
+    default:
+        return 0;
+    }
+    *channel = src_channel(req_src);
+    return 1;
+}
+
+/* Any channel can do memory-to-memory. DMA2 comes first, since its
+ * channels are wanted by fewer peripherals. */
+int _dma_mem2mem_tube(unsigned n, dma_dev **dev, dma_channel *channel,
+                      dma_request_src *req_src) {
+    *dev = DMA1;
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+    if (n < 5) {
+        *dev = DMA2;
+    } else {
+        n -= 5;
+    }
+#endif
+    if (n >= 7) {
+        return 0;
+    }
+    *channel = (dma_channel)(n + 1);
+    *req_src = (dma_request_src)(((*dev)->clk_id << 3) | *channel);
+    return 1;
+}
+
 /*
  * IRQ handlers
  */
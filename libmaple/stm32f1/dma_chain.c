@@ -0,0 +1,258 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/stm32f1/dma_chain.c
+ * @brief Linked lists of DMA transfers
+ */
+
+#include <libmaple/dma_chain.h>
+
+/* Interrupt enables which the chain owns */
+#define CHAIN_CCR_IE (DMA_CCR_TEIE | DMA_CCR_HTIE | DMA_CCR_TCIE)
+
+/*
+ * Interrupt handling
+ */
+
+/* DMA handlers don't take arguments, so each tube gets a trampoline
+ * which looks up the chain running on it. */
+static dma_chain *dma1_chains[7];
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+static dma_chain *dma2_chains[5];
+#endif
+
+static __always_inline void chain_load(dma_tube_reg_map *chregs,
+                                       dma_chain_desc *desc) {
+    chregs->CCR = 0;            /* Must disable before reconfiguring */
+    chregs->CNDTR = desc->cndtr;
+    chregs->CPAR = desc->cpar;
+    chregs->CMAR = desc->cmar;
+    chregs->CCR = desc->ccr | DMA_CCR_EN;
+}
+
+static void chain_irq(dma_chain *chain) {
+    dma_chain_desc *desc = chain->current;
+    dma_chain_desc *next;
+    dma_tube_reg_map *chregs;
+    uint8 status_bits;
+
+    if (!desc) {
+        return;
+    }
+    chregs = dma_tube_regs(chain->dev, chain->tube);
+    status_bits = dma_get_isr_bits(chain->dev, chain->tube);
+    dma_clear_isr_bits(chain->dev, chain->tube);
+
+    if (status_bits & 0x8) {
+        /* The tube has disabled itself. */
+        dma_tube_release(chain->dev, chain->tube, chain);
+        chain->current = NULL;
+        chain->state = DMA_CHAIN_ERROR;
+    } else if ((status_bits & 0x2) || chregs->CNDTR == 0) {
+        /* A short transfer can complete before we return, and
+         * dma_irq_handler() clears its flags on our way out. Its
+         * interrupt is pending again by then, so on the next call we
+         * catch it by its empty CNDTR instead. */
+        next = desc->next;
+        if (next) {
+            chain_load(chregs, next);
+        } else {
+            chregs->CCR = 0;
+            dma_tube_release(chain->dev, chain->tube, chain);
+            chain->state = DMA_CHAIN_IDLE;
+        }
+        chain->current = next;
+    } else {
+        return;
+    }
+
+    if (desc->callback) {
+        desc->callback(chain, desc);
+    }
+}
+
+#define CHAIN_IRQ(n, ch)                                \
+    static void dma##n##_ch##ch##_chain_irq(void) {     \
+        chain_irq(dma##n##_chains[ch - 1]);             \
+    }
+
+CHAIN_IRQ(1, 1)
+CHAIN_IRQ(1, 2)
+CHAIN_IRQ(1, 3)
+CHAIN_IRQ(1, 4)
+CHAIN_IRQ(1, 5)
+CHAIN_IRQ(1, 6)
+CHAIN_IRQ(1, 7)
+static void (*const dma1_chain_irqs[7])(void) = {
+    dma1_ch1_chain_irq, dma1_ch2_chain_irq, dma1_ch3_chain_irq,
+    dma1_ch4_chain_irq, dma1_ch5_chain_irq, dma1_ch6_chain_irq,
+    dma1_ch7_chain_irq,
+};
+
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+CHAIN_IRQ(2, 1)
+CHAIN_IRQ(2, 2)
+CHAIN_IRQ(2, 3)
+CHAIN_IRQ(2, 4)
+CHAIN_IRQ(2, 5)
+static void (*const dma2_chain_irqs[5])(void) = {
+    dma2_ch1_chain_irq, dma2_ch2_chain_irq, dma2_ch3_chain_irq,
+    dma2_ch4_chain_irq, dma2_ch5_chain_irq,
+};
+#endif
+
+/*
+ * Routines
+ */
+
+/* Configure the tube from desc->cfg, and save the resulting register
+ * values in desc. */
+static int chain_prepare(dma_dev *dev, dma_tube tube, dma_chain_desc *desc,
+                         dma_priority priority) {
+    dma_tube_reg_map *chregs = dma_tube_regs(dev, tube);
+    int ret;
+
+    if ((desc->cfg.tube_flags & DMA_CFG_CIRC) ||
+        desc->cfg.tube_nr_xfers == 0) {
+        return -DMA_TUBE_CFG_ECFG;
+    }
+    ret = dma_tube_cfg(dev, tube, &desc->cfg);
+    if (ret < 0) {
+        return ret;
+    }
+    desc->ccr = ((chregs->CCR & ~(CHAIN_CCR_IE | DMA_CCR_PL | DMA_CCR_EN)) |
+                 DMA_CCR_TEIE | DMA_CCR_TCIE | (priority << 12));
+    desc->cpar = chregs->CPAR;
+    desc->cmar = chregs->CMAR;
+    desc->cndtr = chregs->CNDTR;
+    return DMA_TUBE_CFG_SUCCESS;
+}
+
+/* Whether desc is one of head, ..., last. */
+static int chain_contains(dma_chain_desc *head, dma_chain_desc *last,
+                          dma_chain_desc *desc) {
+    for (;;) {
+        if (head == desc) {
+            return 1;
+        }
+        if (head == last) {
+            return 0;
+        }
+        head = head->next;
+    }
+}
+
+/**
+ * @brief Start running a list of DMA transfers.
+ *
+ * Every descriptor reachable from head is checked with
+ * dma_tube_cfg() before anything starts. The list ends at a
+ * descriptor whose next field is NULL, or loops back to an earlier
+ * descriptor. Descriptors may be shared between chains which aren't
+ * running at the same time, but not with one that is.
+ *
+ * The chain claims the tube with dma_tube_claim() until it finishes
+ * or is stopped, and takes over the tube's interrupt handler.
+ *
+ * @param chain Chain to start. Its previous contents are ignored.
+ * @param dev DMA device.
+ * @param tube Tube to run the transfers on. Every descriptor's
+ *             tube_req_src must belong to it.
+ * @param head First descriptor.
+ * @param priority Priority of the tube's requests.
+ * @return DMA_TUBE_CFG_SUCCESS (0) when the chain has started, or
+ *         the negative dma_tube_cfg() error for the first bad
+ *         descriptor. -DMA_TUBE_CFG_ECFG also means that a
+ *         descriptor used DMA_CFG_CIRC, or had no data to transfer,
+ *         or that another driver has claimed the tube.
+ * @see dma_tube_cfg()
+ */
+int dma_chain_start(dma_chain *chain, dma_dev *dev, dma_tube tube,
+                    dma_chain_desc *head, dma_priority priority) {
+    dma_chain **slot;
+    void (*handler)(void);
+    dma_chain_desc *desc = head;
+    int ret;
+
+    ASSERT(head);
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+    if (dev == DMA2) {
+        slot = &dma2_chains[tube - 1];
+        handler = dma2_chain_irqs[tube - 1];
+    } else
+#endif
+    {
+        slot = &dma1_chains[tube - 1];
+        handler = dma1_chain_irqs[tube - 1];
+    }
+    if (dma_tube_claim(dev, tube, chain) < 0) {
+        return -DMA_TUBE_CFG_ECFG;
+    }
+
+    for (;;) {
+        ret = chain_prepare(dev, tube, desc, priority);
+        if (ret < 0) {
+            dma_tube_release(dev, tube, chain);
+            return ret;
+        }
+        if (!desc->next || chain_contains(head, desc, desc->next)) {
+            break;
+        }
+        desc = desc->next;
+    }
+
+    chain->dev = dev;
+    chain->tube = tube;
+    chain->current = head;
+    chain->state = DMA_CHAIN_RUNNING;
+    *slot = chain;
+    dma_attach_interrupt(dev, tube, handler);
+    chain_load(dma_tube_regs(dev, tube), head);
+    return DMA_TUBE_CFG_SUCCESS;
+}
+
+/**
+ * @brief Stop a chain, abandoning any transfer in progress.
+ *
+ * The tube is disabled, its interrupt handler is detached, and it's
+ * released. No more callbacks will be made. This may be called from
+ * a callback, or after the chain has finished.
+ *
+ * @param chain Chain to stop. It must have been started.
+ */
+void dma_chain_stop(dma_chain *chain) {
+    /* Once it's finished, the tube may belong to someone else. */
+    if (dma_tube_owner(chain->dev, chain->tube) == chain) {
+        dma_detach_interrupt(chain->dev, chain->tube);
+        dma_clear_isr_bits(chain->dev, chain->tube);
+        dma_tube_release(chain->dev, chain->tube, chain);
+    }
+    chain->current = NULL;
+    if (chain->state == DMA_CHAIN_RUNNING) {
+        chain->state = DMA_CHAIN_IDLE;
+    }
+}
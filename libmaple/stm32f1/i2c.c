@@ -92,6 +92,50 @@ void __irq_i2c2_er(void) {
     _i2c_irq_error_handler(I2C2);
 }
 
+/* Called by systick.c every millisecond. */
+void _i2c_systick_hook(void) {
+    _i2c_timeout_tick(I2C1);
+    _i2c_timeout_tick(I2C2);
+}
+
+/*
+ * DMA support
+ */
+
+static void i2c1_dma_irq(void) {
+    _i2c_dma_irq_handler(I2C1);
+}
+
+static void i2c2_dma_irq(void) {
+    _i2c_dma_irq_handler(I2C2);
+}
+
+int _i2c_dma_route(i2c_dev *dev, dma_dev **dma,
+                   dma_tube *rx_tube, dma_request_src *rx_req_src,
+                   dma_tube *tx_tube, dma_request_src *tx_req_src,
+                   voidFuncPtr *handler) {
+    switch (dev->clk_id) {
+    case RCC_I2C1:
+        *dma = DMA1;
+        *rx_tube = DMA_CH7;
+        *rx_req_src = DMA_REQ_SRC_I2C1_RX;
+        *tx_tube = DMA_CH6;
+        *tx_req_src = DMA_REQ_SRC_I2C1_TX;
+        *handler = i2c1_dma_irq;
+        return 1;
+    case RCC_I2C2:
+        *dma = DMA1;
+        *rx_tube = DMA_CH5;
+        *rx_req_src = DMA_REQ_SRC_I2C2_RX;
+        *tx_tube = DMA_CH4;
+        *tx_req_src = DMA_REQ_SRC_I2C2_TX;
+        *handler = i2c2_dma_irq;
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 /*
  * Internal APIs
  */
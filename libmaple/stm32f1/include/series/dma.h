@@ -519,6 +519,10 @@ static inline uint8 dma_is_enabled(dma_dev *dev, dma_tube tube) {
     return (uint8)(dma_tube_regs(dev, tube)->CCR & DMA_CCR_EN);
 }
 
+static inline uint16 dma_get_count(dma_dev *dev, dma_tube tube) {
+    return (uint16)dma_tube_regs(dev, tube)->CNDTR;
+}
+
 static inline uint8 dma_get_isr_bits(dma_dev *dev, dma_tube tube) {
     uint8 shift = (tube - 1) * 4;
     return (dev->regs->ISR >> shift) & 0xF;
@@ -18,6 +18,7 @@ cSRCS_$(d) := adc.c
 cSRCS_$(d) += can.c
 cSRCS_$(d) += bkp.c
 cSRCS_$(d) += dma.c
+cSRCS_$(d) += dma_chain.c
 cSRCS_$(d) += exti.c
 cSRCS_$(d) += fsmc.c
 cSRCS_$(d) += gpio.c
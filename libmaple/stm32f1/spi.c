@@ -82,3 +82,57 @@ void spi_foreach(void (*fn)(spi_dev*)) {
     fn(SPI3);
 #endif
 }
+
+/*
+ * DMA support
+ */
+
+static void spi1_dma_irq(void) {
+    _spi_dma_xfer_done(&spi1);
+}
+
+static void spi2_dma_irq(void) {
+    _spi_dma_xfer_done(&spi2);
+}
+
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+static void spi3_dma_irq(void) {
+    _spi_dma_xfer_done(&spi3);
+}
+#endif
+
+int _spi_dma_route(spi_dev *dev, dma_dev **dma,
+                   dma_tube *rx_tube, dma_request_src *rx_req_src,
+                   dma_tube *tx_tube, dma_request_src *tx_req_src,
+                   voidFuncPtr *handler) {
+    switch (dev->clk_id) {
+    case RCC_SPI1:
+        *dma = DMA1;
+        *rx_tube = DMA_CH2;
+        *rx_req_src = DMA_REQ_SRC_SPI1_RX;
+        *tx_tube = DMA_CH3;
+        *tx_req_src = DMA_REQ_SRC_SPI1_TX;
+        *handler = spi1_dma_irq;
+        return 1;
+    case RCC_SPI2:
+        *dma = DMA1;
+        *rx_tube = DMA_CH4;
+        *rx_req_src = DMA_REQ_SRC_SPI2_RX;
+        *tx_tube = DMA_CH5;
+        *tx_req_src = DMA_REQ_SRC_SPI2_TX;
+        *handler = spi2_dma_irq;
+        return 1;
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+    case RCC_SPI3:
+        *dma = DMA2;
+        *rx_tube = DMA_CH1;
+        *rx_req_src = DMA_REQ_SRC_SPI3_RX;
+        *tx_tube = DMA_CH2;
+        *tx_req_src = DMA_REQ_SRC_SPI3_TX;
+        *handler = spi3_dma_irq;
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
@@ -40,10 +40,12 @@
  * Devices
  */
 
-static ring_buffer usart1_rb;
+static spsc_queue usart1_rxq;
+static spsc_queue usart1_txq;
 static usart_dev usart1 = {
     .regs     = USART1_BASE,
-    .rb       = &usart1_rb,
+    .rxq      = &usart1_rxq,
+    .txq      = &usart1_txq,
     .max_baud = 4500000UL,
     .clk_id   = RCC_USART1,
     .irq_num  = NVIC_USART1,
@@ -51,10 +53,12 @@ static usart_dev usart1 = {
 /** USART1 device */
 usart_dev *USART1 = &usart1;
 
-static ring_buffer usart2_rb;
+static spsc_queue usart2_rxq;
+static spsc_queue usart2_txq;
 static usart_dev usart2 = {
     .regs     = USART2_BASE,
-    .rb       = &usart2_rb,
+    .rxq      = &usart2_rxq,
+    .txq      = &usart2_txq,
     .max_baud = 2250000UL,
     .clk_id   = RCC_USART2,
     .irq_num  = NVIC_USART2,
@@ -62,10 +66,12 @@ static usart_dev usart2 = {
 /** USART2 device */
 usart_dev *USART2 = &usart2;
 
-static ring_buffer usart3_rb;
+static spsc_queue usart3_rxq;
+static spsc_queue usart3_txq;
 static usart_dev usart3 = {
     .regs     = USART3_BASE,
-    .rb       = &usart3_rb,
+    .rxq      = &usart3_rxq,
+    .txq      = &usart3_txq,
     .max_baud = 2250000UL,
     .clk_id   = RCC_USART3,
     .irq_num  = NVIC_USART3,
@@ -74,10 +80,12 @@ static usart_dev usart3 = {
 usart_dev *USART3 = &usart3;
 
 #if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
-static ring_buffer uart4_rb;
+static spsc_queue uart4_rxq;
+static spsc_queue uart4_txq;
 static usart_dev uart4 = {
     .regs     = UART4_BASE,
-    .rb       = &uart4_rb,
+    .rxq      = &uart4_rxq,
+    .txq      = &uart4_txq,
     .max_baud = 2250000UL,
     .clk_id   = RCC_UART4,
     .irq_num  = NVIC_UART4,
@@ -85,10 +93,12 @@ static usart_dev uart4 = {
 /** UART4 device */
 usart_dev *UART4 = &uart4;
 
-static ring_buffer uart5_rb;
+static spsc_queue uart5_rxq;
+static spsc_queue uart5_txq;
 static usart_dev uart5 = {
     .regs     = UART5_BASE,
-    .rb       = &uart5_rb,
+    .rxq      = &uart5_rxq,
+    .txq      = &uart5_txq,
     .max_baud = 2250000UL,
     .clk_id   = RCC_UART5,
     .irq_num  = NVIC_UART5,
@@ -143,28 +153,85 @@ void usart_foreach(void (*fn)(usart_dev*)) {
 #endif
 }
 
+/*
+ * RX DMA support
+ */
+
+static void usart1_rx_dma_irq(void) {
+    usart_rx_dma_sync(&usart1);
+}
+
+static void usart2_rx_dma_irq(void) {
+    usart_rx_dma_sync(&usart2);
+}
+
+static void usart3_rx_dma_irq(void) {
+    usart_rx_dma_sync(&usart3);
+}
+
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+static void uart4_rx_dma_irq(void) {
+    usart_rx_dma_sync(&uart4);
+}
+#endif
+
+int _usart_rx_dma_route(usart_dev *dev, dma_dev **dma, dma_tube *tube,
+                        dma_request_src *req_src, voidFuncPtr *handler) {
+    switch (dev->clk_id) {
+    case RCC_USART1:
+        *dma = DMA1;
+        *tube = DMA_CH5;
+        *req_src = DMA_REQ_SRC_USART1_RX;
+        *handler = usart1_rx_dma_irq;
+        return 1;
+    case RCC_USART2:
+        *dma = DMA1;
+        *tube = DMA_CH6;
+        *req_src = DMA_REQ_SRC_USART2_RX;
+        *handler = usart2_rx_dma_irq;
+        return 1;
+    case RCC_USART3:
+        *dma = DMA1;
+        *tube = DMA_CH3;
+        *req_src = DMA_REQ_SRC_USART3_RX;
+        *handler = usart3_rx_dma_irq;
+        return 1;
+#if defined(STM32_HIGH_DENSITY) || defined(STM32_XL_DENSITY)
+    case RCC_UART4:
+        *dma = DMA2;
+        *tube = DMA_CH3;
+        *req_src = DMA_REQ_SRC_UART4_RX;
+        *handler = uart4_rx_dma_irq;
+        return 1;
+#endif
+    default:
+        /* UART5 has no DMA requests. */
+        return 0;
+    }
+}
+
 /*
  * Interrupt handlers.
  */
 
 void __irq_usart1(void) {
-    usart_irq(&usart1_rb, USART1_BASE);
+    usart_irq(&usart1);
 }
 
 void __irq_usart2(void) {
-    usart_irq(&usart2_rb, USART2_BASE);
+    usart_irq(&usart2);
 }
 
 void __irq_usart3(void) {
-    usart_irq(&usart3_rb, USART3_BASE);
+    usart_irq(&usart3);
 }
 
 #ifdef STM32_HIGH_DENSITY
 void __irq_uart4(void) {
-    usart_irq(&uart4_rb, UART4_BASE);
+    usart_irq(&uart4);
 }
 
 void __irq_uart5(void) {
-    usart_irq(&uart5_rb, UART5_BASE);
+    usart_irq(&uart5);
 }
 #endif
@@ -268,6 +268,41 @@ dma_irq_cause dma_get_irq_cause(dma_dev *dev, dma_tube tube) {
     return DMA_TRANSFER_ERROR;
 }
 
+/*
+ * Tube ownership
+ */
+
+dma_handler_config* _dma_tube_state(dma_dev *dev, dma_tube tube) {
+    return &dev->handlers[tube];
+}
+
+int _dma_req_src_tube(dma_request_src req_src, unsigned n,
+                      dma_dev **dev, dma_tube *tube) {
+    uint32 mask = src_stream_mask(req_src);
+    int stream;
+
+    *dev = src_clk_id(req_src) == RCC_DMA1 ? DMA1 : DMA2;
+    for (stream = DMA_S0; stream <= DMA_S7; stream++) {
+        if ((mask & (1U << stream)) && n-- == 0) {
+            *tube = (dma_tube)stream;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Only DMA2 can do memory-to-memory, on any stream. */
+int _dma_mem2mem_tube(unsigned n, dma_dev **dev, dma_tube *tube,
+                      dma_request_src *req_src) {
+    if (n > DMA_S7) {
+        return 0;
+    }
+    *dev = DMA2;
+    *tube = (dma_tube)n;
+    *req_src = (dma_request_src)_DMA_STM32F2_REQ_SRC(1U << n, RCC_DMA2, 0);
+    return 1;
+}
+
 /*
  * IRQ handlers
  */
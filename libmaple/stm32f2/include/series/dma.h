@@ -695,6 +695,10 @@ static inline uint8 dma_is_enabled(dma_dev *dev, dma_tube tube) {
     return dma_tube_regs(dev, tube)->SCR & DMA_SCR_EN;
 }
 
+static inline uint16 dma_get_count(dma_dev *dev, dma_tube tube) {
+    return (uint16)dma_tube_regs(dev, tube)->SNDTR;
+}
+
 /* F2-only; available because of double-buffering. */
 void dma_set_mem_n_addr(dma_dev *dev, dma_tube tube, int n,
                         __io void *address);
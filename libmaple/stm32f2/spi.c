@@ -74,6 +74,57 @@ void spi_foreach(void (*fn)(spi_dev*)) {
     fn(SPI3);
 }
 
+/*
+ * DMA support
+ */
+
+static void spi1_dma_irq(void) {
+    _spi_dma_xfer_done(&spi1);
+}
+
+static void spi2_dma_irq(void) {
+    _spi_dma_xfer_done(&spi2);
+}
+
+static void spi3_dma_irq(void) {
+    _spi_dma_xfer_done(&spi3);
+}
+
+int _spi_dma_route(spi_dev *dev, dma_dev **dma,
+                   dma_tube *rx_tube, dma_request_src *rx_req_src,
+                   dma_tube *tx_tube, dma_request_src *tx_req_src,
+                   voidFuncPtr *handler) {
+    switch (dev->clk_id) {
+    case RCC_SPI1:
+        *dma = DMA2;
+        *rx_tube = DMA_S0;
+        *rx_req_src = DMA_REQ_SRC_SPI1_RX;
+        *tx_tube = DMA_S3;
+        *tx_req_src = DMA_REQ_SRC_SPI1_TX;
+        *handler = spi1_dma_irq;
+        return 1;
+    case RCC_SPI2:
+        *dma = DMA1;
+        *rx_tube = DMA_S3;
+        *rx_req_src = DMA_REQ_SRC_SPI2_RX;
+        *tx_tube = DMA_S4;
+        *tx_req_src = DMA_REQ_SRC_SPI2_TX;
+        *handler = spi2_dma_irq;
+        return 1;
+    case RCC_SPI3:
+        *dma = DMA1;
+        *rx_tube = DMA_S0;
+        *rx_req_src = DMA_REQ_SRC_SPI3_RX;
+        *tx_tube = DMA_S7;
+        *tx_req_src = DMA_REQ_SRC_SPI3_TX;
+        *handler = spi3_dma_irq;
+        return 1;
+    default:
+        ASSERT(0);              /* Can't happen */
+        return 0;
+    }
+}
+
 gpio_af spi_get_af(spi_dev *dev) {
     switch (dev->clk_id) {
     case RCC_SPI1:              /* Fall through */
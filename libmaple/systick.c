@@ -35,6 +35,9 @@
 volatile uint32 systick_uptime_millis;
 static void (*systick_user_callback)(void);
 
+/* (Undocumented) hook used by the I2C driver to time out transfers */
+extern __weak void _i2c_systick_hook(void);
+
 /**
  * @brief Initialize and enable SysTick.
  *
@@ -82,6 +85,9 @@ void systick_attach_callback(void (*callback)(void)) {
 
 void __exc_systick(void) {
     systick_uptime_millis++;
+    if (_i2c_systick_hook) {
+        _i2c_systick_hook();
+    }
     if (systick_user_callback) {
         systick_user_callback();
     }
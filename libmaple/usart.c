@@ -33,13 +33,21 @@
  */
 
 #include <libmaple/usart.h>
+#include <libmaple/bitband.h>
+#include <libmaple/nvic.h>
+#include "usart_private.h"
 
 /**
  * @brief Initialize a serial port.
  * @param dev         Serial port to be initialized
  */
 void usart_init(usart_dev *dev) {
-    rb_init(dev->rb, USART_RX_BUF_SIZE, dev->rx_buf);
+    if (dev->rx_dma_dev) {
+        usart_rx_dma_disable(dev);
+    }
+    spsc_init(dev->rxq, dev->rx_buf, 1, USART_RX_QUEUE_SIZE, USART_RX_POLICY);
+    spsc_init(dev->txq, dev->tx_buf, 1, USART_TX_QUEUE_SIZE,
+              SPSC_DROP_NEWEST);
     rcc_clk_enable(dev->clk_id);
     nvic_irq_enable(dev->irq_num);
 }
@@ -70,6 +78,11 @@ void usart_disable(usart_dev *dev) {
     /* FIXME this misbehaves (on F1) if you try to use PWM on TX afterwards */
     usart_reg_map *regs = dev->regs;
 
+    /* Stop draining the TX queue; anything left in it is dropped.
+     * With the interrupt off, we're its only consumer. */
+    regs->CR1 &= ~USART_CR1_TXEIE;
+    spsc_clear(dev->txq);
+
     /* TC bit must be high before disabling the USART */
     while((regs->CR1 & USART_CR1_UE) && !(regs->SR & USART_SR_TC))
         ;
@@ -77,12 +90,22 @@ void usart_disable(usart_dev *dev) {
     /* Disable UE */
     regs->CR1 &= ~USART_CR1_UE;
 
+    /* Stop RX DMA, if it was in use */
+    if (dev->rx_dma_dev) {
+        usart_rx_dma_disable(dev);
+    }
+
     /* Clean up buffer */
     usart_reset_rx(dev);
 }
 
 /**
  * @brief Nonblocking USART transmit
+ *
+ * This writes directly to the USART's data register, bypassing the
+ * TX queue used by usart_tx_queue(); don't mix the two while queued
+ * data are still pending.
+ *
  * @param dev Serial port to transmit over
  * @param buf Buffer to transmit
  * @param len Maximum number of bytes to transmit
@@ -97,6 +120,119 @@ uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len) {
     return txed;
 }
 
+/**
+ * @brief Queue data for interrupt-driven transmission.
+ *
+ * Copies as much of buf as fits into dev's TX queue and returns
+ * immediately. The queue is drained by the USART's TXE interrupt, so
+ * the caller doesn't have to wait for the data to go out on the wire.
+ *
+ * If nothing is pending and the transmit data register is empty, the
+ * first byte is written to the USART directly.
+ *
+ * @param dev Serial port to transmit over
+ * @param buf Buffer to transmit
+ * @param len Maximum number of bytes to queue
+ * @return Number of bytes queued; less than len if the queue filled up.
+ * @see usart_tx_wait()
+ * @see usart_tx_flush()
+ * @see usart_tx_pending()
+ */
+uint32 usart_tx_queue(usart_dev *dev, const uint8 *buf, uint32 len) {
+    usart_reg_map *regs = dev->regs;
+    uint32 queued = 0;
+    uint32 space;
+
+    if (!len) {
+        return 0;
+    }
+
+    /* Nothing ahead of us: skip the queue for the first byte. Only
+     * we add to the queue, so it can't become nonempty under us. */
+    if (spsc_is_empty(dev->txq) && (regs->SR & USART_SR_TXE)) {
+        regs->DR = buf[queued++];
+    }
+
+    /* Only queue what fits, so it doesn't count as dropped. The
+     * queue orders the bytes before the index which publishes them
+     * to the TXE interrupt. */
+    space = spsc_space(dev->txq);
+    if (len - queued < space) {
+        space = len - queued;
+    }
+    queued += spsc_write_n(dev->txq, buf + queued, space);
+
+    if (!spsc_is_empty(dev->txq)) {
+        bb_peri_set_bit(&regs->CR1, USART_CR1_TXEIE_BIT, 1);
+    }
+    return queued;
+}
+
+/* Might the TXE interrupt be unable to drain the TX queue while we
+ * wait for it? It can't run with interrupts disabled, or while a
+ * handler at or above its priority is running. */
+static __always_inline int tx_irq_blocked(void) {
+    return nvic_globalirq_disabled() || nvic_in_handler();
+}
+
+/* Do the TXE interrupt's job by polling: hand the next queued byte to
+ * the USART, if it's ready for one. The interrupt can still preempt
+ * lower-priority handlers, so keep it out while we take the byte. */
+static void tx_poll(usart_dev *dev) {
+    usart_reg_map *regs = dev->regs;
+    uint32 primask = nvic_globalirq_save();
+    uint8 byte;
+
+    if ((regs->SR & USART_SR_TXE) && spsc_pop(dev->txq, &byte)) {
+        regs->DR = byte;
+    }
+    nvic_globalirq_restore(primask);
+}
+
+/**
+ * @brief Wait for room in a serial port's TX queue.
+ *
+ * Returns once usart_tx_queue() can accept at least one more byte.
+ * Room is normally made by the USART's TXE interrupt. If that can't
+ * run, because interrupts are disabled or this is called from an
+ * interrupt handler, queued bytes are sent by polling instead.
+ *
+ * @param dev Serial port to wait for.
+ * @see usart_tx_queue()
+ */
+void usart_tx_wait(usart_dev *dev) {
+    while (spsc_is_full(dev->txq)) {
+        if (tx_irq_blocked()) {
+            tx_poll(dev);
+        }
+    }
+}
+
+/**
+ * @brief Wait until all queued data have been transmitted.
+ *
+ * Blocks until dev's TX queue is empty and the USART reports that the
+ * last frame has completely left the shift register (TC). Like
+ * usart_tx_wait(), this polls if the TXE interrupt can't run.
+ *
+ * @param dev Serial port to flush.
+ * @see usart_tx_queue()
+ */
+void usart_tx_flush(usart_dev *dev) {
+    usart_reg_map *regs = dev->regs;
+
+    if (!(regs->CR1 & USART_CR1_UE)) {
+        return;
+    }
+    while (usart_tx_pending(dev)) {
+        if (tx_irq_blocked()) {
+            tx_poll(dev);
+        }
+    }
+    while (!(regs->SR & USART_SR_TC))
+        ;
+}
+
 /**
  * @brief Nonblocking USART receive.
  * @param dev Serial port to receive bytes from
@@ -105,12 +241,115 @@ uint32 usart_tx(usart_dev *dev, const uint8 *buf, uint32 len) {
  * @return Number of bytes received
  */
 uint32 usart_rx(usart_dev *dev, uint8 *buf, uint32 len) {
-    uint32 rxed = 0;
-    while (usart_data_available(dev) && rxed < len) {
-        *buf++ = usart_getc(dev);
-        rxed++;
+    return spsc_read_n(dev->rxq, buf, len);
+}
+
+/**
+ * @brief Serve a serial port's receiver with DMA.
+ *
+ * Instead of taking an interrupt for every received byte, the DMA
+ * controller stores incoming data directly into the port's RX queue,
+ * which it treats as a circular buffer. The queue is brought up to
+ * date on DMA half-transfer and transfer-complete
+ * interrupts, and on the USART's IDLE line interrupt, so
+ * usart_data_available(), usart_getc(), etc. keep working as usual,
+ * with a few interrupts per burst of data instead of one per byte.
+ *
+ * Any data already in the RX buffer is discarded.
+ *
+ * Since the DMA controller can't be told to stop when the buffer
+ * fills up, if more than USART_RX_QUEUE_SIZE bytes arrive before they
+ * are read, older data are overwritten, and the number of bytes
+ * available is unreliable until the reader catches up.
+ *
+ * The serial port should already be enabled.
+ *
+ * @param dev Serial port whose receiver should use DMA.
+ * @return 0 on success, -1 if dev's receiver can't be served by DMA
+ *         or its DMA tubes are all claimed by other drivers, or a
+ *         negative dma_tube_cfg() error code.
+ * @see usart_rx_dma_disable()
+ * @see usart_rx_dma_sync()
+ */
+int usart_rx_dma_enable(usart_dev *dev) {
+    usart_reg_map *regs = dev->regs;
+    dma_tube_config cfg;
+    dma_dev *dma;
+    dma_tube tube;
+    dma_request_src req_src;
+    voidFuncPtr handler;
+    int ret;
+
+    if (!_usart_rx_dma_route(dev, &dma, &tube, &req_src, &handler)) {
+        return -1;
+    }
+
+    cfg.tube_src = &regs->DR;
+    cfg.tube_src_size = DMA_SIZE_8BITS;
+    cfg.tube_dst = dev->rx_buf;
+    cfg.tube_dst_size = DMA_SIZE_8BITS;
+    cfg.tube_nr_xfers = USART_RX_QUEUE_SIZE;
+    cfg.tube_flags = (DMA_CFG_DST_INC | DMA_CFG_CIRC |
+                      DMA_CFG_CMPLT_IE | DMA_CFG_HALF_CMPLT_IE);
+    cfg.target_data = NULL;
+    cfg.tube_req_src = req_src;
+
+    /* Prefer the usual tube, but take any which can serve us. */
+    if (dma_claim_req_src(req_src, dev, &dma, &tube) < 0) {
+        return -1;
+    }
+
+    /* Stop taking RXNE interrupts before handing the buffer over. */
+    regs->CR1 &= ~USART_CR1_RXNEIE;
+
+    dma_init(dma);
+    ret = dma_tube_cfg(dma, tube, &cfg);
+    if (ret != DMA_TUBE_CFG_SUCCESS) {
+        dma_tube_release(dma, tube, dev);
+        regs->CR1 |= USART_CR1_RXNEIE;
+        return ret;
+    }
+    dma_set_priority(dma, tube, DMA_PRIORITY_HIGH);
+    /* The DMA controller can't be stopped from overwriting old data. */
+    spsc_init(dev->rxq, dev->rx_buf, 1, USART_RX_QUEUE_SIZE,
+              SPSC_OVERWRITE_OLDEST);
+    dev->rx_dma_tube = tube;
+    dev->rx_dma_dev = dma;
+    dma_attach_interrupt(dma, tube, handler);
+    dma_enable(dma, tube);
+
+    regs->CR3 |= USART_CR3_DMAR;
+    regs->CR1 |= USART_CR1_IDLEIE;
+    return 0;
+}
+
+/**
+ * @brief Stop serving a serial port's receiver with DMA.
+ *
+ * Receiving goes back to one interrupt per byte. Any data already in
+ * the RX buffer is discarded.
+ *
+ * @param dev Serial port whose receiver should stop using DMA.
+ * @see usart_rx_dma_enable()
+ */
+void usart_rx_dma_disable(usart_dev *dev) {
+    usart_reg_map *regs = dev->regs;
+    dma_dev *dma = dev->rx_dma_dev;
+
+    if (!dma) {
+        return;
+    }
+
+    regs->CR1 &= ~USART_CR1_IDLEIE;
+    regs->CR3 &= ~USART_CR3_DMAR;
+    dma_disable(dma, dev->rx_dma_tube);
+    dma_detach_interrupt(dma, dev->rx_dma_tube);
+    dma_tube_release(dma, dev->rx_dma_tube, dev);
+    dev->rx_dma_dev = NULL;
+    spsc_init(dev->rxq, dev->rx_buf, 1, USART_RX_QUEUE_SIZE, USART_RX_POLICY);
+    if (regs->CR1 & USART_CR1_UE) {
+        regs->CR1 |= USART_CR1_RXNEIE;
     }
-    return rxed;
 }
 
 /**
@@ -34,19 +34,73 @@
 #ifndef _LIBMAPLE_USART_PRIVATE_H_
 #define _LIBMAPLE_USART_PRIVATE_H_
 
-#include <libmaple/ring_buffer.h>
+#include <libmaple/spsc_queue.h>
 #include <libmaple/usart.h>
+#include <libmaple/bitband.h>
 
-static __always_inline void usart_irq(ring_buffer *rb, usart_reg_map *regs) {
+static __always_inline void usart_tx_irq(usart_dev *dev,
+                                         usart_reg_map *regs) {
+    uint8 byte;
+    /* Feed the next queued byte, or stop asking for more once the
+     * queue has drained. */
+    if ((regs->CR1 & USART_CR1_TXEIE) && (regs->SR & USART_SR_TXE)) {
+        if (spsc_pop(dev->txq, &byte)) {
+            regs->DR = byte;
+            return;
+        }
+        bb_peri_set_bit(&regs->CR1, USART_CR1_TXEIE_BIT, 0);
+        /* usart_tx_queue() may have queued a byte and set TXEIE
+         * again just before we cleared it. */
+        if (!spsc_is_empty(dev->txq)) {
+            bb_peri_set_bit(&regs->CR1, USART_CR1_TXEIE_BIT, 1);
+        }
+    }
+}
+
+static __always_inline void usart_irq(usart_dev *dev) {
+    usart_reg_map *regs = dev->regs;
+    uint8 byte;
+
+    usart_tx_irq(dev, regs);
+
+    if (dev->rx_dma_dev) {
+        /* RX is served by DMA; we only get here on an IDLE line.
+         * Reading SR then DR clears the IDLE flag. */
+        if (regs->SR & USART_SR_IDLE) {
+            (void)regs->DR;
+            usart_rx_dma_sync(dev);
+        }
+        return;
+    }
+
+    /* We may be here for TXE only, so check before reading DR. */
+    if (!(regs->SR & USART_SR_RXNE)) {
+        return;
+    }
+    /* What happens when the queue is full depends on its policy; see
+     * USART_RX_POLICY. */
+    byte = (uint8)regs->DR;
+    spsc_push(dev->rxq, &byte);
+}
+
+/* If the RX queue is full and the user defines USART_SAFE_INSERT,
+ * new bytes are ignored. By default, they replace the oldest ones. */
 #ifdef USART_SAFE_INSERT
-    /* If the buffer is full and the user defines USART_SAFE_INSERT,
-     * ignore new bytes. */
-    rb_safe_insert(rb, (uint8)regs->DR);
+#define USART_RX_POLICY SPSC_DROP_NEWEST
 #else
-    /* By default, push bytes around in the ring buffer. */
-    rb_push_insert(rb, (uint8)regs->DR);
+#define USART_RX_POLICY SPSC_OVERWRITE_OLDEST
 #endif
-}
+
+/*
+ * RX DMA support
+ */
+
+/* Series-specific. Fills in the DMA controller, tube, and request
+ * source which can serve dev's receiver, as well as a handler which
+ * calls usart_rx_dma_sync(dev). Returns 0 if dev's receiver can't use
+ * DMA. */
+int _usart_rx_dma_route(usart_dev *dev, dma_dev **dma, dma_tube *tube,
+                        dma_request_src *req_src, voidFuncPtr *handler);
 
 uint32 _usart_clock_freq(usart_dev *dev);
 
@@ -20,6 +20,8 @@ ifeq ($(MCU_F1_LINE), performance)
 cSRCS_$(d) += $(MCU_SERIES)/usb.c
 cSRCS_$(d) += $(MCU_SERIES)/usb_reg_map.c
 cSRCS_$(d) += $(MCU_SERIES)/usb_cdcacm.c
+cSRCS_$(d) += $(MCU_SERIES)/usb_dblbuf.c
+cSRCS_$(d) += $(MCU_SERIES)/usb_vendor.c
 cSRCS_$(d) += usb_lib/usb_core.c
 cSRCS_$(d) += usb_lib/usb_init.c
 cSRCS_$(d) += usb_lib/usb_mem.c
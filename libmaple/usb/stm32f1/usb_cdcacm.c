@@ -34,14 +34,19 @@
  */
 
 #include <libmaple/usb_cdcacm.h>
+#include <libmaple/usb_vendor.h>
 
 #include <libmaple/usb.h>
 #include <libmaple/nvic.h>
 #include <libmaple/delay.h>
+#include <libmaple/ring_buffer.h>
+#include <libmaple/spsc_queue.h>
 
 /* Private headers */
 #include "usb_lib_globals.h"
 #include "usb_reg_map.h"
+#include "usb_dblbuf.h"
+#include "usb_vendor_private.h"
 
 /* usb_lib headers */
 #include "usb_type.h"
@@ -83,25 +88,75 @@ static void usbSetDeviceAddress(void);
 
 /*
  * Endpoint configuration
+ *
+ * Addresses are offsets into the 512 bytes of packet memory (PMA),
+ * after the BTABLE at 0.
  */
 
 #define USB_CDCACM_CTRL_ENDP            0
+#define USB_CDCACM_TX_ENDP              1
+#define USB_CDCACM_MANAGEMENT_ENDP      2
+#define USB_CDCACM_RX_ENDP              3
+
+/* The TX endpoint is double-buffered, so one packet can be filled
+ * while the other is on the wire, except in a composite device. */
+
+#if !USB_VENDOR_BULK
+
 #define USB_CDCACM_CTRL_RX_ADDR         0x40
 #define USB_CDCACM_CTRL_TX_ADDR         0x80
 #define USB_CDCACM_CTRL_EPSIZE          0x40
 
-#define USB_CDCACM_TX_ENDP              1
-#define USB_CDCACM_TX_ADDR              0xC0
+#define USB_CDCACM_TX_ADDR0             0xC0
+#define USB_CDCACM_TX_ADDR1             0x150
 #define USB_CDCACM_TX_EPSIZE            0x40
 
-#define USB_CDCACM_MANAGEMENT_ENDP      2
 #define USB_CDCACM_MANAGEMENT_ADDR      0x100
 #define USB_CDCACM_MANAGEMENT_EPSIZE    0x40
 
-#define USB_CDCACM_RX_ENDP              3
 #define USB_CDCACM_RX_ADDR              0x110
 #define USB_CDCACM_RX_EPSIZE            0x40
 
+#else
+
+/* Composite device. Everything has to fit in the 512 bytes:
+ *
+ *     BTABLE, endpoints 0-5        0x000   48
+ *     management TX                0x030   16
+ *     control RX, TX               0x040  128
+ *     CDC TX                       0x0C0   64
+ *     CDC RX                       0x100   64
+ *     vendor TX, double-buffered   0x140  128
+ *     vendor RX                    0x1C0   64
+ *
+ * Every data endpoint keeps 64-byte packets. The vendor interface is
+ * there for bulk transfers from the device, so it gets the double
+ * buffer, and CDC TX makes do with one. The management endpoint
+ * never sends anything. */
+
+#define USB_CDCACM_MANAGEMENT_ADDR      0x30
+#define USB_CDCACM_MANAGEMENT_EPSIZE    0x10
+
+#define USB_CDCACM_CTRL_RX_ADDR         0x40
+#define USB_CDCACM_CTRL_TX_ADDR         0x80
+#define USB_CDCACM_CTRL_EPSIZE          0x40
+
+#define USB_CDCACM_TX_ADDR              0xC0
+#define USB_CDCACM_TX_EPSIZE            0x40
+
+#define USB_CDCACM_RX_ADDR              0x100
+#define USB_CDCACM_RX_EPSIZE            0x40
+
+#define USB_VENDOR_TX_ADDR0             0x140
+#define USB_VENDOR_TX_ADDR1             0x180
+#define USB_VENDOR_RX_ADDR              0x1C0
+
+#if USB_VENDOR_PACKET_SIZE != 0x40
+#error "The composite PMA layout assumes 64-byte vendor packets"
+#endif
+
+#endif
+
 /*
  * Descriptors
  */
@@ -109,11 +164,41 @@ static void usbSetDeviceAddress(void);
 /* FIXME move to Wirish */
 #define LEAFLABS_ID_VENDOR                0x1EAF
 #define MAPLE_ID_PRODUCT                  0x0004
+#if !USB_VENDOR_BULK
 static const usb_descriptor_device usbVcomDescriptor_Device =
     USB_CDCACM_DECLARE_DEV_DESC(LEAFLABS_ID_VENDOR, MAPLE_ID_PRODUCT);
+#else
+/* A composite device's class comes from its interface association
+ * descriptors. */
+static const usb_descriptor_device usbVcomDescriptor_Device = {
+    .bLength            = sizeof(usb_descriptor_device),
+    .bDescriptorType    = USB_DESCRIPTOR_TYPE_DEVICE,
+    .bcdUSB             = 0x0200,
+    .bDeviceClass       = 0xEF, /* Miscellaneous */
+    .bDeviceSubClass    = 0x02, /* Common Class */
+    .bDeviceProtocol    = 0x01, /* Interface Association Descriptor */
+    .bMaxPacketSize0    = USB_CDCACM_CTRL_EPSIZE,
+    .idVendor           = LEAFLABS_ID_VENDOR,
+    .idProduct          = MAPLE_ID_PRODUCT,
+    .bcdDevice          = 0x0200,
+    .iManufacturer      = 0x01,
+    .iProduct           = 0x02,
+    .iSerialNumber      = 0x00,
+    .bNumConfigurations = 0x01,
+};
+#endif
+
+#if !USB_VENDOR_BULK
+#define USB_N_INTERFACES 2
+#else
+#define USB_N_INTERFACES 3
+#endif
 
 typedef struct {
     usb_descriptor_config_header Config_Header;
+#if USB_VENDOR_BULK
+    usb_descriptor_iad           CDC_IAD;
+#endif
     usb_descriptor_interface     CCI_Interface;
     CDC_FUNCTIONAL_DESCRIPTOR(2) CDC_Functional_IntHeader;
     CDC_FUNCTIONAL_DESCRIPTOR(2) CDC_Functional_CallManagement;
@@ -123,6 +208,11 @@ typedef struct {
     usb_descriptor_interface     DCI_Interface;
     usb_descriptor_endpoint      DataOutEndpoint;
     usb_descriptor_endpoint      DataInEndpoint;
+#if USB_VENDOR_BULK
+    usb_descriptor_interface     Vendor_Interface;
+    usb_descriptor_endpoint      VendorOutEndpoint;
+    usb_descriptor_endpoint      VendorInEndpoint;
+#endif
 } __packed usb_descriptor_config;
 
 #define MAX_POWER (100 >> 1)
@@ -131,7 +221,7 @@ static const usb_descriptor_config usbVcomDescriptor_Config = {
         .bLength              = sizeof(usb_descriptor_config_header),
         .bDescriptorType      = USB_DESCRIPTOR_TYPE_CONFIGURATION,
         .wTotalLength         = sizeof(usb_descriptor_config),
-        .bNumInterfaces       = 0x02,
+        .bNumInterfaces       = USB_N_INTERFACES,
         .bConfigurationValue  = 0x01,
         .iConfiguration       = 0x00,
         .bmAttributes         = (USB_CONFIG_ATTR_BUSPOWERED |
@@ -139,6 +229,19 @@ static const usb_descriptor_config usbVcomDescriptor_Config = {
         .bMaxPower            = MAX_POWER,
     },
 
+#if USB_VENDOR_BULK
+    .CDC_IAD = {
+        .bLength           = sizeof(usb_descriptor_iad),
+        .bDescriptorType   = USB_DESCRIPTOR_TYPE_IAD,
+        .bFirstInterface   = 0x00,
+        .bInterfaceCount   = 0x02,
+        .bFunctionClass    = USB_INTERFACE_CLASS_CDC,
+        .bFunctionSubClass = USB_INTERFACE_SUBCLASS_CDC_ACM,
+        .bFunctionProtocol = 0x01,
+        .iFunction         = 0x00,
+    },
+#endif
+
     .CCI_Interface = {
         .bLength            = sizeof(usb_descriptor_interface),
         .bDescriptorType    = USB_DESCRIPTOR_TYPE_INTERFACE,
@@ -219,6 +322,39 @@ static const usb_descriptor_config usbVcomDescriptor_Config = {
         .wMaxPacketSize   = USB_CDCACM_TX_EPSIZE,
         .bInterval        = 0x00,
     },
+
+#if USB_VENDOR_BULK
+    .Vendor_Interface = {
+        .bLength            = sizeof(usb_descriptor_interface),
+        .bDescriptorType    = USB_DESCRIPTOR_TYPE_INTERFACE,
+        .bInterfaceNumber   = 0x02,
+        .bAlternateSetting  = 0x00,
+        .bNumEndpoints      = 0x02,
+        .bInterfaceClass    = USB_VENDOR_INTERFACE_CLASS,
+        .bInterfaceSubClass = 0x00,
+        .bInterfaceProtocol = 0x00,
+        .iInterface         = 0x00,
+    },
+
+    .VendorOutEndpoint = {
+        .bLength          = sizeof(usb_descriptor_endpoint),
+        .bDescriptorType  = USB_DESCRIPTOR_TYPE_ENDPOINT,
+        .bEndpointAddress = (USB_DESCRIPTOR_ENDPOINT_OUT |
+                             USB_VENDOR_RX_ENDP),
+        .bmAttributes     = USB_EP_TYPE_BULK,
+        .wMaxPacketSize   = USB_VENDOR_PACKET_SIZE,
+        .bInterval        = 0x00,
+    },
+
+    .VendorInEndpoint = {
+        .bLength          = sizeof(usb_descriptor_endpoint),
+        .bDescriptorType  = USB_DESCRIPTOR_TYPE_ENDPOINT,
+        .bEndpointAddress = (USB_DESCRIPTOR_ENDPOINT_IN | USB_VENDOR_TX_ENDP),
+        .bmAttributes     = USB_EP_TYPE_BULK,
+        .wMaxPacketSize   = USB_VENDOR_PACKET_SIZE,
+        .bInterval        = 0x00,
+    },
+#endif
 };
 
 /*
@@ -282,14 +418,19 @@ static ONE_DESCRIPTOR String_Descriptor[N_STRING_DESCRIPTORS] = {
 
 /* I/O state */
 
-/* Received data */
-static volatile uint8 vcomBufferRx[USB_CDCACM_RX_EPSIZE];
-/* Read index into vcomBufferRx */
-static volatile uint32 rx_offset = 0;
-/* Number of bytes left to transmit */
-static volatile uint32 n_unsent_bytes = 0;
-/* Number of unread bytes */
-static volatile uint32 n_unread_bytes = 0;
+/* Received data, not yet read. The USB interrupt fills it, and
+ * usb_cdcacm_rx() empties it without masking the interrupt. */
+static uint8 vcomBufferRx[USB_CDCACM_RX_BUF_SIZE];
+static spsc_queue rx_q;
+/* Set when the RX endpoint was left NAKing for lack of room */
+static volatile uint8 rx_paused = 0;
+/* Data waiting to be copied into a TX packet buffer */
+static uint8 vcomBufferTx[USB_CDCACM_TX_BUF_SIZE];
+static ring_buffer tx_rb;
+/* TX endpoint packet buffers */
+static usb_dbl_in tx_ep;
+/* Set after a full-sized packet, until one which isn't */
+static volatile uint8 tx_need_zlp = 0;
 
 /* Other state (line coding, DTR/RTS) */
 
@@ -312,7 +453,11 @@ static void (*ep_int_in[7])(void) =
     {vcomDataTxCb,
      NOP_Process,
      NOP_Process,
+#if USB_VENDOR_BULK
+     usb_vendor_tx_cb,
+#else
      NOP_Process,
+#endif
      NOP_Process,
      NOP_Process,
      NOP_Process};
@@ -322,7 +467,11 @@ static void (*ep_int_out[7])(void) =
      NOP_Process,
      vcomDataRxCb,
      NOP_Process,
+#if USB_VENDOR_BULK
+     usb_vendor_rx_cb,
+#else
      NOP_Process,
+#endif
      NOP_Process,
      NOP_Process};
 
@@ -330,13 +479,17 @@ static void (*ep_int_out[7])(void) =
  * Globals required by usb_lib/
  */
 
+#if !USB_VENDOR_BULK
 #define NUM_ENDPTS                0x04
+#else
+#define NUM_ENDPTS                0x06
+#endif
 DEVICE Device_Table = {
     .Total_Endpoint      = NUM_ENDPTS,
     .Total_Configuration = 1
 };
 
-#define MAX_PACKET_SIZE            0x40  /* 64B, maximum for USB FS Devices */
+#define MAX_PACKET_SIZE            USB_CDCACM_CTRL_EPSIZE
 DEVICE_PROP Device_Property = {
     .Init                        = usbInit,
     .Reset                       = usbReset,
@@ -370,6 +523,7 @@ USER_STANDARD_REQUESTS User_Standard_Requests = {
 
 static void (*rx_hook)(unsigned, void*) = 0;
 static void (*iface_setup_hook)(unsigned, void*) = 0;
+static void (*tx_hook)(unsigned, void*) = 0;
 
 void usb_cdcacm_set_hooks(unsigned hook_flags, void (*hook)(unsigned, void*)) {
     if (hook_flags & USB_CDCACM_HOOK_RX) {
@@ -378,6 +532,9 @@ void usb_cdcacm_set_hooks(unsigned hook_flags, void (*hook)(unsigned, void*)) {
     if (hook_flags & USB_CDCACM_HOOK_IFACE_SETUP) {
         iface_setup_hook = hook;
     }
+    if (hook_flags & USB_CDCACM_HOOK_TX) {
+        tx_hook = hook;
+    }
 }
 
 /*
@@ -407,58 +564,89 @@ void usb_cdcacm_putc(char ch) {
         ;
 }
 
-/* This function is non-blocking.
+/* Moves queued data into free packet buffers, and hands them to the
+ * peripheral, one at a time (see usb_dbl_in_load()). Must run with
+ * the USB interrupt masked, or from it.
  *
- * It copies data from a usercode buffer into the USB peripheral TX
- * buffer, and returns the number of bytes copied. */
-uint32 usb_cdcacm_tx(const uint8* buf, uint32 len) {
-    /* Last transmission hasn't finished, so abort. */
-    if (n_unsent_bytes) {
-        return 0;
+ * A full-sized packet doesn't end a transfer, so if the queue runs
+ * dry right after one, this sends a zero-length packet. Otherwise
+ * the host would sit on the data until we sent more. */
+static void vcomFillTx(void) {
+    uint8 packet[USB_CDCACM_TX_EPSIZE];
+
+    while (usb_dbl_in_can_load(&tx_ep)) {
+        uint16 len = rb_read_n(&tx_rb, packet, USB_CDCACM_TX_EPSIZE);
+        if (len == 0 && !tx_need_zlp) {
+            break;
+        }
+        usb_dbl_in_load(&tx_ep, packet, len);
+        tx_need_zlp = (len == USB_CDCACM_TX_EPSIZE);
     }
+}
 
-    /* We can only put USB_CDCACM_TX_EPSIZE bytes in the buffer. */
-    if (len > USB_CDCACM_TX_EPSIZE) {
-        len = USB_CDCACM_TX_EPSIZE;
-    }
+/* This function is non-blocking.
+ *
+ * It copies data from a usercode buffer into the TX queue, and
+ * returns the number of bytes copied. The queue is drained into the
+ * endpoint's packet buffers as the host reads them. */
+uint32 usb_cdcacm_tx(const uint8* buf, uint32 len) {
+    uint32 irq = usb_dbl_mask_irq();
 
-    /* Queue bytes for sending. */
-    if (len) {
-        usb_copy_to_pma(buf, len, USB_CDCACM_TX_ADDR);
-        usb_set_ep_tx_count(USB_CDCACM_TX_ENDP, len);
-        n_unsent_bytes = len;
-        usb_set_ep_tx_stat(USB_CDCACM_TX_ENDP, USB_EP_STAT_TX_VALID);
+    if (len > USB_CDCACM_TX_BUF_SIZE) {
+        len = USB_CDCACM_TX_BUF_SIZE;
     }
+    len = rb_write_n(&tx_rb, buf, len);
+    vcomFillTx();
 
+    usb_dbl_unmask_irq(irq);
     return len;
 }
 
 uint32 usb_cdcacm_data_available(void) {
-    return n_unread_bytes;
+    return spsc_count(&rx_q);
 }
 
 uint16 usb_cdcacm_get_pending() {
-    return n_unsent_bytes;
+    uint32 irq = usb_dbl_mask_irq();
+    uint16 pending;
+    pending = usb_dbl_in_pending(&tx_ep) + rb_masked_count(&tx_rb);
+    usb_dbl_unmask_irq(irq);
+    return pending;
 }
 
-/* Nonblocking byte receive.
- *
- * Copies up to len bytes from our private data buffer (*NOT* the PMA)
- * into buf and deq's the FIFO. */
-uint32 usb_cdcacm_rx(uint8* buf, uint32 len) {
-    /* Copy bytes to buffer. */
-    uint32 n_copied = usb_cdcacm_peek(buf, len);
-
-    /* Mark bytes as read. */
-    n_unread_bytes -= n_copied;
-    rx_offset += n_copied;
+/* Returns how many bytes usb_cdcacm_tx() would take right now. */
+uint32 usb_cdcacm_tx_space(void) {
+    return rb_masked_space(&tx_rb);
+}
 
-    /* If all bytes have been read, re-enable the RX endpoint, which
-     * was set to NAK when the current batch of bytes was received. */
-    if (n_unread_bytes == 0) {
+/* Lets the host send another packet, if there's room for one. */
+static void vcomResumeRx(void) {
+    if (spsc_space(&rx_q) >= USB_CDCACM_RX_EPSIZE) {
+        rx_paused = 0;
         usb_set_ep_rx_count(USB_CDCACM_RX_ENDP, USB_CDCACM_RX_EPSIZE);
         usb_set_ep_rx_stat(USB_CDCACM_RX_ENDP, USB_EP_STAT_RX_VALID);
-        rx_offset = 0;
+    } else {
+        rx_paused = 1;
+    }
+}
+
+/* Nonblocking byte receive.
+ *
+ * Copies up to len bytes from the RX queue (*NOT* the PMA) into buf
+ * and removes them from it. */
+uint32 usb_cdcacm_rx(uint8* buf, uint32 len) {
+    uint32 n_copied = spsc_read_n(&rx_q, buf, len);
+    uint32 irq;
+
+    /* The endpoint was left NAKing if a packet might not have fit;
+     * re-enable it now that there's room. It stays NAKing until we
+     * do, so only a reset can get in the way. */
+    if (rx_paused) {
+        irq = usb_dbl_mask_irq();
+        if (rx_paused) {
+            vcomResumeRx();
+        }
+        usb_dbl_unmask_irq(irq);
     }
 
     return n_copied;
@@ -468,17 +656,7 @@ uint32 usb_cdcacm_rx(uint8* buf, uint32 len) {
  *
  * Looks at unread bytes without marking them as read. */
 uint32 usb_cdcacm_peek(uint8* buf, uint32 len) {
-    int i;
-
-    if (len > n_unread_bytes) {
-        len = n_unread_bytes;
-    }
-
-    for (i = 0; i < len; i++) {
-        buf[i] = vcomBufferRx[i + rx_offset];
-    }
-
-    return len;
+    return spsc_peek_n(&rx_q, buf, len);
 }
 
 uint8 usb_cdcacm_get_dtr() {
@@ -518,22 +696,25 @@ int usb_cdcacm_get_n_data_bits(void) {
  */
 
 static void vcomDataTxCb(void) {
-    /* The following assumes that all of the bytes we copied during
-     * the last call to usb_cdcacm_tx were sent during the IN
-     * transaction (this seems to be the case). */
-    /* TODO find out why this is broken:
-     * n_unsent_bytes = usb_get_ep_tx_count(USB_CDCACM_TX_ENDP); */
-    n_unsent_bytes = 0;
+    usb_dbl_in_complete(&tx_ep);
+    vcomFillTx();
+
+    if (tx_hook) {
+        tx_hook(USB_CDCACM_HOOK_TX, 0);
+    }
 }
 
 static void vcomDataRxCb(void) {
+    uint8 packet[USB_CDCACM_RX_EPSIZE];
+    uint16 len;
+
     usb_set_ep_rx_stat(USB_CDCACM_RX_ENDP, USB_EP_STAT_RX_NAK);
-    n_unread_bytes = usb_get_ep_rx_count(USB_CDCACM_RX_ENDP);
-    /* This copy won't overwrite unread bytes, since we've set the RX
-     * endpoint to NAK, and will only set it to VALID when all bytes
-     * have been read. */
-    usb_copy_from_pma((uint8*)vcomBufferRx, n_unread_bytes,
-                      USB_CDCACM_RX_ADDR);
+    len = usb_get_ep_rx_count(USB_CDCACM_RX_ENDP);
+    /* The endpoint only goes VALID while a whole packet fits in the
+     * queue, so this never drops anything. */
+    usb_copy_from_pma(packet, len, USB_CDCACM_RX_ADDR);
+    spsc_write_n(&rx_q, packet, len);
+    vcomResumeRx();
 
     if (rx_hook) {
         rx_hook(USB_CDCACM_HOOK_RX, 0);
@@ -601,19 +782,26 @@ static void usbReset(void) {
     usb_set_ep_rx_count(USB_CDCACM_RX_ENDP, USB_CDCACM_RX_EPSIZE);
     usb_set_ep_rx_stat(USB_CDCACM_RX_ENDP, USB_EP_STAT_RX_VALID);
 
-    /* set up data endpoint IN (TX)  */
-    usb_set_ep_type(USB_CDCACM_TX_ENDP, USB_EP_EP_TYPE_BULK);
-    usb_set_ep_tx_addr(USB_CDCACM_TX_ENDP, USB_CDCACM_TX_ADDR);
-    usb_set_ep_tx_stat(USB_CDCACM_TX_ENDP, USB_EP_STAT_TX_NAK);
-    usb_set_ep_rx_stat(USB_CDCACM_TX_ENDP, USB_EP_STAT_RX_DISABLED);
+#if !USB_VENDOR_BULK
+    /* set up data endpoint IN (TX), double-buffered */
+    usb_dbl_in_init(&tx_ep, USB_CDCACM_TX_ENDP,
+                    USB_CDCACM_TX_ADDR0, USB_CDCACM_TX_ADDR1);
+#else
+    /* set up data endpoint IN (TX); no room for a second buffer */
+    usb_dbl_in_init_single(&tx_ep, USB_CDCACM_TX_ENDP, USB_CDCACM_TX_ADDR);
+    usb_vendor_reset(USB_VENDOR_TX_ADDR0, USB_VENDOR_TX_ADDR1,
+                     USB_VENDOR_RX_ADDR);
+#endif
 
     USBLIB->state = USB_ATTACHED;
     SetDeviceAddress(0);
 
     /* Reset the RX/TX state */
-    n_unread_bytes = 0;
-    n_unsent_bytes = 0;
-    rx_offset = 0;
+    spsc_init(&rx_q, vcomBufferRx, 1, USB_CDCACM_RX_BUF_SIZE,
+              SPSC_DROP_NEWEST);
+    rx_paused = 0;
+    rb_init(&tx_rb, USB_CDCACM_TX_BUF_SIZE, vcomBufferTx);
+    tx_need_zlp = 0;
 }
 
 static RESULT usbDataSetup(uint8 request) {
@@ -678,7 +866,7 @@ static RESULT usbNoDataSetup(uint8 request) {
 static RESULT usbGetInterfaceSetting(uint8 interface, uint8 alt_setting) {
     if (alt_setting > 0) {
         return USB_UNSUPPORT;
-    } else if (interface > 1) {
+    } else if (interface >= USB_N_INTERFACES) {
         return USB_UNSUPPORT;
     }
 
@@ -0,0 +1,266 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/usb/stm32f1/usb_dblbuf.c
+ * @brief Double-buffered bulk endpoint state machines (private)
+ */
+
+#include "usb_dblbuf.h"
+#include "usb_reg_map.h"
+
+/*
+ * IN
+ */
+
+/* Is the peripheral holding a packet? It sends from the buffer
+ * DTOG_TX selects, and toggles DTOG_TX once that's gone; when that
+ * makes it select our buffer (SW_BUF), it has nothing left to send. */
+static int usb_dbl_in_held(usb_dbl_in *in) {
+    return usb_get_ep_dtog_tx(in->ep) != in->app_buf;
+}
+
+/* Hands app_buf to the peripheral, and returns nonzero, unless it's
+ * still holding the other buffer. Packets have to go one at a time:
+ * toggling SW_BUF again before the first had gone would make it
+ * equal to DTOG_TX, and the endpoint would NAK both for good. */
+static int usb_dbl_in_release(usb_dbl_in *in) {
+    if (usb_dbl_in_held(in)) {
+        return 0;
+    }
+    usb_toggle_ep_dtog_rx(in->ep);
+    in->app_buf = !in->app_buf;
+    in->filled = 0;
+    /* Once both buffers have been sent, the endpoint NAKs; it needs
+     * to be VALID again for this one to go out. */
+    usb_set_ep_tx_stat(in->ep, USB_EP_STAT_TX_VALID);
+    return 1;
+}
+
+/* Sets up ep as a double-buffered bulk IN endpoint. With DTOG_TX and
+ * SW_BUF both clear, neither buffer holds a packet. */
+void usb_dbl_in_init(usb_dbl_in *in, uint8 ep, uint16 addr0, uint16 addr1) {
+    in->ep = ep;
+    in->addr[0] = addr0;
+    in->addr[1] = addr1;
+    in->app_buf = 0;
+    in->filled = 0;
+    in->len[0] = 0;
+    in->len[1] = 0;
+    in->single = 0;
+
+    usb_set_ep_type(ep, USB_EP_EP_TYPE_BULK);
+    usb_set_ep_kind(ep, USB_EP_EP_KIND);
+    usb_set_ep_tx_buf0_addr(ep, addr0);
+    usb_set_ep_tx_buf1_addr(ep, addr1);
+    usb_set_ep_tx_buf0_count(ep, 0);
+    usb_set_ep_tx_buf1_count(ep, 0);
+    usb_clear_ep_dtogs(ep);
+    usb_set_ep_tx_stat(ep, USB_EP_STAT_TX_NAK);
+    usb_set_ep_rx_stat(ep, USB_EP_STAT_RX_DISABLED);
+}
+
+/* Sets up ep as a plain bulk IN endpoint, with one buffer. A packet
+ * keeps it filled until its CTR_TX callback, so the next one can only
+ * be loaded after that. */
+void usb_dbl_in_init_single(usb_dbl_in *in, uint8 ep, uint16 addr) {
+    in->ep = ep;
+    in->addr[0] = addr;
+    in->addr[1] = addr;
+    in->app_buf = 0;
+    in->filled = 0;
+    in->len[0] = 0;
+    in->len[1] = 0;
+    in->single = 1;
+
+    usb_set_ep_type(ep, USB_EP_EP_TYPE_BULK);
+    usb_set_ep_kind(ep, 0);
+    usb_set_ep_tx_addr(ep, addr);
+    usb_set_ep_tx_count(ep, 0);
+    usb_clear_ep_dtogs(ep);
+    usb_set_ep_tx_stat(ep, USB_EP_STAT_TX_NAK);
+    usb_set_ep_rx_stat(ep, USB_EP_STAT_RX_DISABLED);
+}
+
+/* Copies a packet into our buffer, and sends it as soon as the
+ * peripheral is free: right away if the packet before it has gone,
+ * even if its CTR_TX callback hasn't run yet. Only call this when
+ * usb_dbl_in_can_load(). A zero len sends a zero-length packet. */
+void usb_dbl_in_load(usb_dbl_in *in, const uint8 *buf, uint16 len) {
+    uint8 b = in->app_buf;
+
+    if (in->single) {
+        usb_copy_to_pma(buf, len, in->addr[0]);
+        usb_set_ep_tx_count(in->ep, len);
+        in->len[0] = len;
+        in->filled = 1;
+        usb_set_ep_tx_stat(in->ep, USB_EP_STAT_TX_VALID);
+        return;
+    }
+
+    usb_copy_to_pma(buf, len, in->addr[b]);
+    if (b) {
+        usb_set_ep_tx_buf1_count(in->ep, len);
+    } else {
+        usb_set_ep_tx_buf0_count(in->ep, len);
+    }
+    in->len[b] = len;
+    in->filled = 1;
+    usb_dbl_in_release(in);
+}
+
+/* Call from the endpoint's CTR_TX callback. One callback may cover
+ * two packets, if the second was handed over and sent before it ran;
+ * since that's read off DTOG_TX, nothing needs counting here. */
+void usb_dbl_in_complete(usb_dbl_in *in) {
+    if (in->single) {
+        in->filled = 0;
+        return;
+    }
+    if (in->filled) {
+        usb_dbl_in_release(in);
+    }
+}
+
+/* Returns the number of bytes loaded, but not yet sent. */
+uint32 usb_dbl_in_pending(usb_dbl_in *in) {
+    uint32 pending = 0;
+    if (in->single) {
+        return in->filled ? in->len[0] : 0;
+    }
+    if (in->filled) {
+        pending += in->len[in->app_buf];
+    }
+    if (usb_dbl_in_held(in)) {
+        pending += in->len[!in->app_buf];
+    }
+    return pending;
+}
+
+/*
+ * OUT
+ */
+
+/* Takes the buffer the peripheral just filled, and gives it the one
+ * we were holding. */
+static void usb_dbl_out_take(usb_dbl_out *out) {
+    usb_toggle_ep_dtog_tx(out->ep);
+    out->app_buf = !out->app_buf;
+    out->full = 1;
+    usb_set_ep_rx_stat(out->ep, USB_EP_STAT_RX_VALID);
+}
+
+/* Sets up ep as a double-buffered bulk OUT endpoint, taking packets
+ * of up to size bytes. The peripheral starts out with buffer 0, and
+ * we hold (empty) buffer 1. */
+void usb_dbl_out_init(usb_dbl_out *out, uint8 ep, uint16 addr0, uint16 addr1,
+                      uint16 size) {
+    out->ep = ep;
+    out->addr[0] = addr0;
+    out->addr[1] = addr1;
+    out->app_buf = 1;
+    out->full = 0;
+    out->waiting = 0;
+    out->single = 0;
+
+    usb_set_ep_type(ep, USB_EP_EP_TYPE_BULK);
+    usb_set_ep_kind(ep, USB_EP_EP_KIND);
+    usb_set_ep_rx_buf0_addr(ep, addr0);
+    usb_set_ep_rx_buf1_addr(ep, addr1);
+    usb_set_ep_rx_buf0_count(ep, size);
+    usb_set_ep_rx_buf1_count(ep, size);
+    usb_clear_ep_dtogs(ep);
+    usb_toggle_ep_dtog_tx(ep);
+    usb_set_ep_rx_stat(ep, USB_EP_STAT_RX_VALID);
+    usb_set_ep_tx_stat(ep, USB_EP_STAT_TX_DISABLED);
+}
+
+/* Sets up ep as a plain bulk OUT endpoint, with one buffer, taking
+ * packets of up to size bytes. The peripheral NAKs from the moment a
+ * packet lands until we've read it. */
+void usb_dbl_out_init_single(usb_dbl_out *out, uint8 ep, uint16 addr,
+                             uint16 size) {
+    out->ep = ep;
+    out->addr[0] = addr;
+    out->addr[1] = addr;
+    out->app_buf = 0;
+    out->full = 0;
+    out->waiting = 0;
+    out->single = 1;
+
+    usb_set_ep_type(ep, USB_EP_EP_TYPE_BULK);
+    usb_set_ep_kind(ep, 0);
+    usb_set_ep_rx_addr(ep, addr);
+    usb_set_ep_rx_count(ep, size);
+    usb_clear_ep_dtogs(ep);
+    usb_set_ep_rx_stat(ep, USB_EP_STAT_RX_VALID);
+    usb_set_ep_tx_stat(ep, USB_EP_STAT_TX_DISABLED);
+}
+
+/* Call from the endpoint's CTR_RX callback. */
+void usb_dbl_out_received(usb_dbl_out *out) {
+    if (out->single) {
+        /* The peripheral set STAT_RX to NAK on its own. */
+        out->full = 1;
+        return;
+    }
+    if (out->full) {
+        /* Picked up once we're done with the packet we have. */
+        out->waiting = 1;
+    } else {
+        usb_dbl_out_take(out);
+    }
+}
+
+/* Copies the packet we hold into buf, which must have room for a
+ * whole packet, and returns its length. Only call this when
+ * usb_dbl_out_available(). */
+uint16 usb_dbl_out_read(usb_dbl_out *out, uint8 *buf) {
+    uint8 b = out->app_buf;
+    uint16 len;
+
+    if (out->single) {
+        len = usb_get_ep_rx_count(out->ep);
+        usb_copy_from_pma(buf, len, out->addr[0]);
+        out->full = 0;
+        usb_set_ep_rx_stat(out->ep, USB_EP_STAT_RX_VALID);
+        return len;
+    }
+
+    if (b) {
+        len = usb_get_ep_rx_buf1_count(out->ep);
+    } else {
+        len = usb_get_ep_rx_buf0_count(out->ep);
+    }
+    usb_copy_from_pma(buf, len, out->addr[b]);
+    out->full = 0;
+
+    if (out->waiting) {
+        out->waiting = 0;
+        usb_dbl_out_take(out);
+    }
+    return len;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/usb/stm32f1/usb_dblbuf.h
+ * @brief Double-buffered bulk endpoint state machines (private)
+ *
+ * A double-buffered bulk endpoint has two packet buffers in the PMA.
+ * The peripheral works on the one selected by the endpoint's DTOG
+ * bit, and we work on the one selected by the other DTOG bit, which
+ * RM0008 calls SW_BUF. When the two select the same buffer, the
+ * endpoint NAKs. Toggling SW_BUF hands our buffer to the peripheral
+ * and takes the other one back.
+ *
+ * These keep track of who holds which buffer, so callers only have
+ * to say "here is a packet" or "I'm done with this one".
+ *
+ * Where packet memory is short, the same calls can also drive an
+ * ordinary, single-buffered endpoint; see usb_dbl_in_init_single()
+ * and usb_dbl_out_init_single(). The caller's code doesn't change,
+ * it just gets one packet in flight at a time instead of two.
+ */
+
+#ifndef _USB_DBLBUF_H_
+#define _USB_DBLBUF_H_
+
+#include <libmaple/libmaple_types.h>
+#include <libmaple/nvic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The routines below must run with the USB interrupt masked, or from
+ * it. These mask it for code that runs outside it.
+ */
+
+/* Returns nonzero if the interrupt was enabled. */
+static inline uint32 usb_dbl_mask_irq(void) {
+    nvic_irq_num irq = NVIC_USB_LP_CAN_RX0;
+    uint32 enabled = NVIC_BASE->ISER[irq / 32] & BIT(irq % 32);
+    nvic_irq_disable(irq);
+    return enabled;
+}
+
+static inline void usb_dbl_unmask_irq(uint32 enabled) {
+    if (enabled) {
+        nvic_irq_enable(NVIC_USB_LP_CAN_RX0);
+    }
+}
+
+/*
+ * IN (device to host)
+ *
+ * While the peripheral sends one packet, the next one is copied into
+ * the other buffer. The peripheral can only hold one packet at a
+ * time (SW_BUF must select a buffer it isn't sending from), so the
+ * second is handed over the moment DTOG_TX shows the first has gone:
+ * by usb_dbl_in_load() if that's already happened, and otherwise by
+ * the endpoint's CTR_TX callback. Back-to-back packets wait for at
+ * most an interrupt, never for a copy.
+ */
+
+typedef struct usb_dbl_in {
+    uint8 ep;                   /* Endpoint number */
+    uint16 addr[2];             /* PMA offsets of buffers 0 and 1 */
+    volatile uint8 app_buf;     /* Buffer we fill (SW_BUF) */
+    volatile uint8 filled;      /* app_buf holds a packet */
+    volatile uint16 len[2];     /* Length of the packet in each buffer */
+    uint8 single;               /* Only buffer 0; see below */
+} usb_dbl_in;
+
+void usb_dbl_in_init(usb_dbl_in *in, uint8 ep, uint16 addr0, uint16 addr1);
+void usb_dbl_in_init_single(usb_dbl_in *in, uint8 ep, uint16 addr);
+void usb_dbl_in_load(usb_dbl_in *in, const uint8 *buf, uint16 len);
+void usb_dbl_in_complete(usb_dbl_in *in);
+uint32 usb_dbl_in_pending(usb_dbl_in *in);
+
+/* Returns true if usb_dbl_in_load() can take another packet. */
+static inline int usb_dbl_in_can_load(usb_dbl_in *in) {
+    return !in->filled;
+}
+
+/*
+ * OUT (host to device)
+ *
+ * The peripheral can receive into one buffer while we hold a packet
+ * in the other.
+ */
+
+typedef struct usb_dbl_out {
+    uint8 ep;                   /* Endpoint number */
+    uint16 addr[2];             /* PMA offsets of buffers 0 and 1 */
+    volatile uint8 app_buf;     /* Buffer we hold (SW_BUF) */
+    volatile uint8 full;        /* app_buf holds an unread packet */
+    volatile uint8 waiting;     /* The other buffer does too */
+    uint8 single;               /* Only buffer 0; see below */
+} usb_dbl_out;
+
+void usb_dbl_out_init(usb_dbl_out *out, uint8 ep, uint16 addr0, uint16 addr1,
+                      uint16 size);
+void usb_dbl_out_init_single(usb_dbl_out *out, uint8 ep, uint16 addr,
+                             uint16 size);
+void usb_dbl_out_received(usb_dbl_out *out);
+uint16 usb_dbl_out_read(usb_dbl_out *out, uint8 *buf);
+
+/* Returns true if there's a packet for usb_dbl_out_read(). */
+static inline int usb_dbl_out_available(usb_dbl_out *out) {
+    return out->full;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -26,19 +26,57 @@
 
 #include "usb_reg_map.h"
 
-/* TODO these could use some improvement; they're fairly
- * straightforward ports of the analogous ST code.  The PMA blit
- * routines in particular are obvious targets for performance
- * measurement and tuning. */
+/* The PMA holds two bytes in the low half of every 32-bit word, so
+ * these can't just be memcpy(). They move four halfwords per loop
+ * iteration. When buf is word-aligned, each pair of halfwords is
+ * loaded or stored as a single word and split or packed in
+ * registers; otherwise, they fall back to byte accesses. */
 
 void usb_copy_to_pma(const uint8 *buf, uint16 len, uint16 pma_offset) {
     uint16 *dst = (uint16*)usb_pma_ptr(pma_offset);
     uint16 n = len >> 1;
-    uint16 i;
-    for (i = 0; i < n; i++) {
-        *dst = (uint16)(*buf) | *(buf + 1) << 8;
-        buf += 2;
-        dst += 2;
+
+    if ((uint32)buf & 1) {
+        while (n >= 4) {
+            dst[0] = buf[0] | buf[1] << 8;
+            dst[2] = buf[2] | buf[3] << 8;
+            dst[4] = buf[4] | buf[5] << 8;
+            dst[6] = buf[6] | buf[7] << 8;
+            buf += 8;
+            dst += 8;
+            n -= 4;
+        }
+        while (n--) {
+            *dst = buf[0] | buf[1] << 8;
+            buf += 2;
+            dst += 2;
+        }
+    } else {
+        const uint32 *src;
+        if (((uint32)buf & 2) && n) {
+            *dst = *(const uint16*)buf;
+            buf += 2;
+            dst += 2;
+            n--;
+        }
+        src = (const uint32*)buf;
+        while (n >= 4) {
+            uint32 w0 = src[0];
+            uint32 w1 = src[1];
+            dst[0] = w0;
+            dst[2] = w0 >> 16;
+            dst[4] = w1;
+            dst[6] = w1 >> 16;
+            src += 2;
+            dst += 8;
+            n -= 4;
+        }
+        buf = (const uint8*)src;
+        while (n--) {
+            *dst = *(const uint16*)buf;
+            buf += 2;
+            dst += 2;
+        }
     }
     if (len & 1) {
         *dst = *buf;
@@ -47,19 +85,58 @@ void usb_copy_to_pma(const uint8 *buf, uint16 len, uint16 pma_offset) {
 
 void usb_copy_from_pma(uint8 *buf, uint16 len, uint16 pma_offset) {
     uint32 *src = (uint32*)usb_pma_ptr(pma_offset);
-    uint16 *dst = (uint16*)buf;
     uint16 n = len >> 1;
-    uint16 i;
-    for (i = 0; i < n; i++) {
-        *dst++ = *src++;
+
+    if ((uint32)buf & 1) {
+        while (n >= 4) {
+            uint32 h0 = src[0], h1 = src[1], h2 = src[2], h3 = src[3];
+            buf[0] = h0;
+            buf[1] = h0 >> 8;
+            buf[2] = h1;
+            buf[3] = h1 >> 8;
+            buf[4] = h2;
+            buf[5] = h2 >> 8;
+            buf[6] = h3;
+            buf[7] = h3 >> 8;
+            buf += 8;
+            src += 4;
+            n -= 4;
+        }
+        while (n--) {
+            uint32 h = *src++;
+            buf[0] = h;
+            buf[1] = h >> 8;
+            buf += 2;
+        }
+    } else {
+        uint32 *dst;
+        if (((uint32)buf & 2) && n) {
+            *(uint16*)buf = *src++;
+            buf += 2;
+            n--;
+        }
+        dst = (uint32*)buf;
+        while (n >= 4) {
+            uint32 h0 = src[0], h1 = src[1], h2 = src[2], h3 = src[3];
+            dst[0] = (h0 & 0xFFFF) | h1 << 16;
+            dst[1] = (h2 & 0xFFFF) | h3 << 16;
+            src += 4;
+            dst += 2;
+            n -= 4;
+        }
+        buf = (uint8*)dst;
+        while (n--) {
+            *(uint16*)buf = *src++;
+            buf += 2;
+        }
     }
     if (len & 1) {
-        *dst = *src & 0xFF;
+        *buf = *src & 0xFF;
     }
 }
 
-void usb_set_ep_rx_count(uint8 ep, uint16 count) {
-    uint32 *rxc = usb_ep_rx_count_ptr(ep);
+/* Encodes a buffer size for an RX count entry. */
+static uint16 usb_rx_count_blocks(uint16 count) {
     uint16 nblocks;
     if (count > 62) {
         /* use 32-byte memory block size */
@@ -67,13 +144,23 @@ void usb_set_ep_rx_count(uint8 ep, uint16 count) {
         if ((count & 0x1F) == 0) {
             nblocks--;
         }
-        *rxc = (nblocks << 10) | 0x8000;
+        return (nblocks << 10) | 0x8000;
     } else {
         /* use 2-byte memory block size */
         nblocks = count >> 1;
         if ((count & 0x1) != 0) {
             nblocks++;
         }
-        *rxc = nblocks << 10;
+        return nblocks << 10;
     }
 }
+
+void usb_set_ep_rx_count(uint8 ep, uint16 count) {
+    uint32 *rxc = usb_ep_rx_count_ptr(ep);
+    *rxc = usb_rx_count_blocks(count);
+}
+
+void usb_set_ep_rx_buf0_count(uint8 ep, uint16 count) {
+    uint32 *rxc = usb_ep_tx_count_ptr(ep);
+    *rxc = usb_rx_count_blocks(count);
+}
@@ -239,6 +239,35 @@ static inline void usb_clear_status_out(uint8 ep) {
     usb_set_ep_kind(ep, 0);
 }
 
+/* Data toggles. On a double-buffered endpoint, DTOG_TX (for IN) or
+ * DTOG_RX (for OUT) selects the buffer the peripheral uses, and the
+ * other DTOG bit is the application's SW_BUF. */
+
+static inline uint32 usb_get_ep_dtog_tx(uint8 ep) {
+    return !!(USB_BASE->EP[ep] & USB_EP_DTOG_TX);
+}
+
+static inline uint32 usb_get_ep_dtog_rx(uint8 ep) {
+    return !!(USB_BASE->EP[ep] & USB_EP_DTOG_RX);
+}
+
+static inline void usb_toggle_ep_dtog_tx(uint8 ep) {
+    uint32 epr = USB_BASE->EP[ep];
+    USB_BASE->EP[ep] = (epr & __EP_NONTOGGLE) | __EP_CTR_NOP | USB_EP_DTOG_TX;
+}
+
+static inline void usb_toggle_ep_dtog_rx(uint8 ep) {
+    uint32 epr = USB_BASE->EP[ep];
+    USB_BASE->EP[ep] = (epr & __EP_NONTOGGLE) | __EP_CTR_NOP | USB_EP_DTOG_RX;
+}
+
+static inline void usb_clear_ep_dtogs(uint8 ep) {
+    uint32 epr = USB_BASE->EP[ep];
+    /* Writing back the set bits toggles them to zero. */
+    epr &= __EP_NONTOGGLE | USB_EP_DTOG_RX | USB_EP_DTOG_TX;
+    USB_BASE->EP[ep] = epr | __EP_CTR_NOP;
+}
+
 /*
  * Packet memory area (PMA) base pointer
  */
@@ -399,6 +428,51 @@ static inline uint16 usb_get_ep_rx_count(uint8 ep) {
 
 void usb_set_ep_rx_count(uint8 ep, uint16 count);
 
+/* Double-buffered transmission. Buffer 0 uses the TX address and
+ * count entries; buffer 1 uses the RX ones. */
+
+static inline void usb_set_ep_tx_buf0_addr(uint8 ep, uint16 addr) {
+    usb_set_ep_tx_addr(ep, addr);
+}
+
+static inline void usb_set_ep_tx_buf1_addr(uint8 ep, uint16 addr) {
+    usb_set_ep_rx_addr(ep, addr);
+}
+
+static inline void usb_set_ep_tx_buf0_count(uint8 ep, uint16 count) {
+    usb_set_ep_tx_count(ep, count);
+}
+
+static inline void usb_set_ep_tx_buf1_count(uint8 ep, uint16 count) {
+    uint32 *txc = usb_ep_rx_count_ptr(ep);
+    *txc = count;
+}
+
+/* Double-buffered reception. Buffer 0 uses the TX address and count
+ * entries; buffer 1 uses the RX ones. */
+
+static inline void usb_set_ep_rx_buf0_addr(uint8 ep, uint16 addr) {
+    usb_set_ep_tx_addr(ep, addr);
+}
+
+static inline void usb_set_ep_rx_buf1_addr(uint8 ep, uint16 addr) {
+    usb_set_ep_rx_addr(ep, addr);
+}
+
+void usb_set_ep_rx_buf0_count(uint8 ep, uint16 count);
+
+static inline void usb_set_ep_rx_buf1_count(uint8 ep, uint16 count) {
+    usb_set_ep_rx_count(ep, count);
+}
+
+static inline uint16 usb_get_ep_rx_buf0_count(uint8 ep) {
+    return (uint16)*usb_ep_tx_count_ptr(ep) & 0x3FF;
+}
+
+static inline uint16 usb_get_ep_rx_buf1_count(uint8 ep) {
+    return usb_get_ep_rx_count(ep);
+}
+
 /*
  * Misc. types
  */
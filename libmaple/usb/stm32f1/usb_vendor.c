@@ -0,0 +1,198 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/usb/stm32f1/usb_vendor.c
+ * @brief Vendor-specific bulk interface, alongside USB CDC ACM
+ *
+ * The descriptors live with the rest of the device's, in
+ * usb_cdcacm.c.
+ */
+
+#include <libmaple/usb_vendor.h>
+
+#include "usb_vendor_private.h"
+#include "usb_dblbuf.h"
+
+#if USB_VENDOR_BULK
+
+/* Packet buffers. head and tail count packets removed and added, so
+ * all of them can be used. */
+
+#define TX_MASK (USB_VENDOR_TX_PACKETS - 1)
+#define RX_MASK (USB_VENDOR_RX_PACKETS - 1)
+
+static uint8 tx_data[USB_VENDOR_TX_PACKETS][USB_VENDOR_PACKET_SIZE]
+    __attribute__((aligned(4)));
+static uint16 tx_len[USB_VENDOR_TX_PACKETS];
+static volatile uint32 tx_head;  /* Copied to the endpoint */
+static volatile uint32 tx_tail;  /* Submitted */
+
+static uint8 rx_data[USB_VENDOR_RX_PACKETS][USB_VENDOR_PACKET_SIZE]
+    __attribute__((aligned(4)));
+static uint16 rx_len[USB_VENDOR_RX_PACKETS];
+static volatile uint32 rx_head;  /* Released */
+static volatile uint32 rx_tail;  /* Copied from the endpoint */
+
+static usb_dbl_in tx_ep;
+static usb_dbl_out rx_ep;
+
+/* Moves submitted packets into the endpoint's free buffers. */
+static void vendorFillTx(void) {
+    while (tx_head != tx_tail && usb_dbl_in_can_load(&tx_ep)) {
+        uint32 i = tx_head & TX_MASK;
+        usb_dbl_in_load(&tx_ep, tx_data[i], tx_len[i]);
+        tx_head++;
+    }
+}
+
+/* Moves received packets into free packet buffers. Until there's one
+ * free, the endpoint holds on to them, and NAKs once it's full. */
+static void vendorDrainRx(void) {
+    while (usb_dbl_out_available(&rx_ep) &&
+           rx_tail - rx_head < USB_VENDOR_RX_PACKETS) {
+        uint32 i = rx_tail & RX_MASK;
+        rx_len[i] = usb_dbl_out_read(&rx_ep, rx_data[i]);
+        rx_tail++;
+    }
+}
+
+/*
+ * Interface
+ */
+
+/**
+ * @brief Get the next free packet buffer to send.
+ *
+ * The buffer holds USB_VENDOR_PACKET_SIZE bytes, and is word-aligned.
+ * Calling this again before usb_vendor_tx_submit() returns the same
+ * buffer.
+ *
+ * @return The buffer, or NULL if they're all queued.
+ * @see usb_vendor_tx_submit()
+ */
+uint8* usb_vendor_tx_buffer(void) {
+    if (tx_tail - tx_head >= USB_VENDOR_TX_PACKETS) {
+        return NULL;
+    }
+    return tx_data[tx_tail & TX_MASK];
+}
+
+/**
+ * @brief Queue the buffer from usb_vendor_tx_buffer() for sending.
+ *
+ * Packets go out in the order they're submitted. A packet shorter
+ * than USB_VENDOR_PACKET_SIZE ends the host's current transfer; a
+ * zero len sends a zero-length packet.
+ *
+ * @param len Number of bytes to send from the buffer.
+ * @see usb_vendor_tx_buffer()
+ */
+void usb_vendor_tx_submit(uint16 len) {
+    uint32 irq;
+
+    if (tx_tail - tx_head >= USB_VENDOR_TX_PACKETS) {
+        return;
+    }
+    if (len > USB_VENDOR_PACKET_SIZE) {
+        len = USB_VENDOR_PACKET_SIZE;
+    }
+    tx_len[tx_tail & TX_MASK] = len;
+
+    irq = usb_dbl_mask_irq();
+    tx_tail++;
+    vendorFillTx();
+    usb_dbl_unmask_irq(irq);
+}
+
+/**
+ * @brief Returns the number of packet buffers which are waiting to
+ *        be copied to the endpoint.
+ */
+uint32 usb_vendor_tx_pending(void) {
+    return tx_tail - tx_head;
+}
+
+/**
+ * @brief Get the oldest received packet.
+ *
+ * The packet stays put until usb_vendor_rx_release().
+ *
+ * @param len Set to the packet's length, which may be 0.
+ * @return The packet, or NULL if there isn't one.
+ * @see usb_vendor_rx_release()
+ */
+const uint8* usb_vendor_rx_packet(uint16 *len) {
+    uint32 i;
+
+    if (rx_head == rx_tail) {
+        return NULL;
+    }
+    i = rx_head & RX_MASK;
+    *len = rx_len[i];
+    return rx_data[i];
+}
+
+/**
+ * @brief Give back the packet from usb_vendor_rx_packet().
+ * @see usb_vendor_rx_packet()
+ */
+void usb_vendor_rx_release(void) {
+    uint32 irq;
+
+    if (rx_head == rx_tail) {
+        return;
+    }
+
+    irq = usb_dbl_mask_irq();
+    rx_head++;
+    vendorDrainRx();
+    usb_dbl_unmask_irq(irq);
+}
+
+/*
+ * Hooks for usb_cdcacm.c
+ */
+
+void usb_vendor_reset(uint16 tx_addr0, uint16 tx_addr1, uint16 rx_addr) {
+    tx_head = tx_tail = 0;
+    rx_head = rx_tail = 0;
+    usb_dbl_in_init(&tx_ep, USB_VENDOR_TX_ENDP, tx_addr0, tx_addr1);
+    usb_dbl_out_init_single(&rx_ep, USB_VENDOR_RX_ENDP, rx_addr,
+                            USB_VENDOR_PACKET_SIZE);
+}
+
+void usb_vendor_tx_cb(void) {
+    usb_dbl_in_complete(&tx_ep);
+    vendorFillTx();
+}
+
+void usb_vendor_rx_cb(void) {
+    usb_dbl_out_received(&rx_ep);
+    vendorDrainRx();
+}
+
+#endif
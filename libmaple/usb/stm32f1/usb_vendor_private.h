@@ -0,0 +1,49 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file libmaple/usb/stm32f1/usb_vendor_private.h
+ * @brief Hooks between the vendor bulk interface and the device
+ *        which carries it (private)
+ */
+
+#ifndef _USB_VENDOR_PRIVATE_H_
+#define _USB_VENDOR_PRIVATE_H_
+
+#include <libmaple/usb_vendor.h>
+
+#define USB_VENDOR_TX_ENDP 4
+#define USB_VENDOR_RX_ENDP 5
+
+/* Sets up the endpoints, using the given PMA buffers, and drops
+ * anything queued. Call on USB reset. */
+void usb_vendor_reset(uint16 tx_addr0, uint16 tx_addr1, uint16 rx_addr);
+
+/* Endpoint callbacks */
+void usb_vendor_tx_cb(void);
+void usb_vendor_rx_cb(void);
+
+#endif
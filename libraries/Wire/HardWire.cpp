@@ -38,13 +38,25 @@
 
 #include <Wire/HardWire.h>
 
-uint8 HardWire::process() {
-    int8 res = i2c_master_xfer(sel_hard, &itc_msg, 1, 0);
+uint8 HardWire::process(i2c_msg *msgs, uint8 num) {
+    for (uint8 m = 0; m < num; m++) {
+        msgs[m].xferred = 0;
+    }
+    int32 res = i2c_master_xfer(sel_hard, msgs, num, 0);
     if (res != 0) {
+        // An acknowledge failure is a NACK; it's of the address if
+        // no data from the message it hit got moved.
+        bool nack = (res == I2C_ERROR_PROTOCOL &&
+                     (sel_hard->error_flags & I2C_SR1_AF));
+        i2c_msg *msg = sel_hard->msg;
         i2c_disable(sel_hard);
         i2c_master_enable(sel_hard, (I2C_BUS_RESET | dev_flags));
+        if (nack) {
+            return msg->xferred ? ENACKTRNS : ENACKADDR;
+        }
+        return EOTHER;
     }
-    return 0;
+    return SUCCESS;
 }
 
 // TODO: Add in Error Handling if devsel is out of range for other Maples
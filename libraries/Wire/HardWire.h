@@ -49,10 +49,12 @@ private:
     uint8    dev_flags;
 protected:
     /*
-     * Processes the incoming I2C message defined by WireBase to the
-     * hardware. If an error occured, restart the I2C device.
+     * Processes the incoming I2C messages defined by WireBase to the
+     * hardware, as one transaction. If an error occured, restart the
+     * I2C device. NACKs are reported as ENACKADDR or ENACKTRNS, like
+     * TwoWire does.
      */
-    uint8 process();
+    uint8 process(i2c_msg *msgs, uint8 num);
 public:
     /*
      * Check if devsel is within range and enable selected I2C interface with
@@ -38,46 +38,70 @@
  */
 
 #include <Wire/Wire.h>
+#include <libmaple/dwt.h>       // The DWT cycle counter times the bus
 
 #define I2C_WRITE 0
 #define I2C_READ  1
 
 /* low level conventions:
  * - SDA/SCL idle high (expected high)
- * - always start with i2c_delay rather than end
+ * - SCL edges wait out the low or high time first; SDA changes
+ *   right after SCL falls, or after a wait() for start/stop
+ * - timing runs edge to edge, so the time spent in between isn't
+ *   added on top
  */
 
-void TwoWire::set_scl(bool state) {
-    I2C_DELAY(this->i2c_delay);
-    digitalWrite(this->scl_pin,state);
-    //Allow for clock stretching - dangerous currently
+inline void TwoWire::wait(uint32 cycles) {
+    uint32 now;
+    do {
+        now = dwt_cyccnt();
+    } while (now - this->last_edge < cycles);
+}
+
+inline void TwoWire::set_scl(bool state) {
     if (state == HIGH) {
-        while(digitalRead(this->scl_pin) == 0);
+        wait(this->t_low);
+        *this->scl_bsrr = this->scl_mask;
+        // Allow for clock stretching
+        while (!(*this->scl_idr & this->scl_mask))
+            ;
+    } else {
+        wait(this->t_high);
+        *this->scl_bsrr = this->scl_mask << 16;
     }
+    this->last_edge = dwt_cyccnt();
+}
+
+inline void TwoWire::set_sda(bool state) {
+    *this->sda_bsrr = state ? this->sda_mask : this->sda_mask << 16;
 }
 
-void TwoWire::set_sda(bool state) {
-    I2C_DELAY(this->i2c_delay);
-    digitalWrite(this->sda_pin, state);
+inline bool TwoWire::get_sda() {
+    return *this->sda_idr & this->sda_mask;
 }
 
 void TwoWire::i2c_start() {
+    // Idle, or SCL low after a previous message
+    set_sda(HIGH);
+    set_scl(HIGH);              // After the bus free time, if idle
+    wait(this->t_high);         // Start setup time
     set_sda(LOW);
-    set_scl(LOW);
+    this->last_edge = dwt_cyccnt();
+    set_scl(LOW);               // After the start hold time
 }
 
 void TwoWire::i2c_stop() {
     set_sda(LOW);
     set_scl(HIGH);
+    wait(this->t_high);         // Stop setup time
     set_sda(HIGH);
+    this->last_edge = dwt_cyccnt();
 }
 
 bool TwoWire::i2c_get_ack() {
-    set_scl(LOW);
     set_sda(HIGH);
     set_scl(HIGH);
-
-    bool ret = !digitalRead(this->sda_pin);
+    bool ret = !get_sda();
     set_scl(LOW);
     return ret;
 }
@@ -101,7 +125,7 @@ uint8 TwoWire::i2c_shift_in() {
     int i;
     for (i = 0; i < 8; i++) {
         set_scl(HIGH);
-        data |= digitalRead(this->sda_pin) << (7-i);
+        data = (data << 1) | get_sda();
         set_scl(LOW);
     }
 
@@ -111,66 +135,102 @@ uint8 TwoWire::i2c_shift_in() {
 void TwoWire::i2c_shift_out(uint8 val) {
     int i;
     for (i = 0; i < 8; i++) {
-        set_sda(!!(val & (1 << (7 - i)) ) );
+        set_sda(val & 0x80);
+        val <<= 1;
         set_scl(HIGH);
         set_scl(LOW);
     }
 }
 
-uint8 TwoWire::process() {
-    itc_msg.xferred = 0;
+uint8 TwoWire::process(i2c_msg *msgs, uint8 num) {
+    for (uint8 m = 0; m < num; m++) {
+        i2c_msg *msg = &msgs[m];
+        msg->xferred = 0;
 
-    uint8 sla_addr = (itc_msg.addr << 1);
-    if (itc_msg.flags == I2C_MSG_READ) {
-        sla_addr |= I2C_READ;
-    }
-    i2c_start();
-    // shift out the address we're transmitting to
-    i2c_shift_out(sla_addr);
-    if (!i2c_get_ack()) {
-        return ENACKADDR;
-    }
-    // Recieving
-    if (itc_msg.flags == I2C_MSG_READ) {
-        while (itc_msg.xferred < itc_msg.length) {
-            itc_msg.data[itc_msg.xferred++] = i2c_shift_in();
-            if (itc_msg.xferred < itc_msg.length) {
-                i2c_send_ack();
-            } else {
-                i2c_send_nack();
+        uint8 sla_addr = (msg->addr << 1);
+        if (msg->flags == I2C_MSG_READ) {
+            sla_addr |= I2C_READ;
+        }
+        i2c_start();
+        // shift out the address we're transmitting to
+        i2c_shift_out(sla_addr);
+        if (!i2c_get_ack()) {
+            i2c_stop();
+            return ENACKADDR;
+        }
+        // Recieving
+        if (msg->flags == I2C_MSG_READ) {
+            while (msg->xferred < msg->length) {
+                msg->data[msg->xferred++] = i2c_shift_in();
+                if (msg->xferred < msg->length) {
+                    i2c_send_ack();
+                } else {
+                    i2c_send_nack();
+                }
             }
         }
-    }
-    // Sending
-    else {
-        for (uint8 i = 0; i < itc_msg.length; i++) {
-            i2c_shift_out(itc_msg.data[i]);
-            if (!i2c_get_ack()) {
-                return ENACKTRNS;
+        // Sending
+        else {
+            for (uint16 i = 0; i < msg->length; i++) {
+                i2c_shift_out(msg->data[i]);
+                if (!i2c_get_ack()) {
+                    i2c_stop();
+                    return ENACKTRNS;
+                }
+                msg->xferred++;
             }
-            itc_msg.xferred++;
         }
     }
     i2c_stop();
     return SUCCESS;
 }
 
-// TODO: Add in Error Handling if pins is out of range for other Maples
-// TODO: Make delays more capable
-TwoWire::TwoWire(uint8 scl, uint8 sda, uint8 delay) : i2c_delay(delay) {
+TwoWire::TwoWire(uint8 scl, uint8 sda, uint32 freq) : freq(freq) {
     this->scl_pin=scl;
     this->sda_pin=sda;
 }
 
 void TwoWire::begin(uint8 self_addr) {
+    const stm32_pin_info *scl, *sda;
+    uint32 freq = this->freq;
+    uint32 period;
+
     tx_buf_idx = 0;
     tx_buf_overflow = false;
     rx_buf_idx = 0;
     rx_buf_len = 0;
+
+    ASSERT(this->scl_pin < BOARD_NR_GPIO_PINS &&
+           this->sda_pin < BOARD_NR_GPIO_PINS);
+    scl = &PIN_MAP[this->scl_pin];
+    sda = &PIN_MAP[this->sda_pin];
+    this->scl_bsrr = &scl->gpio_device->regs->BSRR;
+    this->sda_bsrr = &sda->gpio_device->regs->BSRR;
+    this->scl_idr = &scl->gpio_device->regs->IDR;
+    this->sda_idr = &sda->gpio_device->regs->IDR;
+    this->scl_mask = BIT(scl->gpio_bit);
+    this->sda_mask = BIT(sda->gpio_bit);
+
+    // A tiny frequency is probably an old-style delay count; see
+    // TwoWire::TwoWire(). Zero would divide by zero below.
+    ASSERT(freq >= SOFT_MIN_FREQ);
+    if (freq < SOFT_MIN_FREQ) {
+        freq = SOFT_MIN_FREQ;
+    }
+
+    // Standard mode's minimum low and high times are about equal;
+    // the faster modes need twice as long low as high.
+    period = CYCLES_PER_MICROSECOND * 1000000 / freq;
+    this->t_low = freq > SOFT_STANDARD ? period * 2 / 3 : period / 2;
+    this->t_high = period - this->t_low;
+
+    dwt_cyccnt_enable();
+    this->last_edge = dwt_cyccnt();
+
     pinMode(this->scl_pin, OUTPUT_OPEN_DRAIN);
     pinMode(this->sda_pin, OUTPUT_OPEN_DRAIN);
-    set_scl(HIGH);
     set_sda(HIGH);
+    set_scl(HIGH);
 }
 
 TwoWire::~TwoWire() {
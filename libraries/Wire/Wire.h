@@ -50,30 +50,70 @@
 #define SDA 19
 #define SCL 20
 
-//#define I2C_DELAY(x) {uint32 time=micros(); while(time>(micros()+x));}
-#define I2C_DELAY(x) do{for(int i=0;i<x;i++) {asm volatile("nop");}}while(0)
-#define SOFT_STANDARD 25
-#define SOFT_FAST 7
+/*
+ * SCL frequencies, in Hz
+ */
+#define SOFT_STANDARD  100000   // Standard mode
+#define SOFT_FAST      400000   // Fast mode
+#define SOFT_FAST_PLUS 1000000  // Fast-mode Plus
+
+/*
+ * Slowest SCL frequency accepted, in Hz. Anything slower is almost
+ * certainly a delay count left over from the old constructor (see
+ * TwoWire::TwoWire()).
+ */
+#define SOFT_MIN_FREQ  1000
 
 class TwoWire : public WireBase {
  private:
-    const uint8 i2c_delay;
-    uint8       scl_pin;
-    uint8       sda_pin;
+    const uint32 freq;
+    uint8        scl_pin;
+    uint8        sda_pin;
 
     /*
-     * Sets the SCL line to HIGH/LOW and allow for clock stretching by slave
-     * devices
+     * Resolved by begin(), so the lines can be driven without going
+     * through digitalWrite()
+     */
+    __io uint32 *scl_bsrr;
+    __io uint32 *sda_bsrr;
+    __io uint32 *scl_idr;
+    __io uint32 *sda_idr;
+    uint32       scl_mask;
+    uint32       sda_mask;
+
+    /*
+     * SCL low and high times, and the time of the last edge, in CPU
+     * cycles
+     */
+    uint32 t_low;
+    uint32 t_high;
+    uint32 last_edge;
+
+    /*
+     * Waits until the given number of cycles have passed since the
+     * last edge
+     */
+    void wait(uint32);
+
+    /*
+     * Sets the SCL line to HIGH/LOW, after the low or high time, and
+     * allow for clock stretching by slave devices
      */
     void set_scl(bool);
 
     /*
-     * Sets the SDA line to HIGH/LOW
+     * Sets the SDA line to HIGH/LOW, right away
      */
     void set_sda(bool);
 
     /*
-     * Creates a Start condition on the bus
+     * Reads the SDA line
+     */
+    bool get_sda();
+
+    /*
+     * Creates a Start condition on the bus, or a repeated start if
+     * it's already ours
      */
     void i2c_start();
 
@@ -108,20 +148,30 @@ class TwoWire : public WireBase {
     void i2c_shift_out(uint8);
  protected:
     /*
-     * Processes the incoming I2C message defined by WireBase
+     * Processes the incoming I2C messages defined by WireBase, with
+     * a repeated start between each
      */
-    uint8 process();
+    uint8 process(i2c_msg *msgs, uint8 num);
  public:
     /*
-     * Accept pin numbers for SCL and SDA lines. Set the delay needed
-     * to create the timing for I2C's Standard Mode and Fast Mode.
+     * Accept pin numbers for SCL and SDA lines, and the SCL frequency
+     * in Hz: SOFT_STANDARD, SOFT_FAST, SOFT_FAST_PLUS, or anything in
+     * between.
+     *
+     * API change: the third argument used to be a delay count, where
+     * bigger meant slower (SOFT_STANDARD was 25, SOFT_FAST 7). Code
+     * which passes the SOFT_* names keeps working, but code which
+     * passes a number must now pass the frequency instead. Numbers
+     * below SOFT_MIN_FREQ fail an ASSERT in begin(), and are raised
+     * to SOFT_MIN_FREQ if assertions are off.
      */
-    TwoWire(uint8 scl=SCL, uint8 sda=SDA, uint8 delay=SOFT_STANDARD);
+    TwoWire(uint8 scl=SCL, uint8 sda=SDA, uint32 freq=SOFT_STANDARD);
 
     /*
      * Sets pins SDA and SCL to OUPTUT_OPEN_DRAIN, joining I2C bus as
-     * master. This function overwrites the default behaviour of
-     * .begin(uint8) in WireBase
+     * master, and works out the bus timing from the core clock. This
+     * function overwrites the default behaviour of .begin(uint8) in
+     * WireBase
      */
     void begin(uint8 = 0x00);
 
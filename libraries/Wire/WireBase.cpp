@@ -41,6 +41,25 @@
 #include <Wire/WireBase.h>
 #include <wirish/wirish.h>
 
+WireBase::WireBase() {
+    rx_buf = builtin_rx_buf;
+    rx_buf_size = WIRE_BUFSIZ;
+    tx_buf = builtin_tx_buf;
+    tx_buf_size = WIRE_BUFSIZ;
+}
+
+void WireBase::setBuffers(uint8 *rxBuffer, uint16 rxSize,
+                          uint8 *txBuffer, uint16 txSize) {
+    if (rxBuffer) {
+        rx_buf = rxBuffer;
+        rx_buf_size = rxSize;
+    }
+    if (txBuffer) {
+        tx_buf = txBuffer;
+        tx_buf_size = txSize;
+    }
+}
+
 void WireBase::begin(uint8 self_addr) {
     tx_buf_idx = 0;
     tx_buf_overflow = false;
@@ -60,38 +79,69 @@ void WireBase::beginTransmission(int slave_address) {
 }
 
 uint8 WireBase::endTransmission(void) {
+    uint8 ret;
     if (tx_buf_overflow) {
         return EDATA;
     }
-    process();
+    ret = process(&itc_msg, 1);
     tx_buf_idx = 0;
     tx_buf_overflow = false;
-    return SUCCESS;
+    return ret;
 }
 
 //TODO: Add the ability to queue messages (adding a boolean to end of function
 // call, allows for the Arduino style to stay while also giving the flexibility
 // to bulk send
-uint8 WireBase::requestFrom(uint8 address, int num_bytes) {
-    if (num_bytes > WIRE_BUFSIZ) {
-        num_bytes = WIRE_BUFSIZ;
+uint16 WireBase::requestFrom(uint8 address, int num_bytes) {
+    if (num_bytes > rx_buf_size - rx_buf_len) {
+        num_bytes = rx_buf_size - rx_buf_len;
+    }
+    // A zero-length read would never finish in HardWire's interrupt
+    // handler, so don't start one; the buffer's full, or nothing was
+    // asked for.
+    if (num_bytes <= 0) {
+        return rx_buf_len;
     }
     itc_msg.addr = address;
     itc_msg.flags = I2C_MSG_READ;
     itc_msg.length = num_bytes;
-    itc_msg.data = &rx_buf[rx_buf_idx];
-    process();
+    itc_msg.data = &rx_buf[rx_buf_len];
+    process(&itc_msg, 1);
     rx_buf_len += itc_msg.xferred;
     itc_msg.flags = 0;
     return rx_buf_len;
 }
 
-uint8 WireBase::requestFrom(int address, int numBytes) {
+uint16 WireBase::requestFrom(int address, int numBytes) {
     return WireBase::requestFrom((uint8)address, numBytes);
 }
 
+uint8 WireBase::writeThenRead(uint8 address, const uint8 *txBuffer,
+                              uint16 txLen, uint8 *rxBuffer, uint16 rxLen) {
+    i2c_msg msgs[2];
+    uint8 num = 0;
+
+    if (txLen) {
+        msgs[num].addr = address;
+        msgs[num].flags = 0;
+        msgs[num].length = txLen;
+        msgs[num].xferred = 0;
+        msgs[num].data = (uint8*)txBuffer;
+        num++;
+    }
+    if (rxLen) {
+        msgs[num].addr = address;
+        msgs[num].flags = I2C_MSG_READ;
+        msgs[num].length = rxLen;
+        msgs[num].xferred = 0;
+        msgs[num].data = rxBuffer;
+        num++;
+    }
+    return num ? process(msgs, num) : SUCCESS;
+}
+
 void WireBase::send(uint8 value) {
-    if (tx_buf_idx == WIRE_BUFSIZ) {
+    if (tx_buf_idx == tx_buf_size) {
         tx_buf_overflow = true;
         return;
     }
@@ -100,7 +150,7 @@ void WireBase::send(uint8 value) {
 }
 
 void WireBase::send(uint8* buf, int len) {
-    for (uint8 i = 0; i < len; i++) {
+    for (int i = 0; i < len; i++) {
         send(buf[i]);
     }
 }
@@ -121,7 +171,7 @@ void WireBase::send(char* buf) {
     }
 }
 
-uint8 WireBase::available() {
+uint16 WireBase::available() {
     return rx_buf_len - rx_buf_idx;
 }
 
@@ -44,7 +44,10 @@
 #include <wirish/wirish.h>
 #include <libmaple/i2c.h>
 
+/* Size of the built-in buffers; see setBuffers() for bigger ones */
+#ifndef WIRE_BUFSIZ
 #define WIRE_BUFSIZ 32
+#endif
 
 /* return codes from endTransmission() */
 #define SUCCESS   0        /* transmission was successful */
@@ -56,20 +59,37 @@
 class WireBase { // Abstraction is awesome!
 protected:
     i2c_msg itc_msg;
-    uint8 rx_buf[WIRE_BUFSIZ];      /* receive buffer */
-    uint8 rx_buf_idx;               /* first unread idx in rx_buf */
-    uint8 rx_buf_len;               /* number of bytes read */
-
-    uint8 tx_buf[WIRE_BUFSIZ];      /* transmit buffer */
-    uint8 tx_buf_idx;  // next idx available in tx_buf, -1 overflow
+    uint8 *rx_buf;                  /* receive buffer */
+    uint16 rx_buf_size;             /* size of rx_buf */
+    uint16 rx_buf_idx;              /* first unread idx in rx_buf */
+    uint16 rx_buf_len;              /* number of bytes read */
+
+    uint8 *tx_buf;                  /* transmit buffer */
+    uint16 tx_buf_size;             /* size of tx_buf */
+    uint16 tx_buf_idx;  // next idx available in tx_buf
     boolean tx_buf_overflow;
 
-    // Force derived classes to define process function
-    virtual uint8 process() = 0;
+    uint8 builtin_rx_buf[WIRE_BUFSIZ];
+    uint8 builtin_tx_buf[WIRE_BUFSIZ];
+
+    /*
+     * Force derived classes to define process function. It carries out
+     * num messages as one transaction, with a repeated start between
+     * each, and returns one of the endTransmission() codes.
+     */
+    virtual uint8 process(i2c_msg *msgs, uint8 num) = 0;
 public:
-    WireBase() {}
+    WireBase();
     ~WireBase() {}
 
+    /*
+     * Use the given buffers instead of the built-in WIRE_BUFSIZ byte
+     * ones, which allows longer messages. Either may be NULL, to keep
+     * the current one. Call before begin().
+     */
+    void setBuffers(uint8 *rxBuffer, uint16 rxSize,
+                    uint8 *txBuffer, uint16 txSize);
+
     /*
      * Initialises the class interface
      */
@@ -96,12 +116,22 @@ public:
      * Request bytes from a slave device and process the request,
      * storing into the receiving buffer.
      */
-    uint8 requestFrom(uint8, int);
+    uint16 requestFrom(uint8, int);
 
     /*
      * Allow only 8 bit addresses to be used when requesting bytes
      */
-    uint8 requestFrom(int, int);
+    uint16 requestFrom(int, int);
+
+    /*
+     * Write txLen bytes, then read rxLen bytes straight into rxBuffer,
+     * with a repeated start in between, as one transaction. Typically
+     * used to read a device's registers: write the register address,
+     * then read. The buffers are the caller's, so they can be any
+     * length. Returns one of the endTransmission() codes.
+     */
+    uint8 writeThenRead(uint8 address, const uint8 *txBuffer, uint16 txLen,
+                        uint8 *rxBuffer, uint16 rxLen);
 
     /*
      * Stack up bytes to be sent when transmitting
@@ -131,7 +161,7 @@ public:
     /*
      * Return the amount of bytes that is currently in the receiving buffer
      */
-    uint8 available();
+    uint16 available();
 
     /*
      * Return the value of byte in the receiving buffer that is currently being
@@ -51,4 +51,9 @@ TARGET_FLAGS += -mthumb -DBOARD_$(BOARD) -DMCU_$(MCU) \
                 -DERROR_LED_PIN=$(ERROR_LED_PIN) \
                 -D$(VECT_BASE_ADDR)
 
+# Optional libmaple features
+ifeq ($(USB_VENDOR_BULK), 1)
+TARGET_FLAGS += -DUSB_VENDOR_BULK=1
+endif
+
 LIBMAPLE_MODULE_SERIES := $(LIBMAPLE_PATH)/$(MCU_SERIES)
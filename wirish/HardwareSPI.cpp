@@ -38,6 +38,8 @@
 #include <wirish/wirish.h>
 #include <wirish/boards.h>
 
+#include <string.h>
+
 #if CYCLES_PER_MICROSECOND != 72
 /* TODO [0.2.0?] something smarter than this */
 #warning "Unexpected clock speed; SPI frequency calculation will be incorrect"
@@ -51,6 +53,8 @@ struct spi_pins {
 };
 
 static const spi_pins* dev_to_spi_pins(spi_dev *dev);
+static void poll_transfer(spi_dev *dev, const void *tx, void *rx,
+                          uint32 len);
 
 static void enable_device(spi_dev *dev,
                           bool as_master,
@@ -81,6 +85,14 @@ static const spi_pins board_spi_pins[] __FLASH__ = {
  */
 
 HardwareSPI::HardwareSPI(uint32 spi_num) {
+    this->callback = NULL;
+    this->streamCallback = NULL;
+    this->streamBuffer = NULL;
+    this->streamHead = 0;
+    this->streamLaps = 0;
+    this->streamHalves = 0;
+    this->streamOverran = false;
+
     switch (spi_num) {
     case 1:
         this->spi_d = SPI1;
@@ -134,6 +146,8 @@ void HardwareSPI::end(void) {
     if (!spi_is_enabled(this->spi_d)) {
         return;
     }
+    this->endSlaveStream();
+    this->waitForTransfer();
 
     // Follows RM0008's sequence for disabling a SPI in master/slave
     // full duplex mode.
@@ -148,6 +162,31 @@ void HardwareSPI::end(void) {
     spi_peripheral_disable(this->spi_d);
 }
 
+void HardwareSPI::setFrameSize(uint8 bits) {
+    this->waitForTransfer();
+    spi_set_dff(this->spi_d, bits == 16 ? SPI_DFF_16_BIT : SPI_DFF_8_BIT);
+}
+
+uint8 HardwareSPI::frameSize(void) {
+    return spi_dff(this->spi_d) == SPI_DFF_16_BIT ? 16 : 8;
+}
+
+void HardwareSPI::enableCRC(uint16 polynomial) {
+    this->waitForTransfer();
+    spi_crc_enable(this->spi_d, polynomial);
+}
+
+void HardwareSPI::disableCRC(void) {
+    this->waitForTransfer();
+    spi_crc_disable(this->spi_d);
+}
+
+bool HardwareSPI::crcError(void) {
+    bool ret = spi_is_crc_error(this->spi_d);
+    spi_clear_crc_error(this->spi_d);
+    return ret;
+}
+
 /*
  * I/O
  */
@@ -168,13 +207,30 @@ void HardwareSPI::read(uint8 *buf, uint32 len) {
 }
 
 void HardwareSPI::write(uint8 byte) {
-    this->write(&byte, 1);
+    this->waitForTransfer();
+    while (!spi_is_tx_empty(this->spi_d))
+        ;
+    spi_tx_reg(this->spi_d, byte);
 }
 
-void HardwareSPI::write(const uint8 *data, uint32 length) {
+void HardwareSPI::write(const void *data, uint32 length) {
+    this->waitForTransfer();
+    if (length >= SPI_DMA_THRESHOLD &&
+        spi_dma_xfer_start(this->spi_d, data, NULL, length, NULL, NULL) == 0) {
+        spi_dma_xfer_wait(this->spi_d);
+        return;
+    }
+
+    if (spi_crc_is_enabled(this->spi_d)) {
+        poll_transfer(this->spi_d, data, NULL, length);
+        return;
+    }
+
     uint32 txed = 0;
+    uint32 frame_size = spi_dff(this->spi_d) == SPI_DFF_16_BIT ? 2 : 1;
     while (txed < length) {
-        txed += spi_tx(this->spi_d, data + txed, length - txed);
+        txed += spi_tx(this->spi_d, (const uint8*)data + txed * frame_size,
+                       length - txed);
     }
 }
 
@@ -183,6 +239,240 @@ uint8 HardwareSPI::transfer(uint8 byte) {
     return this->read();
 }
 
+uint16 HardwareSPI::transfer16(uint16 data) {
+    if (spi_dff(this->spi_d) == SPI_DFF_16_BIT) {
+        this->waitForTransfer();
+        while (!spi_is_tx_empty(this->spi_d))
+            ;
+        spi_tx_reg(this->spi_d, data);
+        while (!spi_is_rx_nonempty(this->spi_d))
+            ;
+        return spi_rx_reg(this->spi_d);
+    }
+    uint8 hi = this->transfer((uint8)(data >> 8));
+    return (hi << 8) | this->transfer((uint8)data);
+}
+
+/* Polled full-duplex transfer, one frame in flight at a time. With
+ * CRC enabled, it ends with the CRC frames. */
+static void poll_transfer(spi_dev *dev, const void *tx, void *rx,
+                          uint32 len) {
+    bool wide = spi_dff(dev) == SPI_DFF_16_BIT;
+    bool crc = spi_crc_is_enabled(dev);
+
+    if (crc) {
+        spi_crc_reset(dev);
+    }
+    while (spi_is_rx_nonempty(dev)) {
+        (void)spi_rx_reg(dev);
+    }
+    for (uint32 i = 0; i < len; i++) {
+        uint16 frame = 0xFFFF;
+        if (tx) {
+            frame = wide ? ((const uint16*)tx)[i] : ((const uint8*)tx)[i];
+        }
+        while (!spi_is_tx_empty(dev))
+            ;
+        spi_tx_reg(dev, frame);
+        if (crc && i == len - 1) {
+            spi_crc_next(dev);
+        }
+        while (!spi_is_rx_nonempty(dev))
+            ;
+        frame = spi_rx_reg(dev);
+        if (rx) {
+            if (wide) {
+                ((uint16*)rx)[i] = frame;
+            } else {
+                ((uint8*)rx)[i] = (uint8)frame;
+            }
+        }
+    }
+    if (crc && len) {
+        while (!spi_is_rx_nonempty(dev))
+            ;
+        (void)spi_rx_reg(dev);
+    }
+}
+
+void HardwareSPI::transfer(const void *tx, void *rx, uint32 length) {
+    this->waitForTransfer();
+    if (length >= SPI_DMA_THRESHOLD &&
+        spi_dma_xfer_start(this->spi_d, tx, rx, length, NULL, NULL) == 0) {
+        spi_dma_xfer_wait(this->spi_d);
+        return;
+    }
+    poll_transfer(this->spi_d, tx, rx, length);
+}
+
+bool HardwareSPI::transferAsync(const void *tx, void *rx, uint32 length,
+                                voidFuncPtr callback) {
+    if (this->isBusy()) {
+        return false;
+    }
+    this->callback = callback;
+    if (length >= SPI_DMA_THRESHOLD &&
+        spi_dma_xfer_start(this->spi_d, tx, rx, length,
+                           HardwareSPI::dmaDone, this) == 0) {
+        return true;
+    }
+    /* Short, or another driver has the DMA tubes: poll instead. */
+    poll_transfer(this->spi_d, tx, rx, length);
+    if (callback) {
+        callback();
+    }
+    return true;
+}
+
+bool HardwareSPI::writeAsync(const void *buffer, uint32 length,
+                             voidFuncPtr callback) {
+    return this->transferAsync(buffer, NULL, length, callback);
+}
+
+bool HardwareSPI::isBusy(void) {
+    return spi_dma_xfer_busy(this->spi_d);
+}
+
+void HardwareSPI::waitForTransfer(void) {
+    spi_dma_xfer_wait(this->spi_d);
+}
+
+/* Called from the DMA interrupt. */
+void HardwareSPI::dmaDone(void *spi) {
+    HardwareSPI *self = (HardwareSPI*)spi;
+    if (self->callback) {
+        self->callback();
+    }
+}
+
+/*
+ * Slave streaming
+ */
+
+bool HardwareSPI::beginSlaveStream(void *rxBuffer, const void *txBuffer,
+                                   uint16 length,
+                                   SPIStreamCallback callback) {
+    this->streamCallback = callback;
+    this->streamBuffer = (uint8*)rxBuffer;
+    this->streamHead = 0;
+    this->streamLaps = 0;
+    this->streamHalves = 0;
+    this->streamOverran = false;
+    if (spi_slave_stream_start(this->spi_d, rxBuffer, txBuffer, length,
+                               HardwareSPI::streamEvent, this) != 0) {
+        this->streamBuffer = NULL;
+        return false;
+    }
+    attachInterrupt(this->nssPin(), HardwareSPI::nssChanged, this, CHANGE);
+    return true;
+}
+
+void HardwareSPI::endSlaveStream(void) {
+    if (!this->streamBuffer) {
+        return;
+    }
+    detachInterrupt(this->nssPin());
+    spi_slave_stream_stop(this->spi_d);
+    this->streamBuffer = NULL;
+}
+
+uint16 HardwareSPI::streamPosition(void) {
+    return spi_slave_stream_pos(this->spi_d);
+}
+
+uint32 HardwareSPI::streamAvailable(void) {
+    uint16 len = this->spi_d->stream_len;
+    uint32 halves, written, avail;
+    uint16 tail;
+
+    if (!this->streamBuffer) {
+        return 0;
+    }
+    do {
+        halves = this->streamHalves;
+        tail = this->streamPosition();
+    } while (halves != this->streamHalves);
+    // The event for the half DMA has just filled may not have been
+    // handled yet. An even count means the second half was the last
+    // one filled, so we should be in the first.
+    if ((tail < len / 2) != (halves % 2 == 0)) {
+        halves++;
+    }
+
+    // Count frames from the start of the stream, so that a writer
+    // which has lapped the reader shows up.
+    written = halves / 2 * len + tail;
+    avail = written - (this->streamLaps * len + this->streamHead);
+    if (avail > len) {
+        // Skip what's left; it's being overwritten.
+        this->streamLaps = halves / 2;
+        this->streamHead = tail;
+        this->streamOverran = true;
+        return 0;
+    }
+    return avail;
+}
+
+bool HardwareSPI::streamOverrun(void) {
+    bool ret;
+    this->streamAvailable();
+    ret = this->streamOverran;
+    this->streamOverran = false;
+    return ret;
+}
+
+uint32 HardwareSPI::streamRead(void *buffer, uint32 length) {
+    uint32 frame = spi_dff(this->spi_d) == SPI_DFF_16_BIT ? 2 : 1;
+    uint16 len = this->spi_d->stream_len;
+    uint32 avail = this->streamAvailable();
+    uint8 *dst = (uint8*)buffer;
+    uint32 n, chunk;
+
+    if (length > avail) {
+        length = avail;
+    }
+    // At most two copies: up to the end of the ring, then from the start.
+    for (n = 0; n < length; n += chunk) {
+        chunk = len - this->streamHead;
+        if (chunk > length - n) {
+            chunk = length - n;
+        }
+        memcpy(dst + n * frame, this->streamBuffer + this->streamHead * frame,
+               chunk * frame);
+        this->streamHead += chunk;
+        if (this->streamHead == len) {
+            this->streamHead = 0;
+            this->streamLaps++;
+        }
+    }
+    return length;
+}
+
+/* Called from the DMA interrupt. */
+void HardwareSPI::streamEvent(void *spi, spi_stream_event event) {
+    HardwareSPI *self = (HardwareSPI*)spi;
+    if (event == SPI_STREAM_HALF || event == SPI_STREAM_FULL) {
+        self->streamHalves++;
+    }
+    if (event == SPI_STREAM_ERROR) {
+        detachInterrupt(self->nssPin());
+        self->streamBuffer = NULL;
+    }
+    if (self->streamCallback) {
+        self->streamCallback(event);
+    }
+}
+
+/* Called from the NSS pin's external interrupt. */
+void HardwareSPI::nssChanged(void *spi) {
+    HardwareSPI *self = (HardwareSPI*)spi;
+    if (self->streamCallback) {
+        self->streamCallback(digitalRead(self->nssPin()) ?
+                             SPI_STREAM_NSS_RELEASED :
+                             SPI_STREAM_NSS_ASSERTED);
+    }
+}
+
 /*
  * Pin accessors
  */
@@ -213,13 +503,11 @@ uint8 HardwareSPI::send(uint8 data) {
 }
 
 uint8 HardwareSPI::send(uint8 *buf, uint32 len) {
-    uint32 txed = 0;
-    uint8 ret = 0;
-    while (txed < len) {
-        this->write(buf[txed++]);
-        ret = this->read();
+    if (len == 0) {
+        return 0;
     }
-    return ret;
+    this->transfer(buf, NULL, len - 1);
+    return this->transfer(buf[len - 1]);
 }
 
 uint8 HardwareSPI::recv(void) {
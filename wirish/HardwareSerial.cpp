@@ -110,9 +110,25 @@ void HardwareSerial::begin(uint32 baud) {
 }
 
 void HardwareSerial::end(void) {
+    usart_tx_flush(this->usart_device);
     usart_disable(this->usart_device);
 }
 
+/*
+ * DMA
+ */
+
+/* Must be called after begin(). Any data waiting to be read is
+ * discarded. Returns false if this port's receiver can't use DMA, or
+ * another driver has claimed the DMA tubes it could use. */
+bool HardwareSerial::enableRxDMA(void) {
+    return usart_rx_dma_enable(this->usart_device) == 0;
+}
+
+void HardwareSerial::disableRxDMA(void) {
+    usart_rx_dma_disable(this->usart_device);
+}
+
 /*
  * I/O
  */
@@ -129,9 +145,27 @@ uint32 HardwareSerial::available(void) {
 }
 
 void HardwareSerial::write(unsigned char ch) {
-    usart_putc(this->usart_device, ch);
+    this->write(&ch, 1);
+}
+
+void HardwareSerial::write(const void *buf, uint32 len) {
+    const uint8 *bytes = (const uint8*)buf;
+    // Queue as much as fits, then wait for room for the rest. Only
+    // blocks if the TX queue is full. usart_tx_wait() sends queued
+    // bytes itself if the TX interrupt can't, so this is safe with
+    // interrupts disabled and in interrupt handlers.
+    for (;;) {
+        uint32 queued = usart_tx_queue(this->usart_device, bytes, len);
+        bytes += queued;
+        len -= queued;
+        if (!len) {
+            break;
+        }
+        usart_tx_wait(this->usart_device);
+    }
 }
 
 void HardwareSerial::flush(void) {
+    usart_tx_flush(this->usart_device);
     usart_reset_rx(this->usart_device);
 }
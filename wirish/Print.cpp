@@ -24,8 +24,10 @@
 
 #include <wirish/Print.h>
 
-#include <wirish/wirish_math.h>
+#include "print_format.h"
+
 #include <limits.h>
+#include <string.h>
 
 #ifndef LLONG_MAX
 /*
@@ -47,11 +49,11 @@
  */
 
 void Print::write(const char *str) {
-    while (*str) {
-        write(*str++);
-    }
+    write(str, strlen(str));
 }
 
+/* Subclasses which can send more than one byte at a time should
+ * override this; print() and println() send everything through it. */
 void Print::write(const void *buffer, uint32 size) {
     uint8 *ch = (uint8*)buffer;
     while (size--) {
@@ -93,27 +95,40 @@ void Print::print(long long n, int base) {
         return;
     }
     if (n < 0) {
-        print('-');
-        n = -n;
+        // Negate as unsigned, so LLONG_MIN doesn't overflow.
+        printNumber(-(unsigned long long)n, base, true);
+    } else {
+        printNumber(n, base, false);
     }
-    printNumber(n, base);
 }
 
 void Print::print(unsigned long long n, int base) {
     if (base == BYTE) {
         write((uint8)n);
     } else {
-        printNumber(n, base);
+        printNumber(n, base, false);
     }
 }
 
+/* Floating point values are formatted exactly, using integer
+ * arithmetic only; see print_format.cpp. */
+
+void Print::print(float n, int digits) {
+    char buf[32];
+    wirish::priv::FormatBuffer out(buf, sizeof(buf), this);
+    wirish::priv::format_float(&out, n, wirish::priv::FLOAT_FIXED, digits);
+    out.flush();
+}
+
 void Print::print(double n, int digits) {
-    printFloat(n, digits);
+    char buf[32];
+    wirish::priv::FormatBuffer out(buf, sizeof(buf), this);
+    wirish::priv::format_double(&out, n, wirish::priv::FLOAT_FIXED, digits);
+    out.flush();
 }
 
 void Print::println(void) {
-    print('\r');
-    print('\n');
+    write("\r\n", 2);
 }
 
 void Print::println(char c) {
@@ -161,92 +176,64 @@ void Print::println(unsigned long long n, int base) {
     println();
 }
 
+void Print::println(float n, int digits) {
+    print(n, digits);
+    println();
+}
+
 void Print::println(double n, int digits) {
     print(n, digits);
     println();
 }
 
-/*
- * Private methods
- */
+/* See print_format.cpp for the supported conversions. */
 
-void Print::printNumber(unsigned long long n, uint8 base) {
-    unsigned char buf[CHAR_BIT * sizeof(long long)];
-    unsigned long i = 0;
+int Print::printf(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vprintf(fmt, args);
+    va_end(args);
+    return ret;
+}
 
-    if (n == 0) {
-        print('0');
-        return;
-    }
+int Print::vprintf(const char *fmt, va_list args) {
+    char buf[64];
+    wirish::priv::FormatBuffer out(buf, sizeof(buf), this);
+    wirish::priv::format_va(&out, fmt, args);
+    out.flush();
+    return out.count();
+}
 
-    while (n > 0) {
-        buf[i++] = n % base;
-        n /= base;
-    }
+int Print::format(char *buf, uint32 size, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int ret = vformat(buf, size, fmt, args);
+    va_end(args);
+    return ret;
+}
 
-    for (; i > 0; i--) {
-        print((char)(buf[i - 1] < 10 ?
-                     '0' + buf[i - 1] :
-                     'A' + buf[i - 1] - 10));
+int Print::vformat(char *buf, uint32 size, const char *fmt, va_list args) {
+    // Hold back a byte for the NUL.
+    wirish::priv::FormatBuffer out(buf, size ? size - 1 : 0, NULL);
+    wirish::priv::format_va(&out, fmt, args);
+    if (size) {
+        buf[out.length()] = '\0';
     }
+    return out.count();
 }
 
-/* According to snprintf(),
- *
- * nextafter((double)numeric_limits<long long>::max(), 0.0) ~= 9.22337e+18
- *
- * This slightly smaller value was picked semi-arbitrarily. */
-#define LARGE_DOUBLE_TRESHOLD (9.1e18)
-
-/* THIS FUNCTION SHOULDN'T BE USED IF YOU NEED ACCURATE RESULTS.
- *
- * This implementation is meant to be simple and not occupy too much
- * code size.  However, printing floating point values accurately is a
- * subtle task, best left to a well-tested library function.
- *
- * See Steele and White 2003 for more details:
- *
- * http://kurtstephens.com/files/p372-steele.pdf
+/*
+ * Private methods
  */
-void Print::printFloat(double number, uint8 digits) {
-    // Hackish fail-fast behavior for large-magnitude doubles
-    if (abs(number) >= LARGE_DOUBLE_TRESHOLD) {
-        if (number < 0.0) {
-            print('-');
-        }
-        print("<large double>");
-        return;
-    }
-
-    // Handle negative numbers
-    if (number < 0.0) {
-        print('-');
-        number = -number;
-    }
 
-    // Simplistic rounding strategy so that e.g. print(1.999, 2)
-    // prints as "2.00"
-    double rounding = 0.5;
-    for (uint8 i = 0; i < digits; i++) {
-        rounding /= 10.0;
-    }
-    number += rounding;
-
-    // Extract the integer part of the number and print it
-    long long int_part = (long long)number;
-    double remainder = number - int_part;
-    print(int_part);
-
-    // Print the decimal point, but only if there are digits beyond
-    if (digits > 0) {
-        print(".");
-    }
+void Print::printNumber(unsigned long long n, uint8 base, bool negative) {
+    // Room for a minus sign, and all the digits in base 2.
+    char buf[1 + CHAR_BIT * sizeof(long long)];
+    char *end = buf + sizeof(buf);
+    char *start = wirish::priv::format_number(end, n, base);
 
-    // Extract digits from the remainder one at a time
-    while (digits-- > 0) {
-        remainder *= 10.0;
-        int to_print = (int)remainder;
-        print(to_print);
-        remainder -= to_print;
+    if (negative) {
+        *--start = '-';
     }
+    write(start, end - start);
 }
@@ -28,7 +28,7 @@
  * @file wirish/include/wirish/HardwareSPI.h
  * @brief High-level SPI interface
  *
- * This is a "bare essentials" polling driver for now.
+ * Single frames are polled; longer buffers can go through DMA.
  */
 
 /* TODO [0.1.0] Remove deprecated methods. */
@@ -57,6 +57,22 @@ typedef enum SPIFrequency {
 
 #define MAX_SPI_FREQS 8
 
+/**
+ * @brief Shortest buffer transfer which uses DMA.
+ *
+ * Setting up the DMA tubes costs about as much as polling a few
+ * bytes through, so shorter transfers are polled.
+ */
+#ifndef SPI_DMA_THRESHOLD
+#define SPI_DMA_THRESHOLD 16
+#endif
+
+/**
+ * @brief Slave stream event handler.
+ * @see HardwareSPI::beginSlaveStream()
+ */
+typedef void (*SPIStreamCallback)(spi_stream_event event);
+
 /**
  * @brief Wirish SPI interface.
  *
@@ -111,6 +127,45 @@ public:
      */
     void end(void);
 
+    /**
+     * @brief Set the number of bits per frame.
+     *
+     * In 16-bit mode, buffers passed to write(), transfer(), etc.
+     * hold uint16 frames, and their lengths count frames, not bytes.
+     * Call after begin() or beginSlave().
+     *
+     * @param bits 8 (the default) or 16.
+     */
+    void setFrameSize(uint8 bits);
+
+    /**
+     * @brief Return the number of bits per frame, 8 or 16.
+     */
+    uint8 frameSize(void);
+
+    /**
+     * @brief Check every buffer transfer with the hardware CRC unit.
+     *
+     * Each write() and transfer() of a buffer then ends with a CRC
+     * frame in each direction. The peripheral computes and checks
+     * them itself; see crcError(). The CRC is as wide as a frame.
+     *
+     * @param polynomial CRC polynomial, without its top bit; e.g.
+     *                   0x07 for CRC-8, or 0x1021 for CRC-16-CCITT.
+     */
+    void enableCRC(uint16 polynomial);
+
+    /**
+     * @brief Stop sending and checking CRCs.
+     */
+    void disableCRC(void);
+
+    /**
+     * @brief Return true if a received CRC didn't match since the
+     *        last call, and clear the error.
+     */
+    bool crcError(void);
+
     /*
      * I/O
      */
@@ -140,10 +195,15 @@ public:
 
     /**
      * @brief Transmit multiple bytes.
+     *
+     * Buffers of at least SPI_DMA_THRESHOLD bytes are sent with DMA,
+     * unless another driver has claimed the DMA tubes. Received
+     * bytes are discarded.
+     *
      * @param buffer Bytes to transmit.
      * @param length Number of bytes in buffer to transmit.
      */
-    void write(const uint8 *buffer, uint32 length);
+    void write(const void *buffer, uint32 length);
 
     /**
      * @brief Transmit a byte, then return the next unread byte.
@@ -155,6 +215,142 @@ public:
      */
     uint8 transfer(uint8 data);
 
+    /**
+     * @brief Transmit a 16-bit frame, then return the one received.
+     *
+     * In 8-bit mode, this sends two frames, most significant byte
+     * first.
+     *
+     * @param data Frame to transmit.
+     * @return Frame received.
+     */
+    uint16 transfer16(uint16 data);
+
+    /**
+     * @brief Transmit and receive multiple bytes at once.
+     *
+     * Buffers of at least SPI_DMA_THRESHOLD bytes are transferred
+     * with DMA. Blocks until the transfer is done.
+     *
+     * @param txBuffer Bytes to transmit, or NULL to transmit 0xFF.
+     * @param rxBuffer Buffer to store received bytes into, or NULL
+     *                 to discard them. May be the same as txBuffer.
+     * @param length Number of bytes to transfer.
+     */
+    void transfer(const void *txBuffer, void *rxBuffer, uint32 length);
+
+    /**
+     * @brief Start transferring multiple bytes in the background.
+     *
+     * Like transfer(const void*, void*, uint32), but returns once a
+     * DMA transfer has started, and calls callback from an interrupt
+     * when it's done. Don't touch the buffers until then. Transfers
+     * shorter than SPI_DMA_THRESHOLD, or which can't use DMA because
+     * another driver has claimed the DMA tubes, happen right away,
+     * and callback is called before this function returns.
+     *
+     * @param txBuffer Bytes to transmit, or NULL to transmit 0xFF.
+     * @param rxBuffer Buffer to store received bytes into, or NULL
+     *                 to discard them.
+     * @param length Number of bytes to transfer.
+     * @param callback Function to call when done, or NULL.
+     * @return false if another transfer is in progress.
+     * @see isBusy()
+     */
+    bool transferAsync(const void *txBuffer, void *rxBuffer, uint32 length,
+                       voidFuncPtr callback);
+
+    /**
+     * @brief Start transmitting multiple bytes in the background.
+     *
+     * Equivalent to transferAsync(buffer, NULL, length, callback).
+     */
+    bool writeAsync(const void *buffer, uint32 length, voidFuncPtr callback);
+
+    /**
+     * @brief Return true while a background transfer is in progress.
+     */
+    bool isBusy(void);
+
+    /**
+     * @brief Block until any background transfer is done.
+     */
+    void waitForTransfer(void);
+
+    /*
+     * Slave streaming
+     */
+
+    /**
+     * @brief Stream everything a master sends into a ring buffer.
+     *
+     * Call after beginSlave(). Received frames go round and round
+     * rxBuffer using circular DMA, and callback is called from an
+     * interrupt with SPI_STREAM_HALF or SPI_STREAM_FULL whenever a
+     * half of it has filled up. If txBuffer isn't NULL, its contents
+     * are sent over and over in the same way.
+     *
+     * Edges on the NSS pin are reported to callback as
+     * SPI_STREAM_NSS_ASSERTED and SPI_STREAM_NSS_RELEASED, so the
+     * master's framing isn't lost. Use streamPosition() to find out
+     * where a frame ended.
+     *
+     * Nothing stops new data from overwriting frames which haven't
+     * been read yet, so keep up; if the master gets more than a
+     * buffer's length ahead, the unread frames are dropped, and
+     * streamOverrun() says so. Other transfers can't be used until
+     * endSlaveStream().
+     *
+     * @param rxBuffer Ring buffer for received frames.
+     * @param txBuffer Frames to send, or NULL.
+     * @param length Length of rxBuffer (and txBuffer) in frames; see
+     *               setFrameSize(). Must be even.
+     * @param callback Event handler, or NULL.
+     * @return false if the stream couldn't be started.
+     */
+    bool beginSlaveStream(void *rxBuffer, const void *txBuffer,
+                          uint16 length, SPIStreamCallback callback);
+
+    /**
+     * @brief Stop streaming started by beginSlaveStream().
+     */
+    void endSlaveStream(void);
+
+    /**
+     * @brief Return the index in the ring buffer where the next frame
+     *        will be received.
+     */
+    uint16 streamPosition(void);
+
+    /**
+     * @brief Return the number of received frames not yet returned
+     *        by streamRead().
+     *
+     * If new frames have overwritten unread ones, the unread frames
+     * are dropped, and this returns 0.
+     *
+     * @see streamOverrun()
+     */
+    uint32 streamAvailable(void);
+
+    /**
+     * @brief Check whether unread frames have been dropped.
+     *
+     * Frames are dropped when the master gets more than the ring
+     * buffer's length ahead of streamRead().
+     *
+     * @return true if frames were dropped since the last call.
+     */
+    bool streamOverrun(void);
+
+    /**
+     * @brief Copy received frames out of the ring buffer.
+     * @param buffer Where to copy frames to.
+     * @param length Maximum number of frames to copy.
+     * @return Number of frames copied.
+     */
+    uint32 streamRead(void *buffer, uint32 length);
+
     /*
      * Pin accessors
      */
@@ -220,6 +416,17 @@ public:
     uint8 recv(void);
 private:
     spi_dev *spi_d;
+    voidFuncPtr callback;
+    SPIStreamCallback streamCallback;
+    uint8 *streamBuffer;
+    uint16 streamHead;
+    uint32 streamLaps;             // Times streamHead has wrapped
+    volatile uint32 streamHalves;  // HALF and FULL events so far
+    bool streamOverran;
+
+    static void dmaDone(void *spi);
+    static void streamEvent(void *spi, spi_stream_event event);
+    static void nssChanged(void *spi);
 };
 
 #endif
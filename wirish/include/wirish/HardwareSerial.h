@@ -60,11 +60,16 @@ public:
     void begin(uint32 baud);
     void end(void);
 
+    /* DMA */
+    bool enableRxDMA(void);
+    void disableRxDMA(void);
+
     /* I/O */
     uint32 available(void);
     uint8 read(void);
     void flush(void);
     virtual void write(unsigned char);
+    virtual void write(const void *buf, uint32 len);
     using Print::write;
 
     /* Pin accessors */
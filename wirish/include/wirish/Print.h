@@ -25,6 +25,8 @@
 
 #include <libmaple/libmaple_types.h>
 
+#include <stdarg.h>
+
 enum {
     BYTE = 0,
     BIN  = 2,
@@ -33,6 +35,13 @@ enum {
     HEX  = 16
 };
 
+/* Pass as the digits argument to print(double) or print(float) to get
+ * digits which read back as the same value; usually, but not always,
+ * the fewest that do. */
+enum {
+    SHORTEST = -1
+};
+
 class Print {
 public:
     virtual void write(uint8 ch) = 0;
@@ -47,6 +56,7 @@ public:
     void print(unsigned long, int=DEC);
     void print(long long, int=DEC);
     void print(unsigned long long, int=DEC);
+    void print(float, int=2);
     void print(double, int=2);
     void println(void);
     void println(char);
@@ -58,10 +68,28 @@ public:
     void println(unsigned long, int=DEC);
     void println(long long, int=DEC);
     void println(unsigned long long, int=DEC);
+    void println(float, int=2);
     void println(double, int=2);
+
+    /* printf()-style output, without newlib's vfprintf() or the
+     * heap. Lines up to 64 characters go out in a single write();
+     * longer ones go out 64 characters at a time. GCC checks the
+     * arguments against fmt. Returns the number of characters
+     * printed. */
+    int printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    int vprintf(const char *fmt, va_list args)
+        __attribute__((format(printf, 2, 0)));
+
+    /* Like snprintf(): formats into buf, which always ends up
+     * NUL-terminated if size > 0. Returns the length the output
+     * would have had if buf were big enough. */
+    static int format(char *buf, uint32 size, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+    static int vformat(char *buf, uint32 size, const char *fmt,
+                       va_list args)
+        __attribute__((format(printf, 3, 0)));
 private:
-    void printNumber(unsigned long long, uint8);
-    void printFloat(double, uint8);
+    void printNumber(unsigned long long, uint8, bool);
 };
 
 #endif
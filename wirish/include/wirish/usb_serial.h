@@ -48,15 +48,28 @@ public:
 
     uint32 read(void *buf, uint32 len);
     uint8  read(void);
+    uint32 readBytes(void *buf, uint32 len, uint32 timeout);
+    uint32 readAvailable(void *buf, uint32 len);
 
+    /* The writes sleep until everything is queued, giving up only
+     * if the host stops reading for a while. writeAvailable() never
+     * blocks; it queues what fits and returns how much that was. */
     void write(uint8);
     void write(const char *str);
     void write(const void*, uint32);
+    uint32 writeAvailable(const void *buf, uint32 len);
+
+    /* Called from the USB interrupt when data arrives, or when the
+     * host takes some of what was written. */
+    void attachRxInterrupt(voidFuncPtr handler);
+    void detachRxInterrupt(void);
+    void attachTxInterrupt(voidFuncPtr handler);
+    void detachTxInterrupt(void);
 
     uint8 getRTS();
     uint8 getDTR();
     uint8 isConnected();
-    uint8 pending();
+    uint32 pending();
 };
 
 #if BOARD_HAVE_SERIALUSB
@@ -0,0 +1,1355 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file wirish/print_format.cpp
+ * @brief Number formatting support for Print.
+ *
+ * Floating point values are formatted using only integer arithmetic,
+ * so there's no soft-float code involved, and the results don't
+ * suffer from rounding errors:
+ *
+ * - Shortest output uses Grisu2 (Loitsch, "Printing Floating-Point
+ *   Numbers Quickly and Accurately with Integers", PLDI 2010).
+ *
+ * - Fixed and scientific output with a given precision generate the
+ *   exact decimal expansion of the value, one digit at a time, using
+ *   small bignums. A double never needs more than 35 words.
+ */
+
+#include "print_format.h"
+
+#include <libmaple/util.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace wirish::priv;
+
+/*
+ * FormatBuffer
+ */
+
+bool FormatBuffer::spill(void) {
+    if (!this->sink) {
+        return false;
+    }
+    if (this->len) {
+        this->sink->write(this->buf, this->len);
+        this->len = 0;
+    }
+    return true;
+}
+
+void FormatBuffer::put(const char *str, uint32 n) {
+    while (n--) {
+        this->put(*str++);
+    }
+}
+
+void FormatBuffer::fill(char ch, uint32 n) {
+    while (n--) {
+        this->put(ch);
+    }
+}
+
+/*
+ * Integers
+ */
+
+/* Pairs of decimal digits, "00" through "99", so printing a decimal
+ * number takes one division per two digits. */
+static const char decimal_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static inline char digit_char(uint32 digit) {
+    return digit < 10 ? '0' + digit : 'A' + digit - 10;
+}
+
+/* Like format_number(), for values which fit in 32 bits. These are
+ * much more common, and the Cortex-M3 can divide them in hardware;
+ * dividing a 64-bit value needs a call to __aeabi_uldivmod. */
+static char* format_number32(char *end, uint32 n, uint8 base) {
+    char *p = end;
+
+    if (base == 10) {
+        // The compiler turns division by a constant into a multiply.
+        while (n >= 100) {
+            uint32 pair = n % 100;
+            n /= 100;
+            p -= 2;
+            p[0] = decimal_pairs[2 * pair];
+            p[1] = decimal_pairs[2 * pair + 1];
+        }
+        if (n >= 10) {
+            p -= 2;
+            p[0] = decimal_pairs[2 * n];
+            p[1] = decimal_pairs[2 * n + 1];
+        } else {
+            *--p = '0' + n;
+        }
+    } else if (IS_POWER_OF_TWO(base)) {
+        uint32 shift = __builtin_ctz(base);
+        uint32 mask = base - 1;
+        do {
+            *--p = digit_char(n & mask);
+            n >>= shift;
+        } while (n > 0);
+    } else {
+        do {
+            *--p = digit_char(n % base);
+            n /= base;
+        } while (n > 0);
+    }
+
+    return p;
+}
+
+char* wirish::priv::format_number(char *end, uint64 n, uint8 base) {
+    if ((n >> 32) == 0) {
+        return format_number32(end, (uint32)n, base);
+    }
+
+    char *p = end;
+    if (base == 10) {
+        // Peel off nine digits at a time, so there's only one 64-bit
+        // division for every nine digits instead of one per digit.
+        const uint32 billion = 1000000000;
+        while (n >> 32) {
+            unsigned long long q = n / billion;
+            char *chunk = p - 9;
+            p = format_number32(p, (uint32)(n - q * billion), 10);
+            while (p > chunk) {
+                *--p = '0';
+            }
+            n = q;
+        }
+        return format_number32(p, (uint32)n, 10);
+    } else if (IS_POWER_OF_TWO(base)) {
+        uint32 shift = __builtin_ctz(base);
+        uint32 mask = base - 1;
+        do {
+            *--p = digit_char((uint32)n & mask);
+            n >>= shift;
+        } while (n > 0);
+    } else {
+        do {
+            *--p = digit_char(n % base);
+            n /= base;
+        } while (n > 0);
+    }
+    return p;
+}
+
+/*
+ * Decoding floating point values
+ */
+
+enum fp_class {
+    FP_CLASS_FINITE,
+    FP_CLASS_INFINITE,
+    FP_CLASS_NAN,
+};
+
+/* A finite value is m * 2^e. For normal values, the hidden bit is
+ * included in m. */
+struct decoded_fp {
+    uint64 m;
+    int e;
+    bool negative;
+    /* True when the next smaller value is closer than the next
+     * larger one, i.e. for powers of two (other than the smallest
+     * normal). Grisu needs to know this. */
+    bool lower_closer;
+    fp_class cls;
+};
+
+static void decode(decoded_fp *d, uint64 bits,
+                   uint32 mant_bits, uint32 exp_bits) {
+    uint64 frac = bits & ((1ULL << mant_bits) - 1);
+    uint32 max_exp = (1U << exp_bits) - 1;
+    uint32 exp = (uint32)(bits >> mant_bits) & max_exp;
+    int bias = (int)(max_exp >> 1) + (int)mant_bits;
+
+    d->negative = (bits >> (mant_bits + exp_bits)) & 1;
+    d->lower_closer = false;
+    if (exp == max_exp) {
+        d->cls = frac ? FP_CLASS_NAN : FP_CLASS_INFINITE;
+        return;
+    }
+    d->cls = FP_CLASS_FINITE;
+    if (exp == 0) {
+        d->m = frac;
+        d->e = 1 - bias;
+    } else {
+        d->m = frac | (1ULL << mant_bits);
+        d->e = (int)exp - bias;
+        d->lower_closer = (frac == 0 && exp > 1);
+    }
+}
+
+static void decode_double(decoded_fp *d, double x) {
+    uint64 bits;
+    memcpy(&bits, &x, sizeof(bits));
+    decode(d, bits, 52, 11);
+}
+
+static void decode_float(decoded_fp *d, float x) {
+    uint32 bits;
+    memcpy(&bits, &x, sizeof(bits));
+    decode(d, bits, 23, 8);
+}
+
+static void put_exponent(FormatBuffer *out, int exp, uint32 flags) {
+    out->put(flags & FLOAT_UPPERCASE ? 'E' : 'e');
+    out->put(exp < 0 ? '-' : '+');
+    if (exp < 0) {
+        exp = -exp;
+    }
+    if (exp >= 100) {
+        out->put('0' + exp / 100);
+    }
+    out->put('0' + (exp / 10) % 10);
+    out->put('0' + exp % 10);
+}
+
+/*
+ * Exact decimal expansion, for FLOAT_FIXED and FLOAT_SCIENTIFIC.
+ */
+
+/* Enough for 2^1024, in 16-bit pieces, or 2^-1074, in 32-bit ones. */
+#define EXACT_WORDS 35
+/* Enough for 309 decimal digits, four to a chunk. */
+#define EXACT_CHUNKS 80
+
+enum remainder_class {
+    REM_ZERO,
+    REM_BELOW_HALF,
+    REM_HALF,
+    REM_ABOVE_HALF,
+};
+
+/* The value being printed, split into an integer part and a fraction.
+ *
+ * The integer part is converted up front, into base-10000 chunks,
+ * least significant first, since its digits come out backwards.
+ *
+ * The fraction f is stored as the W-word integer f * 2^(32 * W), so
+ * multiplying it by 10 shifts the next decimal digit out of the top
+ * word. */
+struct exact_decimal {
+    uint16 chunks[EXACT_CHUNKS];
+    uint32 n_int_digits;
+    union {
+        uint16 half[2 * EXACT_WORDS];
+        uint32 word[EXACT_WORDS];
+    } big;
+    uint32 frac_lo;             // Lowest nonzero word of the fraction
+    uint32 frac_words;          // W
+};
+
+static const uint16 pow10_16[] = {1, 10, 100, 1000};
+
+static void exact_set_integer(exact_decimal *x, uint64 m, int shift) {
+    uint16 *half = x->big.half;
+    uint32 q = shift / 16;
+    uint32 r = shift % 16;
+    uint32 n = q;
+    uint32 carry = 0;
+
+    memset(half, 0, q * sizeof(half[0]));
+    for (uint32 i = 0; i < 4; i++) {
+        uint32 piece = ((uint32)(m >> (16 * i)) & 0xFFFF) << r;
+        half[n++] = (piece | carry) & 0xFFFF;
+        carry = piece >> 16;
+    }
+    half[n++] = carry;
+
+    // Divide by 10000 until nothing's left. Sticking to 16-bit pieces
+    // keeps this within reach of the hardware 32-bit divider.
+    uint32 n_chunks = 0;
+    while (n && half[n - 1] == 0) {
+        n--;
+    }
+    while (n) {
+        uint32 rem = 0;
+        for (uint32 i = n; i > 0; i--) {
+            uint32 cur = (rem << 16) | half[i - 1];
+            half[i - 1] = cur / 10000;
+            rem = cur % 10000;
+        }
+        x->chunks[n_chunks++] = rem;
+        while (n && half[n - 1] == 0) {
+            n--;
+        }
+    }
+
+    if (n_chunks == 0) {
+        x->n_int_digits = 0;
+        return;
+    }
+    uint32 top = x->chunks[n_chunks - 1];
+    uint32 top_digits = 1;
+    while (top_digits < 4 && top >= pow10_16[top_digits]) {
+        top_digits++;
+    }
+    x->n_int_digits = 4 * (n_chunks - 1) + top_digits;
+}
+
+/* k is the number of fraction bits; f is the fraction. */
+static void exact_set_fraction(exact_decimal *x, uint64 f, uint32 k) {
+    uint32 *word = x->big.word;
+    uint32 w = (k + 31) / 32;
+    uint32 s = 32 * w - k;
+    uint64 lo = f << s;
+    uint64 hi = s ? f >> (64 - s) : 0;
+
+    memset(word, 0, w * sizeof(word[0]));
+    // Since f < 2^k, anything that doesn't fit in w words is zero.
+    if (w > 0) {
+        word[0] = (uint32)lo;
+    }
+    if (w > 1) {
+        word[1] = (uint32)(lo >> 32);
+    }
+    if (w > 2) {
+        word[2] = (uint32)hi;
+    }
+    x->frac_words = w;
+    x->frac_lo = 0;
+    while (x->frac_lo < w && word[x->frac_lo] == 0) {
+        x->frac_lo++;
+    }
+}
+
+static void exact_init(exact_decimal *x, const decoded_fp *d) {
+    if (d->e >= 0) {
+        exact_set_integer(x, d->m, d->e);
+        exact_set_fraction(x, 0, 0);
+    } else {
+        uint32 k = -d->e;
+        if (k >= 64) {
+            exact_set_integer(x, 0, 0);
+            exact_set_fraction(x, d->m, k);
+        } else {
+            exact_set_integer(x, d->m >> k, 0);
+            exact_set_fraction(x, d->m & ((1ULL << k) - 1), k);
+        }
+    }
+}
+
+/* Returns the i-th digit of the integer part, counting from the most
+ * significant one. */
+static uint32 exact_int_digit(const exact_decimal *x, uint32 i) {
+    uint32 r = x->n_int_digits - 1 - i;
+    return (x->chunks[r / 4] / pow10_16[r % 4]) % 10;
+}
+
+static bool exact_frac_is_zero(const exact_decimal *x) {
+    return x->frac_lo == x->frac_words;
+}
+
+/* Returns the next digit of the fraction. Low-order words which are
+ * zero stay that way, so they're skipped. */
+static uint32 exact_frac_digit(exact_decimal *x) {
+    uint32 *word = x->big.word;
+    uint32 carry = 0;
+    for (uint32 i = x->frac_lo; i < x->frac_words; i++) {
+        uint64 t = (uint64)word[i] * 10 + carry;
+        word[i] = (uint32)t;
+        carry = (uint32)(t >> 32);
+    }
+    while (x->frac_lo < x->frac_words && word[x->frac_lo] == 0) {
+        x->frac_lo++;
+    }
+    return carry;
+}
+
+static remainder_class exact_frac_remainder(const exact_decimal *x) {
+    if (exact_frac_is_zero(x)) {
+        return REM_ZERO;
+    }
+    uint32 top = x->big.word[x->frac_words - 1];
+    if (top != 0x80000000) {
+        return top > 0x80000000 ? REM_ABOVE_HALF : REM_BELOW_HALF;
+    }
+    return x->frac_lo < x->frac_words - 1 ? REM_ABOVE_HALF : REM_HALF;
+}
+
+/* What's left after the first i integer digits, and the fraction. */
+static remainder_class exact_int_remainder(const exact_decimal *x,
+                                           uint32 i) {
+    if (i >= x->n_int_digits) {
+        return exact_frac_remainder(x);
+    }
+    uint32 next = exact_int_digit(x, i);
+    bool sticky = !exact_frac_is_zero(x);
+    for (uint32 j = i + 1; !sticky && j < x->n_int_digits; j++) {
+        sticky = exact_int_digit(x, j) != 0;
+    }
+    if (next != 5) {
+        return next > 5 ? REM_ABOVE_HALF :
+            (next || sticky) ? REM_BELOW_HALF : REM_ZERO;
+    }
+    return sticky ? REM_ABOVE_HALF : REM_HALF;
+}
+
+/* Writes a stream of digits, with a decimal point, and rounds the
+ * last one.
+ *
+ * Rounding up can carry through any number of trailing nines, so
+ * digits aren't written until it's certain they won't change: the
+ * last digit which isn't a nine is held back, along with a count of
+ * the nines after it. */
+struct digit_writer {
+    FormatBuffer *out;
+    uint32 point;               // '.' goes before this digit (0: none)
+    uint32 written;
+    int pending;                // Held back digit, or -1
+    uint32 nines;
+    uint32 last;
+    uint32 trailing_zeros;      // Among digits written so far
+};
+
+static void dw_init(digit_writer *dw, FormatBuffer *out, uint32 point) {
+    dw->out = out;
+    dw->point = point;
+    dw->written = 0;
+    dw->pending = -1;
+    dw->nines = 0;
+    dw->last = 0;
+    dw->trailing_zeros = 0;
+}
+
+static void dw_emit(digit_writer *dw, char ch) {
+    if (dw->point && dw->written == dw->point) {
+        dw->out->put('.');
+    }
+    dw->out->put(ch);
+    dw->written++;
+    dw->trailing_zeros = ch == '0' ? dw->trailing_zeros + 1 : 0;
+}
+
+static void dw_emit_nines(digit_writer *dw, char ch) {
+    while (dw->nines) {
+        dw_emit(dw, ch);
+        dw->nines--;
+    }
+}
+
+static void dw_digit(digit_writer *dw, uint32 digit) {
+    dw->last = digit;
+    if (digit == 9) {
+        dw->nines++;
+        return;
+    }
+    if (dw->pending >= 0) {
+        dw_emit(dw, '0' + dw->pending);
+    }
+    dw_emit_nines(dw, '9');
+    dw->pending = digit;
+}
+
+/* Returns true if every digit was a nine and rounding carried out of
+ * them. Nothing has been written in that case, and the caller must
+ * write the result (a one, followed by zeros). */
+static bool dw_finish(digit_writer *dw, remainder_class rem) {
+    bool up = (rem == REM_ABOVE_HALF ||
+               (rem == REM_HALF && (dw->last & 1)));
+    if (!up) {
+        if (dw->pending >= 0) {
+            dw_emit(dw, '0' + dw->pending);
+        }
+        dw_emit_nines(dw, '9');
+        return false;
+    }
+    if (dw->pending < 0) {
+        return true;
+    }
+    dw_emit(dw, '0' + dw->pending + 1);
+    dw_emit_nines(dw, '0');
+    return false;
+}
+
+static void format_fixed(FormatBuffer *out, const decoded_fp *d,
+                         uint32 precision, uint32 flags) {
+    exact_decimal x;
+    digit_writer dw;
+
+    exact_init(&x, d);
+    uint32 n_int = x.n_int_digits ? x.n_int_digits : 1;
+    dw_init(&dw, out, precision ? n_int : 0);
+
+    if (x.n_int_digits == 0) {
+        dw_digit(&dw, 0);
+    }
+    for (uint32 i = 0; i < x.n_int_digits; i++) {
+        dw_digit(&dw, exact_int_digit(&x, i));
+    }
+    for (uint32 i = 0; i < precision; i++) {
+        dw_digit(&dw, exact_frac_digit(&x));
+    }
+
+    if (dw_finish(&dw, exact_frac_remainder(&x))) {
+        // 99.9 -> 100.0: one more digit before the point.
+        dw.nines = n_int + precision;
+        dw.point += dw.point ? 1 : 0;
+        dw_emit(&dw, '1');
+        dw_emit_nines(&dw, '0');
+    }
+    if (!precision && (flags & FLOAT_ALTERNATE)) {
+        out->put('.');
+    }
+}
+
+/* Returns the exponent. If trailing_zeros isn't NULL, it's set to the
+ * number of zeros at the end of the digits. */
+static int format_scientific(FormatBuffer *out, const decoded_fp *d,
+                             uint32 precision, uint32 flags,
+                             uint32 *trailing_zeros) {
+    exact_decimal x;
+    digit_writer dw;
+    uint32 n_digits = precision + 1;
+    int exp;
+
+    dw_init(&dw, out, precision ? 1 : 0);
+
+    exact_init(&x, d);
+    remainder_class rem;
+    if (d->m == 0) {
+        exp = 0;
+        for (uint32 i = 0; i < n_digits; i++) {
+            dw_digit(&dw, 0);
+        }
+        rem = REM_ZERO;
+    } else if (x.n_int_digits) {
+        exp = x.n_int_digits - 1;
+        uint32 i;
+        for (i = 0; i < n_digits && i < x.n_int_digits; i++) {
+            dw_digit(&dw, exact_int_digit(&x, i));
+        }
+        if (i == n_digits) {
+            rem = exact_int_remainder(&x, i);
+        } else {
+            for (; i < n_digits; i++) {
+                dw_digit(&dw, exact_frac_digit(&x));
+            }
+            rem = exact_frac_remainder(&x);
+        }
+    } else {
+        // Skip leading zeros
+        uint32 digit;
+        exp = 0;
+        do {
+            digit = exact_frac_digit(&x);
+            exp--;
+        } while (digit == 0);
+        dw_digit(&dw, digit);
+        for (uint32 i = 1; i < n_digits; i++) {
+            dw_digit(&dw, exact_frac_digit(&x));
+        }
+        rem = exact_frac_remainder(&x);
+    }
+
+    if (dw_finish(&dw, rem)) {
+        // 9.99e1 -> 1.00e2
+        exp++;
+        dw.nines = n_digits - 1;
+        dw_emit(&dw, '1');
+        dw_emit_nines(&dw, '0');
+    }
+    if (!precision && (flags & FLOAT_ALTERNATE)) {
+        out->put('.');
+    }
+    put_exponent(out, exp, flags);
+    if (trailing_zeros) {
+        *trailing_zeros = dw.trailing_zeros;
+    }
+    return exp;
+}
+
+static void format_general(FormatBuffer *out, const decoded_fp *d,
+                           uint32 precision, uint32 flags) {
+    FormatBuffer dry_run(NULL, 0, NULL);
+    uint32 zeros;
+
+    if (precision == 0) {
+        precision = 1;
+    }
+    // Both notations round to the same significant digits, so this
+    // finds the exponent and how many trailing zeros to drop. A
+    // shorter precision doesn't change the rounding of what's left.
+    int exp = format_scientific(&dry_run, d, precision - 1, 0, &zeros);
+    if (flags & FLOAT_ALTERNATE) {
+        zeros = 0;
+    }
+
+    if (exp >= -4 && exp < (int)precision) {
+        uint32 decimals = precision - 1 - exp;
+        format_fixed(out, d, zeros < decimals ? decimals - zeros : 0, flags);
+    } else {
+        uint32 decimals = precision - 1;
+        format_scientific(out, d, zeros < decimals ? decimals - zeros : 0,
+                          flags, NULL);
+    }
+}
+
+/*
+ * Grisu2, for FLOAT_SHORTEST.
+ */
+
+/* A "do-it-yourself floating point" value, f * 2^e. */
+struct diy_fp {
+    uint64 f;
+    int e;
+};
+
+static diy_fp diy_make(uint64 f, int e) {
+    diy_fp ret = {f, e};
+    return ret;
+}
+
+/* Returns the upper 64 bits of the 128-bit product, rounded. */
+static diy_fp diy_mul(diy_fp x, diy_fp y) {
+    uint64 a = x.f >> 32, b = x.f & 0xFFFFFFFF;
+    uint64 c = y.f >> 32, d = y.f & 0xFFFFFFFF;
+    uint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64 mid = (bd >> 32) + (ad & 0xFFFFFFFF) + (bc & 0xFFFFFFFF);
+    mid += 1U << 31;
+    return diy_make(ac + (ad >> 32) + (bc >> 32) + (mid >> 32),
+                    x.e + y.e + 64);
+}
+
+static diy_fp diy_normalize(diy_fp x) {
+    while (!(x.f >> 63)) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+struct cached_power {
+    uint64 f;
+    int16 e;
+    int16 k;
+};
+
+/* Normalized approximations of 10^k, for k = -300, -292, ..., 324. */
+static const cached_power cached_powers[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 },
+};
+
+/* Returns a cached power c = 10^-k such that multiplying by it brings
+ * a value with binary exponent e into the range Grisu's digit
+ * generation can handle: -60 <= e + c.e + 64 <= -32. */
+static const cached_power* get_cached_power(int e) {
+    int f = -60 - e - 1;
+    // ceil(f * log10(2)), with log10(2) ~= 78913 / 2^18
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    int index = (300 + k + 7) / 8;
+    return &cached_powers[index];
+}
+
+/* Largest power of ten <= n, for n < 2^32; returns the number of
+ * decimal digits in n. */
+static uint32 largest_pow10(uint32 n, uint32 *pow10) {
+    uint32 p = 1000000000;
+    uint32 digits = 10;
+    while (digits > 1 && n < p) {
+        p /= 10;
+        digits--;
+    }
+    *pow10 = p;
+    return digits;
+}
+
+/* Nudges the last digit towards w, while staying inside the rounding
+ * interval. */
+static void grisu2_round(char *buf, uint32 len, uint64 dist, uint64 delta,
+                         uint64 rest, uint64 ten_k) {
+    while (rest < dist && delta - rest >= ten_k &&
+           (rest + ten_k < dist || dist - rest > rest + ten_k - dist)) {
+        buf[len - 1]--;
+        rest += ten_k;
+    }
+}
+
+/* Generates the digits of w, given the rounding interval (m_minus,
+ * m_plus). All three have been scaled by a cached power of ten. */
+static uint32 grisu2_digits(char *buf, int *dec_exp, diy_fp m_minus,
+                            diy_fp w, diy_fp m_plus) {
+    uint64 delta = m_plus.f - m_minus.f;
+    uint64 dist = m_plus.f - w.f;
+    uint32 shift = -m_plus.e;
+    uint64 one = 1ULL << shift;
+    uint32 p1 = (uint32)(m_plus.f >> shift);
+    uint64 p2 = m_plus.f & (one - 1);
+    uint32 len = 0;
+    uint32 pow10;
+    uint32 n = largest_pow10(p1, &pow10);
+
+    // Integer part: p1 < 2^32, so 32-bit division is enough.
+    while (n > 0) {
+        uint32 d = p1 / pow10;
+        p1 %= pow10;
+        buf[len++] = '0' + d;
+        n--;
+        uint64 rest = ((uint64)p1 << shift) + p2;
+        if (rest <= delta) {
+            *dec_exp += n;
+            grisu2_round(buf, len, dist, delta, rest,
+                         (uint64)pow10 << shift);
+            return len;
+        }
+        pow10 /= 10;
+    }
+
+    // Fractional part
+    uint32 m = 0;
+    while (true) {
+        p2 *= 10;
+        buf[len++] = '0' + (uint32)(p2 >> shift);
+        p2 &= one - 1;
+        m++;
+        delta *= 10;
+        dist *= 10;
+        if (p2 <= delta) {
+            break;
+        }
+    }
+    *dec_exp -= m;
+    grisu2_round(buf, len, dist, delta, p2, one);
+    return len;
+}
+
+/* Writes digits of d which round-trip into buf (at least 17
+ * characters); usually, but not always, the shortest. The value is
+ * then buf * 10^*dec_exp. */
+static uint32 grisu2(char *buf, int *dec_exp, const decoded_fp *d) {
+    diy_fp v = diy_make(d->m, d->e);
+    diy_fp m_plus = diy_normalize(diy_make(2 * v.f + 1, v.e - 1));
+    diy_fp m_minus = (d->lower_closer ?
+                      diy_make(4 * v.f - 1, v.e - 2) :
+                      diy_make(2 * v.f - 1, v.e - 1));
+    m_minus.f <<= m_minus.e - m_plus.e;
+    m_minus.e = m_plus.e;
+    diy_fp w = diy_normalize(v);
+
+    const cached_power *cp = get_cached_power(m_plus.e);
+    diy_fp c = diy_make(cp->f, cp->e);
+    w = diy_mul(w, c);
+    m_minus = diy_mul(m_minus, c);
+    m_plus = diy_mul(m_plus, c);
+
+    // Shrink the interval by one unit on either side, to account for
+    // the error in the multiplications.
+    m_minus.f++;
+    m_plus.f--;
+    *dec_exp = -cp->k;
+    return grisu2_digits(buf, dec_exp, m_minus, w, m_plus);
+}
+
+/* Outside this range of decimal point positions, use scientific
+ * notation. */
+#define SHORTEST_MIN_POINT (-4)
+
+static void format_shortest(FormatBuffer *out, const decoded_fp *d,
+                            int max_point) {
+    char buf[20];
+    int dec_exp;
+    uint32 len;
+
+    if (d->m == 0) {
+        out->put('0');
+        return;
+    }
+
+    len = grisu2(buf, &dec_exp, d);
+    // The value is 0.buf * 10^point
+    int point = (int)len + dec_exp;
+
+    if (point > 0 && point <= max_point) {
+        if ((uint32)point >= len) {
+            out->put(buf, len);
+            out->fill('0', point - len);
+        } else {
+            out->put(buf, point);
+            out->put('.');
+            out->put(buf + point, len - point);
+        }
+    } else if (point <= 0 && point > SHORTEST_MIN_POINT) {
+        out->put("0.", 2);
+        out->fill('0', -point);
+        out->put(buf, len);
+    } else {
+        out->put(buf[0]);
+        if (len > 1) {
+            out->put('.');
+            out->put(buf + 1, len - 1);
+        }
+        put_exponent(out, point - 1, 0);
+    }
+}
+
+/*
+ * printf()
+ */
+
+/* Flags */
+#define FMT_LEFT        0x01    /* '-' */
+#define FMT_PLUS        0x02    /* '+' */
+#define FMT_SPACE       0x04    /* ' ' */
+#define FMT_ALT         0x08    /* '#' */
+#define FMT_ZERO        0x10    /* '0' */
+
+/* Length modifiers */
+enum fmt_length {
+    LEN_DEFAULT,
+    LEN_CHAR,                   /* hh */
+    LEN_SHORT,                  /* h */
+    LEN_LONG,                   /* l */
+    LEN_LLONG,                  /* ll */
+    LEN_INTMAX,                 /* j */
+    LEN_SIZE,                   /* z, t */
+    LEN_LDOUBLE,                /* L */
+};
+
+struct fmt_spec {
+    uint32 flags;
+    uint32 width;
+    int precision;              /* -1 if none was given */
+    fmt_length length;
+};
+
+static int64 fetch_signed(va_list *args, fmt_length length) {
+    switch (length) {
+    case LEN_CHAR:
+        return (signed char)va_arg(*args, int);
+    case LEN_SHORT:
+        return (short)va_arg(*args, int);
+    case LEN_LONG:
+        return va_arg(*args, long);
+    case LEN_LLONG:
+        return va_arg(*args, long long);
+    case LEN_INTMAX:
+        return va_arg(*args, intmax_t);
+    case LEN_SIZE:
+        return va_arg(*args, ptrdiff_t);
+    default:
+        return va_arg(*args, int);
+    }
+}
+
+static uint64 fetch_unsigned(va_list *args, fmt_length length) {
+    switch (length) {
+    case LEN_CHAR:
+        return (unsigned char)va_arg(*args, unsigned);
+    case LEN_SHORT:
+        return (unsigned short)va_arg(*args, unsigned);
+    case LEN_LONG:
+        return va_arg(*args, unsigned long);
+    case LEN_LLONG:
+        return va_arg(*args, unsigned long long);
+    case LEN_INTMAX:
+        return va_arg(*args, uintmax_t);
+    case LEN_SIZE:
+        return va_arg(*args, size_t);
+    default:
+        return va_arg(*args, unsigned);
+    }
+}
+
+/* Sign for signed conversions, or "" */
+static uint32 sign_prefix(char *prefix, const fmt_spec *spec,
+                          bool negative) {
+    if (negative) {
+        *prefix = '-';
+    } else if (spec->flags & FMT_PLUS) {
+        *prefix = '+';
+    } else if (spec->flags & FMT_SPACE) {
+        *prefix = ' ';
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* Writes prefix, then zeros, then body, padded out to the field
+ * width. */
+static void put_field(FormatBuffer *out, const fmt_spec *spec,
+                      const char *prefix, uint32 prefix_len,
+                      uint32 zeros, const char *body, uint32 body_len) {
+    uint32 len = prefix_len + zeros + body_len;
+    uint32 pad = spec->width > len ? spec->width - len : 0;
+
+    if (!(spec->flags & FMT_LEFT)) {
+        out->fill(' ', pad);
+    }
+    out->put(prefix, prefix_len);
+    out->fill('0', zeros);
+    out->put(body, body_len);
+    if (spec->flags & FMT_LEFT) {
+        out->fill(' ', pad);
+    }
+}
+
+static void put_integer(FormatBuffer *out, const fmt_spec *spec,
+                        uint64 n, bool negative, char conv) {
+    char buf[24];
+    char *end = buf + sizeof(buf);
+    char *start = end;
+    char prefix[2];
+    uint32 prefix_len = 0;
+    uint8 base = 10;
+
+    if (conv == 'o') {
+        base = 8;
+    } else if (conv == 'x' || conv == 'X' || conv == 'p') {
+        base = 16;
+    }
+
+    // An explicit zero precision prints zero as nothing at all.
+    if (n || spec->precision != 0) {
+        start = format_number(end, n, base);
+        if (conv != 'X') {
+            for (char *p = start; p < end; p++) {
+                *p |= 0x20;     // Lowercase; leaves digits alone
+            }
+        }
+    }
+    uint32 digits = end - start;
+    uint32 zeros = (spec->precision > (int)digits ?
+                    spec->precision - digits : 0);
+
+    if (conv == 'd' || conv == 'i') {
+        prefix_len = sign_prefix(prefix, spec, negative);
+    } else if (conv == 'p' || ((spec->flags & FMT_ALT) && base == 16 && n)) {
+        prefix[prefix_len++] = '0';
+        prefix[prefix_len++] = conv == 'X' ? 'X' : 'x';
+    } else if ((spec->flags & FMT_ALT) && base == 8 && zeros == 0 &&
+               (digits == 0 || *start != '0')) {
+        zeros = 1;
+    }
+
+    if ((spec->flags & (FMT_ZERO | FMT_LEFT)) == FMT_ZERO &&
+        spec->precision < 0) {
+        uint32 len = prefix_len + zeros + digits;
+        if (spec->width > len) {
+            zeros += spec->width - len;
+        }
+    }
+    put_field(out, spec, prefix, prefix_len, zeros, start, digits);
+}
+
+static void put_floating(FormatBuffer *out, const fmt_spec *spec,
+                         double x, char conv) {
+    uint64 bits;
+    char prefix[1];
+    float_style style;
+    uint32 flags = 0;
+
+    // Take the sign off here, so zero padding can go after it.
+    memcpy(&bits, &x, sizeof(bits));
+    uint32 prefix_len = sign_prefix(prefix, spec, bits >> 63);
+    bits &= ~(1ULL << 63);
+    memcpy(&x, &bits, sizeof(x));
+    bool finite = ((bits >> 52) & 0x7FF) != 0x7FF;
+
+    switch (conv | 0x20) {
+    case 'f':
+        style = FLOAT_FIXED;
+        break;
+    case 'e':
+        style = FLOAT_SCIENTIFIC;
+        break;
+    default:
+        style = FLOAT_GENERAL;
+        break;
+    }
+    if (conv < 'a') {
+        flags |= FLOAT_UPPERCASE;
+    }
+    if (spec->flags & FMT_ALT) {
+        flags |= FLOAT_ALTERNATE;
+    }
+    int precision = spec->precision < 0 ? 6 : spec->precision;
+
+    // Padding needs the length up front, so format twice.
+    uint32 zeros = 0;
+    uint32 pad = 0;
+    if (spec->width) {
+        FormatBuffer dry_run(NULL, 0, NULL);
+        format_double(&dry_run, x, style, precision, flags);
+        uint32 len = prefix_len + dry_run.count();
+        if (spec->width > len) {
+            if ((spec->flags & (FMT_ZERO | FMT_LEFT)) == FMT_ZERO && finite) {
+                zeros = spec->width - len;
+            } else {
+                pad = spec->width - len;
+            }
+        }
+    }
+
+    if (!(spec->flags & FMT_LEFT)) {
+        out->fill(' ', pad);
+    }
+    out->put(prefix, prefix_len);
+    out->fill('0', zeros);
+    format_double(out, x, style, precision, flags);
+    if (spec->flags & FMT_LEFT) {
+        out->fill(' ', pad);
+    }
+}
+
+static const char* parse_spec(const char *fmt, fmt_spec *spec,
+                              va_list *args) {
+    spec->flags = 0;
+    spec->width = 0;
+    spec->precision = -1;
+    spec->length = LEN_DEFAULT;
+
+    for (;; fmt++) {
+        uint32 flag;
+        switch (*fmt) {
+        case '-': flag = FMT_LEFT; break;
+        case '+': flag = FMT_PLUS; break;
+        case ' ': flag = FMT_SPACE; break;
+        case '#': flag = FMT_ALT; break;
+        case '0': flag = FMT_ZERO; break;
+        default: flag = 0; break;
+        }
+        if (!flag) {
+            break;
+        }
+        spec->flags |= flag;
+    }
+
+    if (*fmt == '*') {
+        int width = va_arg(*args, int);
+        if (width < 0) {
+            spec->flags |= FMT_LEFT;
+            width = -width;
+        }
+        spec->width = width;
+        fmt++;
+    } else {
+        while (*fmt >= '0' && *fmt <= '9') {
+            spec->width = 10 * spec->width + (*fmt++ - '0');
+        }
+    }
+
+    if (*fmt == '.') {
+        fmt++;
+        if (*fmt == '*') {
+            int precision = va_arg(*args, int);
+            spec->precision = precision < 0 ? -1 : precision;
+            fmt++;
+        } else {
+            spec->precision = 0;
+            while (*fmt >= '0' && *fmt <= '9') {
+                spec->precision = 10 * spec->precision + (*fmt++ - '0');
+            }
+        }
+    }
+
+    switch (*fmt) {
+    case 'h':
+        fmt++;
+        spec->length = LEN_SHORT;
+        if (*fmt == 'h') {
+            fmt++;
+            spec->length = LEN_CHAR;
+        }
+        break;
+    case 'l':
+        fmt++;
+        spec->length = LEN_LONG;
+        if (*fmt == 'l') {
+            fmt++;
+            spec->length = LEN_LLONG;
+        }
+        break;
+    case 'j':
+        fmt++;
+        spec->length = LEN_INTMAX;
+        break;
+    case 'z':
+    case 't':
+        fmt++;
+        spec->length = LEN_SIZE;
+        break;
+    case 'L':
+        fmt++;
+        spec->length = LEN_LDOUBLE;
+        break;
+    }
+
+    return fmt;
+}
+
+static void format_args(FormatBuffer *out, const char *fmt, va_list *args) {
+    while (*fmt) {
+        // Copy literal text a run at a time.
+        const char *text = fmt;
+        while (*fmt && *fmt != '%') {
+            fmt++;
+        }
+        out->put(text, fmt - text);
+        if (!*fmt) {
+            break;
+        }
+
+        const char *start = fmt;
+        fmt_spec spec;
+        fmt = parse_spec(fmt + 1, &spec, args);
+        char conv = *fmt;
+        if (!conv) {
+            // Incomplete conversion at the end of fmt
+            out->put(start, fmt - start);
+            break;
+        }
+        fmt++;
+
+        switch (conv) {
+        case 'd':
+        case 'i': {
+            int64 n = fetch_signed(args, spec.length);
+            // Negate as unsigned, so the most negative value works.
+            put_integer(out, &spec, n < 0 ? -(uint64)n : (uint64)n,
+                        n < 0, conv);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            put_integer(out, &spec, fetch_unsigned(args, spec.length),
+                        false, conv);
+            break;
+        case 'p':
+            put_integer(out, &spec, (uintptr_t)va_arg(*args, void*),
+                        false, conv);
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G': {
+            double x;
+            if (spec.length == LEN_LDOUBLE) {
+                x = (double)va_arg(*args, long double);
+            } else {
+                x = va_arg(*args, double);
+            }
+            put_floating(out, &spec, x, conv);
+            break;
+        }
+        case 'c': {
+            char ch = (char)va_arg(*args, int);
+            put_field(out, &spec, NULL, 0, 0, &ch, 1);
+            break;
+        }
+        case 's': {
+            const char *str = va_arg(*args, const char*);
+            uint32 len = 0;
+            if (!str) {
+                str = "(null)";
+            }
+            while (str[len] &&
+                   (spec.precision < 0 || len < (uint32)spec.precision)) {
+                len++;
+            }
+            put_field(out, &spec, NULL, 0, 0, str, len);
+            break;
+        }
+        case '%':
+            out->put('%');
+            break;
+        default:
+            // Unsupported; print it as-is.
+            out->put(start, fmt - start);
+            break;
+        }
+    }
+}
+
+/*
+ * Entry points
+ */
+
+static void format_decoded(FormatBuffer *out, const decoded_fp *d,
+                           float_style style, int precision,
+                           uint32 flags, int max_point) {
+    bool upper = flags & FLOAT_UPPERCASE;
+    if (d->cls == FP_CLASS_NAN) {
+        out->put(upper ? "NAN" : "nan", 3);
+        return;
+    }
+    if (d->negative) {
+        out->put('-');
+    }
+    if (d->cls == FP_CLASS_INFINITE) {
+        out->put(upper ? "INF" : "inf", 3);
+        return;
+    }
+
+    if (precision < 0) {
+        style = FLOAT_SHORTEST;
+    }
+    switch (style) {
+    case FLOAT_FIXED:
+        format_fixed(out, d, precision, flags);
+        break;
+    case FLOAT_SCIENTIFIC:
+        format_scientific(out, d, precision, flags, NULL);
+        break;
+    case FLOAT_GENERAL:
+        format_general(out, d, precision, flags);
+        break;
+    case FLOAT_SHORTEST:
+        format_shortest(out, d, max_point);
+        break;
+    }
+}
+
+namespace wirish {
+    namespace priv {
+
+        void format_double(FormatBuffer *out, double x,
+                           float_style style, int precision,
+                           uint32 flags) {
+            decoded_fp d;
+            decode_double(&d, x);
+            format_decoded(out, &d, style, precision, flags, 17);
+        }
+
+        void format_float(FormatBuffer *out, float x,
+                          float_style style, int precision,
+                          uint32 flags) {
+            decoded_fp d;
+            decode_float(&d, x);
+            format_decoded(out, &d, style, precision, flags, 9);
+        }
+
+        void format_va(FormatBuffer *out, const char *fmt, va_list args) {
+            // Helpers take a pointer to the va_list; copying it first
+            // makes that work where va_list is an array type.
+            va_list ap;
+            va_copy(ap, args);
+            format_args(out, fmt, &ap);
+            va_end(ap);
+        }
+
+    }
+}
@@ -0,0 +1,158 @@
+/******************************************************************************
+ * The MIT License
+ *
+ * Copyright (c) 2012 LeafLabs, LLC.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *****************************************************************************/
+
+/**
+ * @file wirish/print_format.h
+ * @brief Private number formatting support for Print.
+ *
+ * It is not part of the public Wirish API, and can change without
+ * notice.
+ */
+
+#ifndef _WIRISH_PRINT_FORMAT_H_
+#define _WIRISH_PRINT_FORMAT_H_
+
+#include <libmaple/libmaple_types.h>
+#include <wirish/Print.h>
+
+#include <stdarg.h>
+
+namespace wirish {
+    namespace priv {
+
+        /*
+         * Output buffering
+         */
+
+        /* Collects formatted output in a caller-provided buffer.
+         *
+         * If there's a sink, a full buffer is written to it and
+         * reused, so output of any length goes through in as few
+         * write() calls as possible. Otherwise, anything that doesn't
+         * fit is dropped, but still counted. */
+        class FormatBuffer {
+        public:
+            FormatBuffer(char *buf, uint32 size, Print *sink)
+                : buf(buf), size(size), len(0), total(0), sink(sink) { }
+
+            void put(char ch) {
+                if (this->len == this->size && !this->spill()) {
+                    this->total++;
+                    return;
+                }
+                this->buf[this->len++] = ch;
+                this->total++;
+            }
+            void put(const char *str, uint32 n);
+            void fill(char ch, uint32 n);
+
+            /* Send anything buffered to the sink, if there is one. */
+            void flush(void) { this->spill(); }
+
+            /* Number of characters put so far, including any that
+             * were dropped. */
+            uint32 count(void) { return this->total; }
+
+            /* Number of characters in the buffer right now. */
+            uint32 length(void) { return this->len; }
+
+        private:
+            bool spill(void);
+
+            char *buf;
+            uint32 size;
+            uint32 len;
+            uint32 total;
+            Print *sink;
+        };
+
+        /*
+         * Integers
+         */
+
+        /* Formats n into the characters just before end, and returns
+         * a pointer to the first one. Digits above 9 are uppercase.
+         * There must be room for all of n's digits in the given base
+         * (at most 64). */
+        char* format_number(char *end, uint64 n, uint8 base);
+
+        /*
+         * Floating point
+         */
+
+        enum float_style {
+            /* [-]ddd.ddd, with `precision' digits after the point. */
+            FLOAT_FIXED,
+            /* [-]d.ddde[+-]dd, with `precision' digits after the point. */
+            FLOAT_SCIENTIFIC,
+            /* printf()'s %g: `precision' significant digits, in
+             * whichever of the above is shorter, without trailing
+             * zeros. */
+            FLOAT_GENERAL,
+            /* Digits which read back as the same value: usually,
+             * but not always, as few as possible (this uses Grisu2,
+             * which can be a digit or so long for a small fraction
+             * of values). `precision' is ignored. Uses scientific
+             * notation for very large and very small magnitudes. */
+            FLOAT_SHORTEST,
+        };
+
+        /* Flags for format_double() and format_float(). */
+        enum {
+            /* "1E+10", "INF", and "NAN". */
+            FLOAT_UPPERCASE = 0x1,
+            /* printf()'s '#' flag: always print a decimal point, and
+             * keep FLOAT_GENERAL's trailing zeros. */
+            FLOAT_ALTERNATE = 0x2,
+        };
+
+        /* Output other than FLOAT_SHORTEST is the exact decimal
+         * value, correctly rounded (ties to even) to the requested
+         * precision. Infinities and NaNs print as "inf", "-inf" and
+         * "nan". */
+        void format_double(FormatBuffer *out, double x,
+                           float_style style, int precision,
+                           uint32 flags = 0);
+        /* Like format_double(), but never converts x to double.
+         * FLOAT_SHORTEST prints a string which reads back as the
+         * same float, usually the shortest, so e.g. 0.1f prints as
+         * "0.1". */
+        void format_float(FormatBuffer *out, float x,
+                          float_style style, int precision,
+                          uint32 flags = 0);
+
+        /*
+         * printf()
+         */
+
+        /* Supports the C99 conversions and flags, except for %n,
+         * %a, and wide characters. */
+        void format_va(FormatBuffer *out, const char *fmt, va_list args);
+
+    }
+}
+
+#endif
@@ -28,6 +28,7 @@ cppSRCS_$(d) += ext_interrupts.cpp
 cppSRCS_$(d) += HardwareSerial.cpp
 cppSRCS_$(d) += HardwareTimer.cpp
 cppSRCS_$(d) += Print.cpp
+cppSRCS_$(d) += print_format.cpp
 cppSRCS_$(d) += pwm.cpp
 ifeq ($(MCU_SERIES), stm32f1)
 cppSRCS_$(d) += usb_serial.cpp	# HACK: this is currently STM32F1 only.
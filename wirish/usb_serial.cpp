@@ -45,15 +45,30 @@
 
 #if BOARD_HAVE_SERIALUSB
 static void rxHook(unsigned, void*);
+static void txHook(unsigned, void*);
 static void ifaceSetupHook(unsigned, void*);
 #endif
 
+/* User handlers, called by rxHook() and txHook() */
+static voidFuncPtr rx_handler = 0;
+static voidFuncPtr tx_handler = 0;
+
 /*
  * USBSerial interface
  */
 
+/* How long write() waits for the host to make room in the TX queue
+ * before giving up, in ms. */
 #define USB_TIMEOUT 50
 
+/* Sleeps until the next interrupt. The USB interrupt wakes us up
+ * when a packet arrives or leaves; if it fires just before we get
+ * here, the next SysTick wakes us instead, so we're never more than
+ * a millisecond late. */
+static inline void waitForInterrupt(void) {
+    asm volatile("wfi");
+}
+
 USBSerial::USBSerial(void) {
 #if !BOARD_HAVE_SERIALUSB
     ASSERT(0);
@@ -64,6 +79,7 @@ void USBSerial::begin(void) {
 #if BOARD_HAVE_SERIALUSB
     usb_cdcacm_enable(BOARD_USB_DISC_DEV, BOARD_USB_DISC_BIT);
     usb_cdcacm_set_hooks(USB_CDCACM_HOOK_RX, rxHook);
+    usb_cdcacm_set_hooks(USB_CDCACM_HOOK_TX, txHook);
     usb_cdcacm_set_hooks(USB_CDCACM_HOOK_IFACE_SETUP, ifaceSetupHook);
 #endif
 }
@@ -71,7 +87,8 @@ void USBSerial::begin(void) {
 void USBSerial::end(void) {
 #if BOARD_HAVE_SERIALUSB
     usb_cdcacm_disable(BOARD_USB_DISC_DEV, BOARD_USB_DISC_BIT);
-    usb_cdcacm_remove_hooks(USB_CDCACM_HOOK_RX | USB_CDCACM_HOOK_IFACE_SETUP);
+    usb_cdcacm_remove_hooks(USB_CDCACM_HOOK_RX | USB_CDCACM_HOOK_TX |
+                            USB_CDCACM_HOOK_IFACE_SETUP);
 #endif
 }
 
@@ -83,28 +100,49 @@ void USBSerial::write(const char *str) {
     this->write(str, strlen(str));
 }
 
+/* Returns as soon as everything is queued. If the queue is full,
+ * sleeps until the host makes room, but gives up on the rest if the
+ * host stops reading for USB_TIMEOUT ms. With interrupts disabled,
+ * or in an interrupt handler, neither the USB interrupt nor millis()
+ * can move, so it only queues what fits. */
 void USBSerial::write(const void *buf, uint32 len) {
     if (!this->isConnected() || !buf) {
         return;
     }
 
-    uint32 txed = 0;
-    uint32 old_txed = 0;
+    const uint8 *bytes = (const uint8*)buf;
     uint32 start = millis();
 
-    while (txed < len && (millis() - start < USB_TIMEOUT)) {
-        txed += usb_cdcacm_tx((const uint8*)buf + txed, len - txed);
-        if (old_txed != txed) {
+    while (len) {
+        uint32 txed = usb_cdcacm_tx(bytes, len);
+        if (txed) {
+            bytes += txed;
+            len -= txed;
             start = millis();
+        } else if (nvic_globalirq_disabled() || nvic_in_handler() ||
+                   millis() - start >= USB_TIMEOUT ||
+                   !this->isConnected()) {
+            return;
+        } else {
+            waitForInterrupt();
         }
-        old_txed = txed;
     }
 }
 
+/* Never blocks. Queues as much of buf as fits, and returns how many
+ * bytes that was. */
+uint32 USBSerial::writeAvailable(const void *buf, uint32 len) {
+    if (!this->isConnected() || !buf) {
+        return 0;
+    }
+    return usb_cdcacm_tx((const uint8*)buf, len);
+}
+
 uint32 USBSerial::available(void) {
     return usb_cdcacm_data_available();
 }
 
+/* Blocks until len bytes are received. */
 uint32 USBSerial::read(void *buf, uint32 len) {
     if (!buf) {
         return 0;
@@ -112,12 +150,49 @@ uint32 USBSerial::read(void *buf, uint32 len) {
 
     uint32 rxed = 0;
     while (rxed < len) {
-        rxed += usb_cdcacm_rx((uint8*)buf + rxed, len - rxed);
+        uint32 n = usb_cdcacm_rx((uint8*)buf + rxed, len - rxed);
+        if (n) {
+            rxed += n;
+        } else {
+            waitForInterrupt();
+        }
+    }
+
+    return rxed;
+}
+
+/* Blocks until len bytes are received, or timeout ms go by. Returns
+ * how many bytes were received. */
+uint32 USBSerial::readBytes(void *buf, uint32 len, uint32 timeout) {
+    if (!buf) {
+        return 0;
+    }
+
+    uint32 rxed = 0;
+    uint32 start = millis();
+    while (rxed < len) {
+        uint32 n = usb_cdcacm_rx((uint8*)buf + rxed, len - rxed);
+        if (n) {
+            rxed += n;
+        } else if (millis() - start >= timeout) {
+            break;
+        } else {
+            waitForInterrupt();
+        }
     }
 
     return rxed;
 }
 
+/* Never blocks. Reads up to len bytes of whatever has arrived, and
+ * returns how many that was. */
+uint32 USBSerial::readAvailable(void *buf, uint32 len) {
+    if (!buf) {
+        return 0;
+    }
+    return usb_cdcacm_rx((uint8*)buf, len);
+}
+
 /* Blocks forever until 1 byte is received */
 uint8 USBSerial::read(void) {
     uint8 b;
@@ -125,7 +200,7 @@ uint8 USBSerial::read(void) {
     return b;
 }
 
-uint8 USBSerial::pending(void) {
+uint32 USBSerial::pending(void) {
     return usb_cdcacm_get_pending();
 }
 
@@ -141,6 +216,22 @@ uint8 USBSerial::getRTS(void) {
     return usb_cdcacm_get_rts();
 }
 
+void USBSerial::attachRxInterrupt(voidFuncPtr handler) {
+    rx_handler = handler;
+}
+
+void USBSerial::detachRxInterrupt(void) {
+    rx_handler = 0;
+}
+
+void USBSerial::attachTxInterrupt(voidFuncPtr handler) {
+    tx_handler = handler;
+}
+
+void USBSerial::detachTxInterrupt(void) {
+    tx_handler = 0;
+}
+
 #if BOARD_HAVE_SERIALUSB
 USBSerial SerialUSB;
 #endif
@@ -196,9 +287,10 @@ static void wait_reset(void) {
 #define STACK_TOP 0x20000800
 #define EXC_RETURN 0xFFFFFFF9
 #define DEFAULT_CPSR 0x61000000
-static void rxHook(unsigned hook, void *ignored) {
-    /* FIXME this is mad buggy; we need a new reset sequence. E.g. NAK
-     * after each RX means you can't reset if any bytes are waiting. */
+static void checkResetSequence(void) {
+    /* FIXME this is mad buggy; we need a new reset sequence. E.g. we
+     * only look at the head of the RX queue, so you can't reset if
+     * any bytes are waiting. */
     if (reset_state == DTR_NEGEDGE) {
         reset_state = DTR_LOW;
 
@@ -246,4 +338,17 @@ static void rxHook(unsigned hook, void *ignored) {
     }
 }
 
+static void rxHook(unsigned hook, void *ignored) {
+    checkResetSequence();
+    if (rx_handler) {
+        rx_handler();
+    }
+}
+
+static void txHook(unsigned hook, void *ignored) {
+    if (tx_handler) {
+        tx_handler();
+    }
+}
+
 #endif  // BOARD_HAVE_SERIALUSB